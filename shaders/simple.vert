@@ -1,22 +1,29 @@
 #version 330 core
 
+// Must match VERTEX_POSITION_SUBPIXELS in renderer.h
+#define POSITION_SUBPIXELS 4.0
+
 layout(location = 0) in vec2 position;
 layout(location = 1) in vec2 uv;
 layout(location = 2) in vec4 color;
+layout(location = 3) in uint layer;
 
 uniform vec2 resolution;
-uniform vec2 scroll_pos;
+uniform vec2 origin;
 
 out vec2 out_uv;
 out vec4 out_color;
+flat out uint out_layer;
 
 void main() {
+    vec2 screen_pos = origin + position / POSITION_SUBPIXELS;
     gl_Position = vec4(
-        2 * ((position.x - scroll_pos.x) / resolution.x - 0.5),
-        -2 * ((position.y - scroll_pos.y) / resolution.y - 0.5),
+        2 * (screen_pos.x / resolution.x - 0.5),
+        -2 * (screen_pos.y / resolution.y - 0.5),
         0,
         1
     );
     out_color = color;
     out_uv = uv;
+    out_layer = layer;
 }
@@ -0,0 +1,12 @@
+#version 330 core
+
+uniform sampler2D image;
+
+in vec2 out_uv;
+in vec4 out_color;
+flat in uint out_layer;
+
+void main() {
+    float density = texture(image, out_uv).r;
+    gl_FragColor = vec4(out_color.rgb, out_color.a * density);
+}
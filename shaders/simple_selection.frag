@@ -0,0 +1,24 @@
+#version 330 core
+
+// Selected [x0, x1) spans of every visual row, one texel row per row
+uniform sampler2D image;
+// Width of the quad in pixels and the number of rows it covers
+uniform vec2 extent;
+
+in vec2 out_uv;
+in vec4 out_color;
+flat in uint out_layer;
+
+void main() {
+    float x = out_uv.x * extent.x;
+    int row = int(out_uv.y * extent.y);
+    int spans = textureSize(image, 0).x;
+    for(int i = 0; i < spans; ++i) {
+        vec2 span = texelFetch(image, ivec2(i, row), 0).rg;
+        if(x >= span.x && x < span.y) {
+            gl_FragColor = out_color;
+            return;
+        }
+    }
+    discard;
+}
@@ -1,12 +1,13 @@
 #version 330 core
 
-uniform sampler2D image;
+uniform sampler2DArray image;
 
 in vec2 out_uv;
 in vec4 out_color;
+flat in uint out_layer;
 
 void main() {
-    float d = texture(image, out_uv).r;
+    float d = texture(image, vec3(out_uv, float(out_layer))).r;
     float aaf = fwidth(d);
     float alpha = smoothstep(0.5 - aaf, 0.5 + aaf, d);
     gl_FragColor = vec4(out_color.rgb, alpha);
@@ -0,0 +1,113 @@
+#include "./advance_cache.h"
+
+#include <stdlib.h>
+
+#include "./editor/wrap.h"
+
+void advance_cache_init(AdvanceCache *ac) {
+    *ac = (AdvanceCache) {0};
+    line_cache_init(&ac->index, ADVANCE_CACHE_SLOTS);
+}
+
+static void advance_cache_wrap(LineAdvances *advances, const char *text, float width) {
+    advances->wrap_width = width;
+    for(;;) {
+        advances->rows = wrap_line(
+            text, advances->x, advances->length, width,
+            advances->starts, advances->starts_capacity
+        );
+        if(advances->rows <= advances->starts_capacity)
+            return;
+        advances->starts_capacity = advances->rows * 2;
+        advances->starts = (size_t *) realloc(advances->starts, advances->starts_capacity * sizeof(size_t));
+    }
+}
+
+const LineAdvances *advance_cache_get(AdvanceCache *ac, Font *font, Line *line, float width) {
+    if(ac->font_generation != font->atlas.generation) {
+        line_cache_clear(&ac->index);
+        ac->font_generation = font->atlas.generation;
+    }
+
+    size_t slot;
+    LineAdvances *advances;
+    if(line_cache_get(&ac->index, line->id, line->version, &slot)) {
+        advances = &ac->lines[slot];
+        if(advances->wrap_width != width)
+            advance_cache_wrap(advances, line->buffer, width);
+        return advances;
+    }
+
+    advances = &ac->lines[slot];
+    if(line->buffer_size + 1 > advances->capacity) {
+        advances->capacity = line->buffer_size + 1;
+        advances->x = (float *) realloc(advances->x, advances->capacity * sizeof(float));
+    }
+    advances->length = line->buffer_size;
+    font_line_advances(font, line->buffer, line->buffer_size, advances->x);
+    advance_cache_wrap(advances, line->buffer, width);
+    return advances;
+}
+
+float advance_cache_col_to_x(const LineAdvances *advances, size_t col) {
+    return advances->x[col < advances->length ? col : advances->length];
+}
+
+// First column whose position is not less than x
+static size_t advance_cache_lower_bound(const LineAdvances *advances, float x) {
+    size_t lo = 0, hi = advances->length + 1;
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if(advances->x[mid] < x)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+size_t advance_cache_x_to_col(const LineAdvances *advances, float x) {
+    size_t right = advance_cache_lower_bound(advances, x);
+    if(right == 0)
+        return 0;
+    if(right > advances->length)
+        right = advances->length;
+
+    // Bytes of one character share a position, step back to its first byte
+    size_t left = advance_cache_lower_bound(advances, advances->x[right - 1]);
+    if(advances->x[right] - x < x - advances->x[left])
+        return right;
+    return left;
+}
+
+size_t advance_cache_row_of_col(const LineAdvances *advances, size_t col) {
+    size_t lo = 1, hi = advances->rows;
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if(advances->starts[mid] <= col)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo - 1;
+}
+
+size_t advance_cache_row_end(const LineAdvances *advances, size_t row) {
+    return row + 1 < advances->rows ? advances->starts[row + 1] : advances->length;
+}
+
+size_t advance_cache_char_start(const LineAdvances *advances, size_t col) {
+    return advance_cache_lower_bound(advances, advance_cache_col_to_x(advances, col));
+}
+
+void advance_cache_clear(AdvanceCache *ac) {
+    line_cache_clear(&ac->index);
+}
+
+void advance_cache_destroy(AdvanceCache *ac) {
+    for(size_t i = 0; i < ADVANCE_CACHE_SLOTS; ++i) {
+        free(ac->lines[i].x);
+        free(ac->lines[i].starts);
+    }
+    line_cache_destroy(&ac->index);
+}
@@ -0,0 +1,62 @@
+#ifndef ADVANCE_CACHE_H_
+#define ADVANCE_CACHE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./font.h"
+#include "./line_cache.h"
+#include "./editor/line.h"
+
+// Cumulative glyph advances of recently used lines, so column to x is a
+// lookup and x to column a binary search instead of a rescan of the line.
+
+#define ADVANCE_CACHE_SLOTS 256
+
+typedef struct {
+    // x[col] is the pen position before byte col, x[length] the line width
+    float *x;
+    size_t length;
+    size_t capacity;
+
+    // First byte of every visual row when wrapped at wrap_width
+    size_t *starts;
+    size_t rows;
+    size_t starts_capacity;
+    float wrap_width;
+} LineAdvances;
+
+typedef struct {
+    LineCache index;
+    LineAdvances lines[ADVANCE_CACHE_SLOTS];
+    // Advances depend on the zoom, the cache is dropped when the font changes
+    uint64_t font_generation;
+} AdvanceCache;
+
+void advance_cache_init(AdvanceCache *ac);
+
+// Returns the advances of line, computing them if the line was edited since,
+// together with its row starts when wrapped at width
+const LineAdvances *advance_cache_get(AdvanceCache *ac, Font *font, Line *line, float width);
+
+float advance_cache_col_to_x(const LineAdvances *advances, size_t col);
+
+// Column whose boundary is the nearest to x, never inside a character
+size_t advance_cache_x_to_col(const LineAdvances *advances, float x);
+
+// Visual row of the line that col is on, a column at a row start belongs to
+// the row it starts
+size_t advance_cache_row_of_col(const LineAdvances *advances, size_t col);
+
+// End of row, the start of the next one or the line length for the last
+size_t advance_cache_row_end(const LineAdvances *advances, size_t row);
+
+// First byte of the character col is in
+size_t advance_cache_char_start(const LineAdvances *advances, size_t col);
+
+void advance_cache_clear(AdvanceCache *ac);
+
+void advance_cache_destroy(AdvanceCache *ac);
+
+#endif // ADVANCE_CACHE_H_
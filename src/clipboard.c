@@ -0,0 +1,420 @@
+#define _DEFAULT_SOURCE
+#include "./clipboard.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef TE_X11
+#include <poll.h>
+#include <unistd.h>
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#endif
+
+#include "./utils.h"
+
+// Replaces the text, the lock has to be held
+static void clipboard_set_text(Clipboard *cb, char *text, size_t text_length) {
+    free(cb->text);
+    cb->text = text;
+    cb->text_length = text_length;
+}
+
+#ifdef TE_X11
+
+static size_t clipboard_range_length(LineBuffer *lb, size_t rs, size_t cs, size_t re, size_t ce) {
+    if(rs == re)
+        return ce - cs;
+    size_t length = lb->lines[rs].buffer_size - cs + 1;
+    for(size_t i = rs + 1; i < re; ++i)
+        length += lb->lines[i].buffer_size + 1;
+    return length + ce;
+}
+
+// Builds the text of a lazy copy. The editor only reads the lines until
+// clipboard_materialize waited for this.
+static int clipboard_build(void *data) {
+    Clipboard *cb = (Clipboard *) data;
+    char *text;
+    size_t text_length;
+    lines_range_to_str(cb->lines, cb->rs, cb->cs, cb->re, cb->ce, &text, &text_length);
+
+    SDL_LockMutex(cb->lock);
+    clipboard_set_text(cb, text, text_length);
+    cb->pending = false;
+    SDL_CondBroadcast(cb->built);
+    SDL_UnlockMutex(cb->lock);
+    return 0;
+}
+
+/* X11 selection owner */
+
+// Transfers of texts too big for one property (the INCR protocol)
+#define CLIPBOARD_TRANSFERS 8
+
+typedef struct {
+    bool active;
+    Window requestor;
+    Atom property;
+    Atom type;
+    size_t offset;
+    uint64_t generation;
+} ClipboardTransfer;
+
+struct ClipboardX11 {
+    Display *display;
+    Window window;
+    Atom clipboard, targets, utf8_string, text, incr;
+    size_t chunk;
+
+    // The editor writes the generation of a copy to take the selection
+    // for, 0 stops the thread
+    int command_pipe[2];
+    SDL_Thread *thread;
+
+    ClipboardTransfer transfers[CLIPBOARD_TRANSFERS];
+};
+
+// Waits until the text of the copy is built, returns with the lock held
+static bool clipboard_wait_text(Clipboard *cb) {
+    SDL_LockMutex(cb->lock);
+    while(cb->pending && cb->owned)
+        if(SDL_CondWaitTimeout(cb->built, cb->lock, CLIPBOARD_REQUEST_TIMEOUT_MS) == SDL_MUTEX_TIMEDOUT)
+            break;
+    return cb->owned && !cb->pending && cb->text;
+}
+
+static ClipboardTransfer *clipboard_x11_new_transfer(struct ClipboardX11 *x) {
+    for(size_t i = 0; i < CLIPBOARD_TRANSFERS; ++i)
+        if(!x->transfers[i].active)
+            return &x->transfers[i];
+    return NULL;
+}
+
+static bool clipboard_x11_send_text(Clipboard *cb, XSelectionRequestEvent *request, Atom property) {
+    struct ClipboardX11 *x = cb->x11;
+    Atom type = request->target == XA_STRING ? XA_STRING : x->utf8_string;
+
+    bool sent = false;
+    if(!clipboard_wait_text(cb))
+        goto unlock;
+
+    if(cb->text_length <= x->chunk) {
+        XChangeProperty(
+            x->display, request->requestor, property, type, 8, PropModeReplace,
+            (unsigned char *) cb->text, (int) cb->text_length
+        );
+        sent = true;
+        goto unlock;
+    }
+
+    // The requestor deletes the property to ask for every next chunk
+    ClipboardTransfer *transfer = clipboard_x11_new_transfer(x);
+    if(!transfer)
+        goto unlock;
+    *transfer = (ClipboardTransfer) {
+        .active = true,
+        .requestor = request->requestor,
+        .property = property,
+        .type = type,
+        .generation = cb->generation
+    };
+    long length = (long) cb->text_length;
+    XSelectInput(x->display, request->requestor, PropertyChangeMask);
+    XChangeProperty(
+        x->display, request->requestor, property, x->incr, 32, PropModeReplace,
+        (unsigned char *) &length, 1
+    );
+    sent = true;
+
+unlock:
+    SDL_UnlockMutex(cb->lock);
+    return sent;
+}
+
+static void clipboard_x11_answer(Clipboard *cb, XSelectionRequestEvent *request) {
+    struct ClipboardX11 *x = cb->x11;
+    XSelectionEvent reply = {
+        .type = SelectionNotify,
+        .display = request->display,
+        .requestor = request->requestor,
+        .selection = request->selection,
+        .target = request->target,
+        .property = None,
+        .time = request->time
+    };
+    // Obsolete clients leave the property out
+    Atom property = request->property != None ? request->property : request->target;
+
+    if(request->target == x->targets) {
+        Atom targets[] = { x->targets, x->utf8_string, x->text, XA_STRING };
+        XChangeProperty(
+            x->display, request->requestor, property, XA_ATOM, 32, PropModeReplace,
+            (unsigned char *) targets, sizeof(targets) / sizeof(*targets)
+        );
+        reply.property = property;
+    }
+    else if(request->target == x->utf8_string || request->target == x->text || request->target == XA_STRING) {
+        if(clipboard_x11_send_text(cb, request, property))
+            reply.property = property;
+    }
+
+    XSendEvent(x->display, request->requestor, False, NoEventMask, (XEvent *) &reply);
+}
+
+static void clipboard_x11_continue(Clipboard *cb, XPropertyEvent *deleted) {
+    struct ClipboardX11 *x = cb->x11;
+    for(size_t i = 0; i < CLIPBOARD_TRANSFERS; ++i) {
+        ClipboardTransfer *transfer = &x->transfers[i];
+        if(!transfer->active || transfer->requestor != deleted->window || transfer->property != deleted->atom)
+            continue;
+
+        // A new copy ends the transfer of the old one early
+        SDL_LockMutex(cb->lock);
+        size_t chunk = 0;
+        if(transfer->generation == cb->generation && cb->text)
+            chunk = minul(cb->text_length - transfer->offset, x->chunk);
+        XChangeProperty(
+            x->display, transfer->requestor, transfer->property, transfer->type, 8, PropModeReplace,
+            (unsigned char *) (cb->text ? cb->text + transfer->offset : ""), (int) chunk
+        );
+        SDL_UnlockMutex(cb->lock);
+
+        // An empty chunk tells the requestor the text is complete
+        transfer->offset += chunk;
+        if(!chunk) {
+            transfer->active = false;
+            XSelectInput(x->display, transfer->requestor, NoEventMask);
+        }
+    }
+}
+
+static void clipboard_x11_lost(Clipboard *cb) {
+    struct ClipboardX11 *x = cb->x11;
+    // A late notice of a loss from before the last copy
+    if(XGetSelectionOwner(x->display, x->clipboard) == x->window)
+        return;
+
+    SDL_LockMutex(cb->lock);
+    cb->owned = false;
+    SDL_CondBroadcast(cb->built);
+    SDL_UnlockMutex(cb->lock);
+}
+
+static bool clipboard_x11_command(Clipboard *cb) {
+    struct ClipboardX11 *x = cb->x11;
+    uint64_t generation;
+    if(read(x->command_pipe[0], &generation, sizeof(generation)) != sizeof(generation) || !generation)
+        return false;
+
+    // Copied again meanwhile
+    SDL_LockMutex(cb->lock);
+    bool current = generation == cb->generation;
+    SDL_UnlockMutex(cb->lock);
+    if(!current)
+        return true;
+
+    XSetSelectionOwner(x->display, x->clipboard, x->window, CurrentTime);
+    if(XGetSelectionOwner(x->display, x->clipboard) != x->window) {
+        fprintf(stderr, "Error: Could not take the clipboard selection\n");
+        clipboard_x11_lost(cb);
+        return true;
+    }
+
+    // Undo the loss of an earlier copy noticed only now
+    SDL_LockMutex(cb->lock);
+    if(generation == cb->generation)
+        cb->owned = true;
+    SDL_UnlockMutex(cb->lock);
+    return true;
+}
+
+static int clipboard_x11_worker(void *data) {
+    Clipboard *cb = (Clipboard *) data;
+    struct ClipboardX11 *x = cb->x11;
+    struct pollfd fds[2] = {
+        { .fd = ConnectionNumber(x->display), .events = POLLIN },
+        { .fd = x->command_pipe[0], .events = POLLIN }
+    };
+
+    for(;;) {
+        XFlush(x->display);
+        if(!XPending(x->display) && poll(fds, 2, -1) < 0)
+            continue;
+        if(fds[1].revents & POLLIN) {
+            fds[1].revents = 0;
+            if(!clipboard_x11_command(cb))
+                return 0;
+        }
+
+        while(XPending(x->display)) {
+            XEvent event;
+            XNextEvent(x->display, &event);
+            switch(event.type) {
+                case SelectionRequest: { clipboard_x11_answer(cb, &event.xselectionrequest); } break;
+                case SelectionClear: { clipboard_x11_lost(cb); } break;
+                case PropertyNotify: {
+                    if(event.xproperty.state == PropertyDelete)
+                        clipboard_x11_continue(cb, &event.xproperty);
+                } break;
+                default: break;
+            }
+        }
+    }
+}
+
+static bool clipboard_x11_init(Clipboard *cb) {
+    // Without an X server (or XWayland) copies go through SDL
+    Display *display = XOpenDisplay(NULL);
+    if(!display)
+        return false;
+
+    struct ClipboardX11 *x = (struct ClipboardX11 *) calloc(1, sizeof(*x));
+    x->display = display;
+    x->window = XCreateSimpleWindow(display, DefaultRootWindow(display), 0, 0, 1, 1, 0, 0, 0);
+    x->clipboard = XInternAtom(display, "CLIPBOARD", False);
+    x->targets = XInternAtom(display, "TARGETS", False);
+    x->utf8_string = XInternAtom(display, "UTF8_STRING", False);
+    x->text = XInternAtom(display, "TEXT", False);
+    x->incr = XInternAtom(display, "INCR", False);
+
+    size_t max_request = XExtendedMaxRequestSize(display);
+    if(!max_request)
+        max_request = XMaxRequestSize(display);
+    x->chunk = minul(CLIPBOARD_CHUNK_BYTES, max_request * 4 / 2);
+
+    if(pipe(x->command_pipe) < 0) {
+        perror("pipe");
+        goto fail;
+    }
+
+    cb->x11 = x;
+    x->thread = SDL_CreateThread(clipboard_x11_worker, "clipboard", cb);
+    if(!x->thread) {
+        fprintf(stderr, "Error: Could not start clipboard thread: %s\n", SDL_GetError());
+        close(x->command_pipe[0]);
+        close(x->command_pipe[1]);
+        cb->x11 = NULL;
+        goto fail;
+    }
+    return true;
+
+fail:
+    XDestroyWindow(display, x->window);
+    XCloseDisplay(display);
+    free(x);
+    return false;
+}
+
+static bool clipboard_x11_command_send(Clipboard *cb, uint64_t generation) {
+    return write(cb->x11->command_pipe[1], &generation, sizeof(generation)) == sizeof(generation);
+}
+
+static void clipboard_x11_destroy(Clipboard *cb) {
+    struct ClipboardX11 *x = cb->x11;
+
+    // Let go of a request waiting for the editor
+    SDL_LockMutex(cb->lock);
+    cb->owned = false;
+    SDL_CondBroadcast(cb->built);
+    SDL_UnlockMutex(cb->lock);
+
+    if(clipboard_x11_command_send(cb, 0))
+        SDL_WaitThread(x->thread, NULL);
+    close(x->command_pipe[0]);
+    close(x->command_pipe[1]);
+    XDestroyWindow(x->display, x->window);
+    XCloseDisplay(x->display);
+    free(x);
+    cb->x11 = NULL;
+}
+
+#endif // TE_X11
+
+/* Clipboard */
+
+bool clipboard_init(Clipboard *cb) {
+    *cb = (Clipboard) {0};
+    cb->lock = SDL_CreateMutex();
+    cb->built = SDL_CreateCond();
+    if(!cb->lock || !cb->built) {
+        fprintf(stderr, "Error: Could not set up the clipboard: %s\n", SDL_GetError());
+        return false;
+    }
+#ifdef TE_X11
+    clipboard_x11_init(cb);
+#endif
+    return true;
+}
+
+void clipboard_copy(Clipboard *cb, LineBuffer *lb, size_t rs, size_t cs, size_t re, size_t ce) {
+    clipboard_materialize(cb);
+    SDL_LockMutex(cb->lock);
+    clipboard_set_text(cb, NULL, 0);
+    cb->pending = cb->owned = false;
+    uint64_t generation = ++cb->generation;
+    SDL_UnlockMutex(cb->lock);
+
+#ifdef TE_X11
+    if(cb->x11 && clipboard_range_length(lb, rs, cs, re, ce) >= CLIPBOARD_LAZY_BYTES) {
+        SDL_LockMutex(cb->lock);
+        cb->lines = lb;
+        cb->rs = rs;
+        cb->cs = cs;
+        cb->re = re;
+        cb->ce = ce;
+        cb->pending = cb->owned = true;
+        SDL_UnlockMutex(cb->lock);
+        if(clipboard_x11_command_send(cb, generation)) {
+            cb->builder = SDL_CreateThread(clipboard_build, "clipboard build", cb);
+            if(!cb->builder)
+                clipboard_build(cb);
+            return;
+        }
+
+        SDL_LockMutex(cb->lock);
+        cb->pending = cb->owned = false;
+        SDL_UnlockMutex(cb->lock);
+    }
+#else
+    (void) generation;
+#endif
+
+    char *text;
+    size_t text_length;
+    lines_range_to_str(lb, rs, cs, re, ce, &text, &text_length);
+    if(SDL_SetClipboardText(text) < 0)
+        fprintf(stderr, "Error: Could not copy to the clipboard: %s\n", SDL_GetError());
+    free(text);
+}
+
+void clipboard_materialize(Clipboard *cb) {
+    if(!cb->builder)
+        return;
+    SDL_WaitThread(cb->builder, NULL);
+    cb->builder = NULL;
+}
+
+const char *clipboard_owned_text(Clipboard *cb, size_t *length) {
+    clipboard_materialize(cb);
+
+    SDL_LockMutex(cb->lock);
+    const char *text = cb->owned ? cb->text : NULL;
+    *length = cb->text_length;
+    SDL_UnlockMutex(cb->lock);
+    return text;
+}
+
+void clipboard_destroy(Clipboard *cb) {
+    clipboard_materialize(cb);
+#ifdef TE_X11
+    if(cb->x11)
+        clipboard_x11_destroy(cb);
+#endif
+    free(cb->text);
+    if(cb->built)
+        SDL_DestroyCond(cb->built);
+    if(cb->lock)
+        SDL_DestroyMutex(cb->lock);
+}
@@ -0,0 +1,57 @@
+#ifndef CLIPBOARD_H_
+#define CLIPBOARD_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <SDL2/SDL.h>
+
+#include "./editor/line.h"
+
+// System clipboard. Small copies are handed to SDL right away. Built with
+// TE_X11, bigger ones return at once: a builder thread turns the copied
+// range into text while the editor goes on, and a helper thread owns the
+// X CLIPBOARD selection and sends the text in chunks once some program
+// asks for it. Wayland sessions get it through XWayland.
+
+// Copies of at least this many bytes are offered lazily
+#define CLIPBOARD_LAZY_BYTES (1 << 20)
+// Largest piece of text sent to another program at once
+#define CLIPBOARD_CHUNK_BYTES (256 << 10)
+// How long a request from another program waits for the editor
+#define CLIPBOARD_REQUEST_TIMEOUT_MS 5000
+
+struct ClipboardX11;
+
+typedef struct {
+    SDL_mutex *lock;
+    SDL_cond *built;
+
+    // The copied range, builder makes text from it while pending.
+    // generation changes with every copy.
+    LineBuffer *lines;
+    size_t rs, cs, re, ce;
+    SDL_Thread *builder;
+    bool pending;
+    bool owned;
+    char *text;
+    size_t text_length;
+    uint64_t generation;
+
+    struct ClipboardX11 *x11;
+} Clipboard;
+
+bool clipboard_init(Clipboard *cb);
+
+void clipboard_copy(Clipboard *cb, LineBuffer *lb, size_t rs, size_t cs, size_t re, size_t ce);
+
+// Waits for the text of a lazy copy to be built. Has to be called before
+// the copied lines are changed.
+void clipboard_materialize(Clipboard *cb);
+
+// Text of the last copy if the clipboard still holds it, NULL otherwise
+const char *clipboard_owned_text(Clipboard *cb, size_t *length);
+
+void clipboard_destroy(Clipboard *cb);
+
+#endif // CLIPBOARD_H_
@@ -1,69 +1,245 @@
+#define _DEFAULT_SOURCE
 #include "./dialog.h"
 
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdint.h>
 #include <stdio.h>
-#include <string.h>
-#include <assert.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "./utils.h"
 
 #define MAX_FILEPATH_LENGTH 1024
+#define MAX_ZENITY_ARGS 8
+
+extern char **environ;
 
 typedef enum {
     OPEN_FILE = 0,
     SAVE_FILE,
     CONFIRM_UNSAVED_CHANGES,
+    CONFIRM_RELOAD,
+    CONFIRM_FOLLOW_RESTART,
+    CONFIRM_RECOVER,
     COUNT_ZENITY_CMDS
 } ZenityCommand;
 
-const static char *COMMANDS[COUNT_ZENITY_CMDS] = {
-    [OPEN_FILE] = "zenity --file-selection",
-    [SAVE_FILE] = "zenity --file-selection --save --confirm-overwrite",
-    [CONFIRM_UNSAVED_CHANGES] = "zenity --question --text \"You have unsaved changes. Do you wish to continue?\""
+const static char *COMMANDS[COUNT_ZENITY_CMDS][MAX_ZENITY_ARGS] = {
+    [OPEN_FILE] = { "zenity", "--file-selection", NULL },
+    [SAVE_FILE] = { "zenity", "--file-selection", "--save", "--confirm-overwrite", NULL },
+    [CONFIRM_UNSAVED_CHANGES] = { "zenity", "--question", "--text", "You have unsaved changes. Do you wish to continue?", NULL },
+    [CONFIRM_RELOAD] = { "zenity", "--question", "--text", "The file was changed by another program. Reload it and drop your unsaved changes?", NULL },
+    [CONFIRM_FOLLOW_RESTART] = { "zenity", "--question", "--text", "The followed file was rotated or truncated. Read it from the start and drop your unsaved changes?", NULL },
+    [CONFIRM_RECOVER] = { "zenity", "--question", "--text", "An editor that did not exit cleanly left unsaved changes to this file. Recover them over the file as it is now?", NULL }
 };
 
-static bool zenity_read_retcode(ZenityCommand cmd) {
-    FILE *fp = popen(COMMANDS[cmd], "r");
-    if(!fp)
-        return false;
-    return pclose(fp);
-}
+// Commands answering with a path on stdout, the others only say yes or no
+// through their exit status
+const static bool RETURNS_PATH[COUNT_ZENITY_CMDS] = {
+    [OPEN_FILE] = true,
+    [SAVE_FILE] = true
+};
+
+// The open dialog. Everything but the atomics is set up before the helper
+// thread starts and left alone until it is joined.
+typedef struct {
+    Uint32 event;
+    SDL_atomic_t open;
+    // Cleared once zenity closed its output, it must not be killed after
+    SDL_atomic_t running;
+
+    ZenityCommand cmd;
+    int purpose;
+    pid_t pid;
+    int output;
+    SDL_Thread *thread;
+} Dialog;
 
-static char *zenity_read_string(ZenityCommand cmd) {
+static Dialog dialog = { .event = (Uint32) -1 };
+
+static int zenity_worker(void *data) {
+    (void) data;
     char buffer[MAX_FILEPATH_LENGTH];
+    size_t length = 0;
+
+    // Read to the end so zenity never blocks on a full pipe
+    for(;;) {
+        char chunk[256];
+        ssize_t n = read(dialog.output, chunk, sizeof(chunk));
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            break;
+        size_t kept = minul((size_t) n, sizeof(buffer) - 1 - length);
+        memcpy(buffer + length, chunk, kept);
+        length += kept;
+    }
+    SDL_AtomicSet(&dialog.running, 0);
+    close(dialog.output);
+
+    int status = 0;
+    while(waitpid(dialog.pid, &status, 0) < 0 && errno == EINTR);
+    bool accepted = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+
+    char *path = NULL;
+    if(accepted && RETURNS_PATH[dialog.cmd]) {
+        if(length && buffer[length - 1] == '\n') // strip newline returned by command
+            --length;
+        if(length) {
+            path = (char *) malloc(length + 1);
+            memcpy(path, buffer, length);
+            path[length] = 0;
+        }
+        accepted = path != NULL;
+    }
+
+    SDL_Event event = { .type = dialog.event };
+    event.user.code = dialog.purpose;
+    event.user.data1 = path;
+    event.user.data2 = (void *) (uintptr_t) accepted;
+    if(SDL_PushEvent(&event) <= 0) {
+        fprintf(stderr, "Error: Could not deliver the dialog result: %s\n", SDL_GetError());
+        free(path);
+        SDL_AtomicSet(&dialog.open, 0);
+    }
+    return 0;
+}
+
+static void zenity_join(void) {
+    if(!dialog.thread)
+        return;
+    SDL_WaitThread(dialog.thread, NULL);
+    dialog.thread = NULL;
+}
+
+static bool zenity_start(ZenityCommand cmd, int purpose, const char *dir) {
+    if(dialog.event == (Uint32) -1 || SDL_AtomicGet(&dialog.open))
+        return false;
+    zenity_join();
+
+    const char *argv[MAX_ZENITY_ARGS + 1];
+    size_t argc = 0;
+    for(; COMMANDS[cmd][argc]; ++argc)
+        argv[argc] = COMMANDS[cmd][argc];
 
-    FILE *fp = popen(COMMANDS[cmd], "r");
-    if(!fp) {
-        return NULL;
+    // A trailing slash makes zenity start in the directory
+    char *filename = NULL;
+    if(dir) {
+        size_t size = strlen("--filename=") + strlen(dir) + 2;
+        filename = (char *) malloc(size);
+        snprintf(filename, size, "--filename=%s/", dir);
+        argv[argc++] = filename;
     }
+    argv[argc] = NULL;
 
-    fgets(buffer, sizeof(buffer), fp);
-    size_t path_length = strlen(buffer);
+    int fds[2];
+    if(pipe(fds) < 0) {
+        perror("pipe");
+        goto fail;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions, fds[0]);
+    posix_spawn_file_actions_addclose(&actions, fds[1]);
+    int error = posix_spawnp(&dialog.pid, argv[0], &actions, NULL, (char *const *) argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+    if(error) {
+        fprintf(stderr, "Error: Could not run %s: %s\n", argv[0], strerror(error));
+        close(fds[0]);
+        goto fail;
+    }
+
+    dialog.cmd = cmd;
+    dialog.purpose = purpose;
+    dialog.output = fds[0];
+    SDL_AtomicSet(&dialog.open, 1);
+    SDL_AtomicSet(&dialog.running, 1);
+    dialog.thread = SDL_CreateThread(zenity_worker, "dialog", NULL);
+    if(!dialog.thread) {
+        fprintf(stderr, "Error: Could not start dialog thread: %s\n", SDL_GetError());
+        kill(dialog.pid, SIGTERM);
+        waitpid(dialog.pid, NULL, 0);
+        close(fds[0]);
+        SDL_AtomicSet(&dialog.open, 0);
+        goto fail;
+    }
+
+    free(filename);
+    return true;
 
-    char *result = NULL;
-    if(path_length) {
-        result = (char *) malloc(path_length);
-        strncpy(result, buffer, path_length - 1); // strip newline returned by command
-        result[path_length - 1] = 0;
+fail:
+    free(filename);
+    return false;
+}
+
+bool dialog_init(void) {
+    dialog.event = SDL_RegisterEvents(1);
+    if(dialog.event == (Uint32) -1) {
+        fprintf(stderr, "Error: Could not register dialog events: %s\n", SDL_GetError());
+        return false;
     }
+    return true;
+}
+
+bool dialog_is_open(void) {
+    return SDL_AtomicGet(&dialog.open) != 0;
+}
 
-    return pclose(fp) == 0 ? result : NULL;
+bool dialog_confirm_unsaved_changes(int purpose) {
+    return zenity_start(CONFIRM_UNSAVED_CHANGES, purpose, NULL);
 }
 
-bool dialog_confirm_unsaved_changes() {
-    return !zenity_read_retcode(CONFIRM_UNSAVED_CHANGES);
+bool dialog_confirm_reload(int purpose) {
+    return zenity_start(CONFIRM_RELOAD, purpose, NULL);
 }
 
-char *dialog_select_file() {
-    return zenity_read_string(OPEN_FILE);
+bool dialog_confirm_follow_restart(int purpose) {
+    return zenity_start(CONFIRM_FOLLOW_RESTART, purpose, NULL);
 }
 
-char *dialog_select_file_default_dir(const char *dir) {
-    assert(false && "TODO");
+bool dialog_confirm_recover(int purpose) {
+    return zenity_start(CONFIRM_RECOVER, purpose, NULL);
 }
 
-char *dialog_save_file() {
-    return zenity_read_string(SAVE_FILE);
+bool dialog_select_file(int purpose) {
+    return zenity_start(OPEN_FILE, purpose, NULL);
 }
 
-char *dialog_save_file_default_dir(const char *dir) {
-    assert(false && "TODO");
-}
\ No newline at end of file
+bool dialog_select_file_default_dir(int purpose, const char *dir) {
+    return zenity_start(OPEN_FILE, purpose, dir);
+}
+
+bool dialog_save_file(int purpose) {
+    return zenity_start(SAVE_FILE, purpose, NULL);
+}
+
+bool dialog_save_file_default_dir(int purpose, const char *dir) {
+    return zenity_start(SAVE_FILE, purpose, dir);
+}
+
+bool dialog_take_result(SDL_Event *event, DialogResult *result) {
+    if(dialog.event == (Uint32) -1 || event->type != dialog.event)
+        return false;
+
+    zenity_join();
+    SDL_AtomicSet(&dialog.open, 0);
+    *result = (DialogResult) {
+        .purpose = event->user.code,
+        .accepted = event->user.data2 != NULL,
+        .path = (char *) event->user.data1
+    };
+    return true;
+}
+
+void dialog_destroy(void) {
+    if(SDL_AtomicGet(&dialog.running))
+        kill(dialog.pid, SIGTERM);
+    zenity_join();
+}
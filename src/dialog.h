@@ -3,14 +3,44 @@
 
 #include <stdbool.h>
 
-char *dialog_select_file();
+#include <SDL2/SDL.h>
 
-char *dialog_select_file_default_dir(const char *dir);
+// zenity dialogs run on a helper thread while the editor keeps going. One
+// dialog is open at a time, the functions opening one return false if it
+// could not be shown. The answer comes back as an SDL event tagged with
+// the purpose the dialog was opened for, see dialog_take_result.
 
-bool  dialog_confirm_unsaved_changes();
+typedef struct {
+    int purpose;
+    // The user confirmed, or picked path
+    bool accepted;
+    char *path; // owned by the receiver, NULL unless a file was picked
+} DialogResult;
 
-char *dialog_save_file();
+bool dialog_init(void);
 
-char *dialog_save_file_default_dir(const char *dir);
+bool dialog_is_open(void);
 
-#endif // DIALOG_H_
\ No newline at end of file
+bool dialog_select_file(int purpose);
+
+bool dialog_select_file_default_dir(int purpose, const char *dir);
+
+bool dialog_confirm_unsaved_changes(int purpose);
+
+bool dialog_confirm_reload(int purpose);
+
+bool dialog_confirm_follow_restart(int purpose);
+
+bool dialog_confirm_recover(int purpose);
+
+bool dialog_save_file(int purpose);
+
+bool dialog_save_file_default_dir(int purpose, const char *dir);
+
+// Whether event carries the answer of a dialog, fills result if so
+bool dialog_take_result(SDL_Event *event, DialogResult *result);
+
+// Closes a dialog that is still open
+void dialog_destroy(void);
+
+#endif // DIALOG_H_
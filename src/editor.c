@@ -2,26 +2,424 @@
 #include <memory.h>
 #include <assert.h>
 #include <string.h>
+#include <math.h>
 
 #include <SDL2/SDL.h>
 
 #include "file.h"
 #include "editor.h"
 #include "dialog.h"
+#include "editor/line_diff.h"
 #include "utils.h"
+#include "profiler.h"
+#include "editor/wrap.h"
+#include "editor/fold.h"
+
+static void editor_damage_rows(Editor *editor, size_t start, size_t end) {
+    damage_mark_rows(&editor->damage, start, end);
+    damage_mark_rows(&editor->wrap_dirty, start, end);
+    minimap_lines_changed(&editor->minimap, start, end);
+}
+
+void editor_damage_all(Editor *editor) {
+    damage_mark_all(&editor->damage);
+}
+
+static bool editor_selection_changed(Editor *editor) {
+    Selection *a = &editor->selection, *b = &editor->drawn_selection;
+    return a->row_start != b->row_start || a->col_start != b->col_start ||
+        a->row_end != b->row_end || a->col_end != b->col_end;
+}
+
+static bool editor_cursor_moved(Editor *editor) {
+    return editor->cursor.row != editor->drawn_cursor.row ||
+        editor->cursor.col != editor->drawn_cursor.col;
+}
+
+bool editor_needs_redraw(Editor *editor) {
+    // The profiler overlay is refreshed every frame while it is shown
+    return !damage_is_empty(&editor->damage) ||
+        profiler_is_enabled() ||
+        font_frame_incomplete(editor->font) ||
+        font_rebuild_ready(editor->font) ||
+        editor->font_generation != editor->font->atlas.generation ||
+        editor->wrap_sweep < editor->lines.lines_size ||
+        editor->finder.dirty ||
+        editor->project_search.dirty ||
+        minimap_pending(&editor->minimap, &editor->lines) ||
+        editor_cursor_moved(editor) ||
+        editor_selection_changed(editor);
+}
+
+// Cursor and selection are also changed directly by the input handlers,
+// so their damage is derived from what was drawn last time
+static void editor_collect_damage(Editor *editor) {
+    // Nothing was edited, only the screen is damaged
+    if(editor_cursor_moved(editor)) {
+        damage_mark_rows(&editor->damage, editor->drawn_cursor.row, editor->drawn_cursor.row + 1);
+        damage_mark_rows(&editor->damage, editor->cursor.row, editor->cursor.row + 1);
+    }
+    if(editor_selection_changed(editor)) {
+        size_t rs, cs, re, ce;
+        if(selection_is_nonempty(&editor->drawn_selection)) {
+            selection_get_ordered_range(&editor->drawn_selection, &rs, &cs, &re, &ce);
+            damage_mark_rows(&editor->damage, rs, re + 1);
+        }
+        if(selection_is_nonempty(&editor->selection)) {
+            selection_get_ordered_range(&editor->selection, &rs, &cs, &re, &ce);
+            damage_mark_rows(&editor->damage, rs, re + 1);
+        }
+    }
+}
+
+/* Soft wrap */
+
+static const LineAdvances *editor_line_advances(Editor *editor, size_t row) {
+    return advance_cache_get(&editor->line_advances, editor->font, &editor->lines.lines[row], editor->wrap_width);
+}
+
+static bool editor_line_rows_known(Editor *editor, Line *line) {
+    return !editor->wrap ||
+        (line->wrap_version == line->version && line->wrap_generation == editor->wrap_generation);
+}
+
+// Guess for lines that were not wrapped at the current width yet
+static uint32_t editor_estimate_line_rows(Editor *editor, Line *line) {
+    if(!editor->wrap)
+        return 1;
+    return 1 + (uint32_t) (line->buffer_size * font_advance(editor->font, ' ') / editor->wrap_width);
+}
+
+static void editor_set_line_rows(Editor *editor, size_t row, uint32_t rows) {
+    Line *line = &editor->lines.lines[row];
+    line->wrap_rows = rows;
+    line->wrap_version = line->version;
+    line->wrap_generation = editor->wrap_generation;
+
+    // Everything below moves up or down
+    if(line->hidden)
+        rows = 0;
+    if(row_map_get(&editor->row_map, row) != rows) {
+        row_map_set(&editor->row_map, row, rows);
+        damage_mark_rows(&editor->damage, row, DAMAGE_TO_END);
+    }
+}
+
+// Rewraps a line through the advance cache, for lines that are about to be
+// drawn or hit-tested anyway
+static void editor_wrap_line(Editor *editor, size_t row) {
+    if(editor_line_rows_known(editor, &editor->lines.lines[row]))
+        return;
+    editor_set_line_rows(editor, row, editor_line_advances(editor, row)->rows);
+}
+
+// Rewraps a line without touching the advance cache, for the background pass
+static void editor_wrap_line_uncached(Editor *editor, size_t row) {
+    Line *line = &editor->lines.lines[row];
+    if(line->buffer_size + 1 > editor->wrap_scratch_capacity) {
+        editor->wrap_scratch_capacity = (line->buffer_size + 1) * 2;
+        editor->wrap_scratch = (float *) realloc(editor->wrap_scratch, editor->wrap_scratch_capacity * sizeof(float));
+    }
+    font_line_advances(editor->font, line->buffer, line->buffer_size, editor->wrap_scratch);
+    size_t rows = wrap_line(line->buffer, editor->wrap_scratch, line->buffer_size, editor->wrap_width, NULL, 0);
+    editor_set_line_rows(editor, row, (uint32_t) rows);
+}
+
+/* Folding */
+
+// Rows a line takes up in the row map
+static uint32_t editor_line_rows(Editor *editor, Line *line) {
+    if(line->hidden)
+        return 0;
+    return editor_line_rows_known(editor, line)
+        ? (editor->wrap ? line->wrap_rows : 1)
+        : editor_estimate_line_rows(editor, line);
+}
+
+// Hides or shows the lines from first to last, inclusive
+static void editor_set_hidden(Editor *editor, size_t first, size_t last, bool hidden) {
+    LineBuffer *lb = &editor->lines;
+    last = minul(last, lb->lines_size - 1);
+    for(size_t i = first; i <= last; ++i) {
+        lb->lines[i].hidden = hidden;
+        row_map_set(&editor->row_map, i, editor_line_rows(editor, &lb->lines[i]));
+    }
+}
+
+// Takes the stale folds out in one pass and shows their lines again,
+// except where a fold that stays still hides them
+static void editor_drop_stale_folds(Editor *editor) {
+    LineBuffer *lb = &editor->lines;
+    FoldSet *folds = &editor->folds;
+    Fold *dropped;
+    size_t count = fold_set_take_stale(folds, &dropped);
+    if(!count)
+        return;
+
+    for(size_t i = 0; i < count; ++i) {
+        Fold *fold = &dropped[i];
+        if(fold->header < lb->lines_size && !fold_set_find(folds, fold->header))
+            lb->lines[fold->header].folded = false;
+        editor_set_hidden(editor, fold->header, fold->last, false);
+    }
+    for(size_t i = 0; i < count; ++i) {
+        for(size_t k = 0; k < folds->size && folds->folds[k].header < dropped[i].last; ++k) {
+            Fold *kept = &folds->folds[k];
+            if(kept->last >= dropped[i].header)
+                editor_set_hidden(editor,
+                    maxul(kept->header + 1, dropped[i].header),
+                    minul(kept->last, dropped[i].last), true);
+        }
+    }
+    free(dropped);
+    editor_damage_all(editor);
+}
+
+// Follows removed lines from at on being replaced by inserted new ones in
+// the row map and the folds. Only the lines touched are updated, changes
+// made behind the editor's back are caught up with by a full rebuild.
+static void editor_lines_replaced(Editor *editor, size_t at, size_t removed, size_t inserted) {
+    LineBuffer *lb = &editor->lines;
+    RowMap *map = &editor->row_map;
+    if(editor->row_map_structure + 1 != lb->structure_version ||
+        map->size - removed + inserted != lb->lines_size)
+        return;
+    editor->row_map_structure = lb->structure_version;
+
+    row_map_remove(map, at, removed);
+    row_map_insert(map, at, inserted);
+    for(size_t i = at; i < at + inserted; ++i)
+        row_map_set(map, i, editor_line_rows(editor, &lb->lines[i]));
+
+    // Folds after the edit move along, folds it cuts into are dropped. Their
+    // bounds become the lines left to show again.
+    for(size_t i = 0; i < editor->folds.size; ++i) {
+        Fold *fold = &editor->folds.folds[i];
+        if(fold->last < at)
+            continue;
+        if(fold->header >= at + removed) {
+            fold->header = fold->header - removed + inserted;
+            fold->last = fold->last - removed + inserted;
+            continue;
+        }
+        fold->stale = true;
+        fold->header = minul(fold->header, at);
+        if(fold->last >= at + removed)
+            fold->last = fold->last - removed + inserted;
+        else
+            fold->last = at + inserted ? at + inserted - 1 : 0;
+    }
+    editor_drop_stale_folds(editor);
+}
+
+static void editor_lines_swapped(Editor *editor, size_t a, size_t b) {
+    LineBuffer *lb = &editor->lines;
+    if(editor->row_map_structure + 1 != lb->structure_version ||
+        editor->row_map.size != lb->lines_size)
+        return;
+    editor->row_map_structure = lb->structure_version;
+
+    for(size_t i = 0; i < editor->folds.size; ++i) {
+        Fold *fold = &editor->folds.folds[i];
+        if((a >= fold->header && a <= fold->last) || (b >= fold->header && b <= fold->last))
+            fold->stale = true;
+    }
+    editor_drop_stale_folds(editor);
+
+    size_t swapped[] = { a, b };
+    for(size_t i = 0; i < 2; ++i) {
+        Line *line = &lb->lines[swapped[i]];
+        line->folded = false;
+        line->hidden = false;
+        row_map_set(&editor->row_map, swapped[i], editor_line_rows(editor, line));
+    }
+}
+
+// Lines after row up to the next one on screen are hidden
+static size_t editor_next_visible_line(Editor *editor, size_t row) {
+    RowMap *map = &editor->row_map;
+    return row_map_line_at_row(map, row_map_row_of_line(map, row) + row_map_get(map, row));
+}
+
+// Brings the row map in line with the buffer: new wrap width, lines the
+// editor was not told about, edited fold headers and edited lines
+static void editor_sync_row_map(Editor *editor) {
+    LineBuffer *lb = &editor->lines;
+
+    float width = editor->wrap
+        ? fmaxf(editor->renderer->resolution.x - editor->gutter.width - MINIMAP_WIDTH - EDITOR_WRAP_MARGIN, font_line_height(editor->font))
+        : INFINITY;
+    bool regenerate = width != editor->wrap_width ||
+        editor->wrap_font_scale != editor->font->scale ||
+        editor->wrap_font_size != editor->font->pixel_size;
+    if(regenerate) {
+        editor->wrap_width = width;
+        editor->wrap_font_scale = editor->font->scale;
+        editor->wrap_font_size = editor->font->pixel_size;
+        ++editor->wrap_generation;
+        mesh_cache_clear(&editor->line_meshes);
+        editor_damage_all(editor);
+    }
+
+    // The lines were replaced wholesale, the folds went with them
+    bool restructure = editor->row_map_structure != lb->structure_version || editor->row_map.size != lb->lines_size;
+    if(restructure) {
+        if(editor->folds.size)
+            editor_damage_all(editor);
+        fold_set_clear(&editor->folds);
+        for(size_t i = 0; i < lb->lines_size; ++i) {
+            lb->lines[i].folded = false;
+            lb->lines[i].hidden = false;
+        }
+    }
+    if(regenerate || restructure) {
+        row_map_resize(&editor->row_map, lb->lines_size);
+        for(size_t i = 0; i < lb->lines_size; ++i)
+            editor->row_map.rows[i] = editor_line_rows(editor, &lb->lines[i]);
+        row_map_rebuild(&editor->row_map);
+        editor->row_map_structure = lb->structure_version;
+        if(regenerate)
+            editor->wrap_sweep = 0;
+    }
+
+    // An edited header unfolds
+    if(editor->wrap_dirty.rows && editor->folds.size) {
+        size_t start = minul(editor->wrap_dirty.row_start, lb->lines_size);
+        size_t end = editor->wrap_dirty.row_end == DAMAGE_TO_END
+            ? minul(start + 1, lb->lines_size)
+            : minul(editor->wrap_dirty.row_end, lb->lines_size);
+        for(size_t i = start; i < end; ++i) {
+            Fold *fold = lb->lines[i].folded ? fold_set_find(&editor->folds, i) : NULL;
+            if(fold && fold->version != lb->lines[i].version)
+                fold->stale = true;
+        }
+        editor_drop_stale_folds(editor);
+    }
+
+    if(!editor->wrap) {
+        editor->wrap_sweep = lb->lines_size;
+        damage_reset(&editor->wrap_dirty);
+        return;
+    }
+
+    // Edited lines are rewrapped right away, lines inserted in bulk are left
+    // to the background pass
+    if(editor->wrap_dirty.rows) {
+        size_t start = minul(editor->wrap_dirty.row_start, lb->lines_size);
+        size_t end = minul(editor->wrap_dirty.row_end, lb->lines_size);
+        if(editor->wrap_dirty.row_end == DAMAGE_TO_END) {
+            editor->wrap_sweep = minul(editor->wrap_sweep, start);
+            end = minul(start + 1, lb->lines_size);
+        }
+        for(size_t i = start; i < end; ++i)
+            editor_wrap_line(editor, i);
+    }
+    damage_reset(&editor->wrap_dirty);
+}
+
+// Lines above the viewport may change height, the line at the top stays put
+static size_t editor_top_anchor(Editor *editor, float *offset) {
+    float line_height = font_line_height(editor->font);
+    size_t line = row_map_line_at_row(&editor->row_map, (uint64_t) (editor->renderer->scroll_pos.y / line_height));
+    *offset = editor->renderer->scroll_pos.y - row_map_row_of_line(&editor->row_map, line) * line_height;
+    return line;
+}
+
+static void editor_restore_top_anchor(Editor *editor, size_t line, float offset) {
+    float scroll_y = row_map_row_of_line(&editor->row_map, line) * font_line_height(editor->font) + offset;
+    if(scroll_y != editor->renderer->scroll_pos.y) {
+        editor->renderer->scroll_pos.y = scroll_y;
+        editor_damage_all(editor);
+    }
+}
+
+// Rewraps the next batch of lines in the background
+static void editor_wrap_sweep(Editor *editor) {
+    LineBuffer *lb = &editor->lines;
+    if(editor->wrap_sweep >= lb->lines_size)
+        return;
+
+    float offset;
+    size_t anchor = editor_top_anchor(editor, &offset);
+
+    size_t wrapped = 0, scanned = 0;
+    for(; editor->wrap_sweep < lb->lines_size &&
+        wrapped < EDITOR_WRAP_SWEEP_LINES && scanned < EDITOR_WRAP_SWEEP_SCAN;
+        ++editor->wrap_sweep, ++scanned) {
+        if(editor_line_rows_known(editor, &lb->lines[editor->wrap_sweep]))
+            continue;
+        editor_wrap_line_uncached(editor, editor->wrap_sweep);
+        ++wrapped;
+    }
+
+    editor_restore_top_anchor(editor, anchor, offset);
+}
+
+// Wraps the lines on screen so they are drawn at their final height
+static void editor_wrap_visible(Editor *editor) {
+    if(!editor->wrap)
+        return;
+
+    float line_height = font_line_height(editor->font);
+    uint64_t bottom = (uint64_t) ((editor->renderer->scroll_pos.y + editor->renderer->resolution.y) / line_height) + 1;
+    float offset;
+    size_t line = editor_top_anchor(editor, &offset);
+    while(line < editor->lines.lines_size && row_map_row_of_line(&editor->row_map, line) < bottom) {
+        editor_wrap_line(editor, line);
+        line = editor_next_visible_line(editor, line);
+    }
+}
+
+void editor_toggle_wrap(Editor *editor) {
+    float offset;
+    size_t anchor = editor_top_anchor(editor, &offset);
+    editor->wrap = !editor->wrap;
+    editor->renderer->scroll_pos.x = 0.0f;
+    editor_sync_row_map(editor);
+    editor_wrap_visible(editor);
+    editor_restore_top_anchor(editor, anchor, 0.0f);
+    editor_damage_all(editor);
+}
+
+// Visual row and x of a position in the buffer
+static void editor_locate(Editor *editor, size_t row, size_t col, uint64_t *visual_row, float *x) {
+    editor_wrap_line(editor, row);
+    const LineAdvances *advances = editor_line_advances(editor, row);
+    size_t sub_row = advance_cache_row_of_col(advances, col);
+    *visual_row = row_map_row_of_line(&editor->row_map, row) + sub_row;
+    *x = advance_cache_col_to_x(advances, col) - advance_cache_col_to_x(advances, advances->starts[sub_row]);
+}
 
 static void editor_adjust_view_to_cursor(Editor *editor) {
-    float char_width = (float) editor->font->atlas.metrics['0'].advance_x;
-    float line_height = (float) editor->font->atlas.height;
+    if(editor->batching) {
+        editor->view_pending = true;
+        return;
+    }
+
+    float line_height = font_line_height(editor->font);
+
+    // The cursor got into a fold some other way than by moving, open it
+    editor_sync_row_map(editor);
+    while(editor->lines.lines[editor->cursor.row].hidden) {
+        size_t header = row_map_line_at_row(&editor->row_map, row_map_row_of_line(&editor->row_map, editor->cursor.row) - 1);
+        Fold *fold = fold_set_find(&editor->folds, header);
+        if(!fold)
+            break;
+        fold->stale = true;
+        editor_drop_stale_folds(editor);
+    }
 
-    float cursor_absolute_x = editor->cursor.col * char_width;
-    float cursor_absolute_y = editor->cursor.row * line_height;
+    uint64_t cursor_visual_row;
+    float cursor_absolute_x;
+    editor_locate(editor, editor->cursor.row, editor->cursor.col, &cursor_visual_row, &cursor_absolute_x);
+    float cursor_absolute_y = cursor_visual_row * line_height;
 
-    int window_w, window_h;
-    SDL_GetWindowSize(editor->window, &window_w, &window_h);
+    float window_w = editor->renderer->resolution.x;
+    float window_h = editor->renderer->resolution.y;
+    float text_w = window_w - editor->gutter.width - MINIMAP_WIDTH;
 
-    if(cursor_absolute_x > window_w + editor->renderer->scroll_pos.x) {
-        editor_scroll_x(editor, cursor_absolute_x - (window_w + editor->renderer->scroll_pos.x));
+    if(cursor_absolute_x > text_w + editor->renderer->scroll_pos.x) {
+        editor_scroll_x(editor, cursor_absolute_x - (text_w + editor->renderer->scroll_pos.x));
     }
     else if(cursor_absolute_x < editor->renderer->scroll_pos.x) {
         editor_scroll_x(editor, cursor_absolute_x - editor->renderer->scroll_pos.x);
@@ -35,6 +433,56 @@ static void editor_adjust_view_to_cursor(Editor *editor) {
     }
 }
 
+void editor_toggle_fold(Editor *editor) {
+    LineBuffer *lb = &editor->lines;
+    editor_sync_row_map(editor);
+    size_t header = editor->cursor.row, last;
+    Fold *fold = fold_set_find(&editor->folds, header);
+    if(fold) {
+        fold->stale = true;
+        editor_drop_stale_folds(editor);
+        return;
+    }
+
+    if(!fold_find_region(lb, header, &last) && (
+        !fold_find_enclosing(lb, editor->cursor.row, &header) ||
+        !fold_find_region(lb, header, &last)))
+        return;
+
+    Line *line = &lb->lines[header];
+    line->folded = true;
+    fold_set_add(&editor->folds, (Fold) { .header = header, .last = last, .version = line->version });
+    editor_set_hidden(editor, header + 1, last, true);
+    editor_damage_all(editor);
+
+    // Folding the block around the cursor leaves it on the header
+    if(editor->cursor.row > header && editor->cursor.row <= last) {
+        cursor_set(&editor->cursor, lb, header, line->buffer_size);
+        selection_reset(&editor->selection);
+    }
+    editor_adjust_view_to_cursor(editor);
+}
+
+void editor_unfold_all(Editor *editor) {
+    editor_sync_row_map(editor);
+    for(size_t i = 0; i < editor->folds.size; ++i)
+        editor->folds.folds[i].stale = true;
+    editor_drop_stale_folds(editor);
+    editor_adjust_view_to_cursor(editor);
+}
+
+void editor_begin_batch(Editor *editor) {
+    editor->batching = true;
+}
+
+void editor_end_batch(Editor *editor) {
+    editor->batching = false;
+    if(editor->view_pending) {
+        editor->view_pending = false;
+        editor_adjust_view_to_cursor(editor);
+    }
+}
+
 bool editor_init(Editor *editor, SDL_Window *window, Renderer *renderer, Font *font) {
     *editor = (Editor) {0};
     editor->window = window;
@@ -46,96 +494,398 @@ bool editor_init(Editor *editor, SDL_Window *window, Renderer *renderer, Font *f
     cursor_init(&editor->cursor);
     source_info_init(&editor->source_info, editor->window);
 
+    if(!mesh_cache_init(&editor->line_meshes, editor->renderer))
+        return false;
+    advance_cache_init(&editor->line_advances);
+    gutter_init(&editor->gutter);
+    if(!selection_pass_init(&editor->selection_pass))
+        return false;
+    if(!minimap_init(&editor->minimap))
+        return false;
+    if(!clipboard_init(&editor->clipboard))
+        return false;
+    if(!dialog_init())
+        return false;
+    finder_init(&editor->finder);
+    if(!project_search_init(&editor->project_search))
+        return false;
+    if(!journal_init(&editor->journal))
+        return false;
+    row_map_init(&editor->row_map);
+    fold_set_init(&editor->folds);
+    editor->wrap_width = INFINITY;
+
+    damage_reset(&editor->damage);
+    editor_damage_all(editor);
+
     return true;
 }
 
-static void editor_render_selection(Editor *editor, size_t rs, size_t cs, size_t re, size_t ce) {
-    Vec4f color = vec4f(0.3f, 0.7f, 1.0f, 0.25f);
-    
-    int line_height = editor->font->atlas.height;
-    int char_width = editor->font->atlas.metrics['0'].advance_x;
+// Adds the spans of [cs, ce) of a line to the selection pass, one per
+// visual row it touches from top_row on
+static void editor_add_selection_line(Editor *editor, size_t row, size_t cs, size_t ce, uint64_t top_row) {
+    const LineAdvances *advances = editor_line_advances(editor, row);
+    uint64_t first_row = row_map_row_of_line(&editor->row_map, row);
+
+    for(size_t k = advance_cache_row_of_col(advances, cs); k < advances->rows; ++k) {
+        size_t start = advances->starts[k];
+        if(start > ce || (start == ce && k))
+            break;
+        if(first_row + k < top_row)
+            continue;
+        size_t a = maxul(cs, start), b = minul(ce, advance_cache_row_end(advances, k));
+        float row_x = advance_cache_col_to_x(advances, start);
+        selection_pass_add(
+            &editor->selection_pass, first_row + k - top_row,
+            advance_cache_col_to_x(advances, a) - row_x,
+            advance_cache_col_to_x(advances, b) - row_x
+        );
+    }
+}
+
+// Highlights the selected ranges on the visible lines [first, last) in one
+// pass, lines further away are never looked at
+static void editor_render_selections(Editor *editor, Selection *selections, size_t count, size_t first, size_t last) {
+    Renderer *renderer = editor->renderer;
+    float line_height = font_line_height(editor->font);
+    uint64_t top_row = (uint64_t) (renderer->scroll_pos.y / line_height);
+    size_t rows = (size_t) (renderer->resolution.y / line_height) + 2;
+    selection_pass_begin(&editor->selection_pass, rows);
+
+    for(size_t s = 0; s < count; ++s) {
+        if(!selection_is_nonempty(&selections[s]))
+            continue;
+
+        size_t rs, cs, re, ce;
+        selection_get_ordered_range(&selections[s], &rs, &cs, &re, &ce);
+
+        size_t i = maxul(rs, first);
+        if(i < editor->lines.lines_size && editor->lines.lines[i].hidden)
+            i = editor_next_visible_line(editor, i);
+        for(; i <= re && i < last; i = editor_next_visible_line(editor, i))
+            editor_add_selection_line(
+                editor, i,
+                i == rs ? cs : 0,
+                i == re ? ce : editor->lines.lines[i].buffer_size,
+                top_row
+            );
+    }
+
+    selection_pass_draw(
+        &editor->selection_pass, renderer,
+        vec2f(editor->gutter.width, top_row * line_height),
+        line_height,
+        vec4f(0.3f, 0.7f, 1.0f, 0.25f)
+    );
+}
+
+// Box after the text of every folded line on screen
+static void editor_render_fold_markers(Editor *editor, size_t first, size_t last) {
+    float line_height = font_line_height(editor->font);
+    float space = font_advance(editor->font, ' ');
+    bool drawn = false;
+
+    for(size_t i = first; i < last; i = editor_next_visible_line(editor, i)) {
+        if(!editor->lines.lines[i].folded)
+            continue;
+        if(!drawn)
+            renderer_set_shader(editor->renderer, SHADER_SOLID);
+        drawn = true;
 
-    // Selection is a single line
-    if(rs == re) {
-        if(cs == ce) return;
+        const LineAdvances *advances = editor_line_advances(editor, i);
+        size_t k = advances->rows - 1;
+        float x = advance_cache_col_to_x(advances, advances->length) - advance_cache_col_to_x(advances, advances->starts[k]);
+        float y = (row_map_row_of_line(&editor->row_map, i) + k) * line_height;
         renderer_solid_rect(
             editor->renderer,
-            vec2f(cs * char_width, rs * line_height),
-            vec2f((ce - cs) * char_width, (re - rs + 1) * line_height),
-            color
+            vec2f(editor->gutter.width + x + space, y + line_height * 0.3f),
+            vec2f(space * 3.0f, line_height * 0.5f),
+            vec4f(0.5f, 0.5f, 0.5f, 0.4f)
         );
-        return;
     }
+    if(drawn)
+        renderer_flush(editor->renderer);
+}
 
-    // Selection is 2+ lines
+// Line numbers of the visible lines in [first, last), over the text
+// scrolled under the gutter
+static void editor_render_gutter(Editor *editor, size_t first, size_t last) {
+    Renderer *renderer = editor->renderer;
+    Gutter *gutter = &editor->gutter;
+    float line_height = font_line_height(editor->font);
+    float left = renderer->scroll_pos.x;
+
+    renderer_set_shader(renderer, SHADER_SOLID);
     renderer_solid_rect(
-        editor->renderer,
-        vec2f(cs * char_width, rs * line_height),
-        vec2f((editor->lines.lines[rs].buffer_size - cs) * char_width, line_height),
-        color
+        renderer,
+        vec2f(left, renderer->scroll_pos.y),
+        vec2f(gutter->width, renderer->resolution.y),
+        vec4f(0.9f, 0.9f, 0.9f, 1.0f)
     );
-    for(size_t i = rs + 1; i < re; ++i)
-        renderer_solid_rect(
-            editor->renderer,
-            vec2f(0.0f, i * line_height),
-            vec2f(editor->lines.lines[i].buffer_size * char_width, line_height),
-            color
+    renderer_flush(renderer);
+
+    if(first < editor->lines.lines_size && editor->lines.lines[first].hidden)
+        first = editor_next_visible_line(editor, first);
+    renderer_set_shader(renderer, SHADER_TEXT);
+    for(size_t i = first; i < last; i = editor_next_visible_line(editor, i))
+        gutter_emit_number(
+            gutter, renderer, i + 1,
+            left + gutter->width - gutter->digit_advance,
+            (row_map_row_of_line(&editor->row_map, i) + 1) * line_height,
+            vec4f(0.5f, 0.5f, 0.5f, 1.0f)
         );
+    renderer_flush(renderer);
+}
+
+// Sidebar with the document overview and a box around the visible lines
+static void editor_render_minimap(Editor *editor) {
+    Renderer *renderer = editor->renderer;
+    Vec2f pos = vec2f(renderer->scroll_pos.x + renderer->resolution.x - MINIMAP_WIDTH, renderer->scroll_pos.y);
+    float height = minimap_height(&editor->minimap, renderer->resolution.y);
+
+    renderer_set_shader(renderer, SHADER_SOLID);
+    renderer_solid_rect(renderer, pos, vec2f(MINIMAP_WIDTH, renderer->resolution.y), vec4f(0.9f, 0.9f, 0.9f, 1.0f));
+    renderer_flush(renderer);
+
+    minimap_draw(&editor->minimap, renderer, pos, vec2f(MINIMAP_WIDTH, height), vec4f(0.3f, 0.3f, 0.3f, 0.8f));
+
+    // Lines at the top and bottom edge of the screen
+    float line_height = font_line_height(editor->font);
+    size_t lines = editor->lines.lines_size;
+    size_t top = row_map_line_at_row(&editor->row_map, (uint64_t) (renderer->scroll_pos.y / line_height));
+    size_t bottom = row_map_line_at_row(&editor->row_map, (uint64_t) ((renderer->scroll_pos.y + renderer->resolution.y) / line_height));
+    float box_top = height * top / lines;
+    float box_bottom = height * minul(bottom + 1, lines) / lines;
+
+    renderer_set_shader(renderer, SHADER_SOLID);
     renderer_solid_rect(
-        editor->renderer,
-        vec2f(0.0f, re * line_height),
-        vec2f(ce * char_width, line_height),
-        color
+        renderer,
+        vec2f(pos.x, pos.y + box_top),
+        vec2f(MINIMAP_WIDTH, fmaxf(box_bottom - box_top, 2.0f)),
+        vec4f(0.3f, 0.7f, 1.0f, 0.2f)
     );
+    renderer_flush(renderer);
 }
 
-void editor_render(Editor *editor) {
-    // Render selection
-    if(selection_is_nonempty(&editor->selection)) {
-        renderer_set_shader(editor->renderer, SHADER_SOLID);
-        {
-            size_t srow_start, scol_start, srow_end, scol_end;
-            selection_get_ordered_range(
-                &editor->selection,
-                &srow_start, &scol_start, &srow_end, &scol_end
-            );
-            editor_render_selection(editor, srow_start, scol_start, srow_end, scol_end);
+static bool editor_minimap_hit(Editor *editor, int32_t x) {
+    return x >= editor->renderer->resolution.x - MINIMAP_WIDTH;
+}
+
+// Centers the view on the line under y in the minimap
+static void editor_minimap_jump(Editor *editor, int32_t y) {
+    Renderer *renderer = editor->renderer;
+    float height = minimap_height(&editor->minimap, renderer->resolution.y);
+    if(height <= 0.0f)
+        return;
+
+    editor_sync_row_map(editor);
+    float fraction = fminf(fmaxf(y / height, 0.0f), 1.0f);
+    size_t line = minul((size_t) (fraction * editor->lines.lines_size), editor->lines.lines_size - 1);
+    float target = row_map_row_of_line(&editor->row_map, line) * font_line_height(editor->font) - renderer->resolution.y / 2.0f;
+    editor_scroll_y(editor, fmaxf(target, 0.0f) - renderer->scroll_pos.y);
+}
+
+static void editor_get_visible_rows(Editor *editor, size_t *first, size_t *last) {
+    float line_height = font_line_height(editor->font);
+    float top = editor->renderer->scroll_pos.y;
+    float bottom = top + editor->renderer->resolution.y;
+
+    *first = row_map_line_at_row(&editor->row_map, (uint64_t) (top / line_height));
+    *last = minul(row_map_line_at_row(&editor->row_map, (uint64_t) (bottom / line_height)) + 1, editor->lines.lines_size);
+}
+
+// Emits every visual row of a line below the previous one
+static void editor_emit_line(Editor *editor, size_t row, Vec2f baseline, Vec4f color) {
+    Line *line = &editor->lines.lines[row];
+    float line_height = font_line_height(editor->font);
+    const LineAdvances *advances = editor_line_advances(editor, row);
+
+    for(size_t k = 0; k < advances->rows; ++k) {
+        size_t start = advances->starts[k];
+        font_emit_line(
+            editor->font, editor->renderer,
+            line->buffer + start, advance_cache_row_end(advances, k) - start,
+            vec2f(baseline.x, baseline.y + k * line_height), color
+        );
+    }
+}
+
+// Queues the glyphs of every visual row of a line that are not rasterized yet
+static void editor_prefetch_line(Editor *editor, size_t row) {
+    Line *line = &editor->lines.lines[row];
+    const LineAdvances *advances = editor_line_advances(editor, row);
+    for(size_t k = 0; k < advances->rows; ++k) {
+        size_t start = advances->starts[k];
+        font_prefetch(editor->font, line->buffer + start, advance_cache_row_end(advances, k) - start);
+    }
+}
+
+// Draws a line from the mesh cache, building and uploading its mesh first if
+// the line changed since it was last drawn. Lines too long for a cache slot
+// are streamed like before.
+static void editor_render_line(Editor *editor, size_t row, Vec4f color) {
+    Renderer *renderer = editor->renderer;
+    Line *line = &editor->lines.lines[row];
+    float line_height = font_line_height(editor->font);
+    Vec2f line_pos = vec2f(editor->gutter.width, row_map_row_of_line(&editor->row_map, row) * line_height);
+    Vec2f baseline = vec2f(line_pos.x, line_pos.y + line_height);
+
+    if(!line->buffer_size)
+        return;
+
+    if(line->buffer_size > MESH_CACHE_SLOT_GLYPHS) {
+        editor_emit_line(editor, row, baseline, color);
+        renderer_flush(renderer);
+        return;
+    }
+
+    size_t slot;
+    if(!mesh_cache_get(&editor->line_meshes, line->id, line->version, &slot)) {
+        size_t draw_calls = renderer->draw_calls;
+        size_t skipped = editor->font->skipped_this_frame;
+        editor->font->emitted_pages = 0;
+        editor_emit_line(editor, row, baseline, color);
+
+        // The line did not fit into a single batch and has been partially
+        // drawn already, or some of its glyphs are not rasterized yet.
+        // Finish it the streaming way.
+        if(renderer->draw_calls != draw_calls ||
+            editor->font->skipped_this_frame != skipped ||
+            !mesh_cache_store(&editor->line_meshes, slot, renderer, line_pos)) {
+            mesh_cache_forget(&editor->line_meshes, slot);
+            renderer_flush(renderer);
+            return;
         }
-        renderer_flush(editor->renderer);
+        editor->line_meshes.atlas_pages[slot] = editor->font->emitted_pages;
     }
+    else {
+        font_touch_pages(editor->font, editor->line_meshes.atlas_pages[slot]);
+    }
+    mesh_cache_draw(&editor->line_meshes, slot, renderer, line_pos);
+}
 
-    // Render text
-    int line_height = editor->font->atlas.height;
-    for(size_t i = 0; i < editor->lines.lines_size; ++i) {
-        font_render_line(
-            editor->font,
-            editor->renderer,
-            editor->lines.lines[i].buffer,
-            editor->lines.lines[i].buffer_size,
-            vec2f(0.0f, (float)((i + 1) * line_height)),
+void editor_render(Editor *editor) {
+    Renderer *renderer = editor->renderer;
+
+    // Glyphs skipped in the last frame are due now. Meshes built before
+    // an atlas page was evicted or the zoom changed are stale.
+    if(font_frame_incomplete(editor->font))
+        editor_damage_all(editor);
+    font_begin_frame(editor->font);
+    if(editor->font_generation != editor->font->atlas.generation) {
+        mesh_cache_clear(&editor->line_meshes);
+        editor->font_generation = editor->font->atlas.generation;
+        editor_damage_all(editor);
+    }
+    float line_height = font_line_height(editor->font);
+
+    // The text moves when the line count gains or loses a digit
+    if(gutter_update(&editor->gutter, editor->font, editor->lines.lines_size))
+        editor_damage_all(editor);
+
+    // Lines on screen are wrapped before anything is placed, the rest of the
+    // document a batch at a time
+    editor_sync_row_map(editor);
+    editor_wrap_sweep(editor);
+    editor_wrap_visible(editor);
+    if(minimap_update(&editor->minimap, &editor->lines))
+        editor_damage_all(editor);
+
+    // Only the rows that changed are cleared and redrawn
+    editor_collect_damage(editor);
+    // Overlays cover rows they don't belong to
+    if(profiler_is_enabled() ||
+        editor->finder.open || editor->finder.dirty ||
+        editor->project_search.open || editor->project_search.dirty)
+        editor_damage_all(editor);
+    editor->finder.dirty = false;
+    editor->project_search.dirty = false;
+    size_t damage_start = 0, damage_end = DAMAGE_TO_END;
+    float damage_top = 0.0f, damage_bottom = renderer->resolution.y;
+    if(!editor->damage.full) {
+        damage_start = editor->damage.row_start;
+        damage_end = editor->damage.row_end;
+        damage_top = row_map_row_of_line(&editor->row_map, minul(damage_start, editor->lines.lines_size)) * line_height - renderer->scroll_pos.y;
+        if(damage_end != DAMAGE_TO_END)
+            damage_bottom = row_map_row_of_line(&editor->row_map, minul(damage_end, editor->lines.lines_size)) * line_height - renderer->scroll_pos.y;
+    }
+    renderer_begin_frame(renderer, damage_top, damage_bottom);
+
+    size_t first_row, last_row;
+    editor_get_visible_rows(editor, &first_row, &last_row);
+
+    // Render selection
+    if(selection_is_nonempty(&editor->selection))
+        editor_render_selections(editor, &editor->selection, 1, first_row, last_row);
+
+    // Render text, only the visible lines. Glyphs new to the atlas are
+    // rasterized together on worker threads before the first line is drawn.
+    size_t start = maxul(first_row, damage_start);
+    if(start < editor->lines.lines_size && editor->lines.lines[start].hidden)
+        start = editor_next_visible_line(editor, start);
+    for(size_t i = start; i < minul(last_row, damage_end); i = editor_next_visible_line(editor, i))
+        editor_prefetch_line(editor, i);
+    font_rasterize_prefetched(editor->font);
+
+    renderer_set_shader(editor->renderer, SHADER_TEXT);
+    for(size_t i = start; i < minul(last_row, damage_end); i = editor_next_visible_line(editor, i))
+        editor_render_line(editor, i, vec4f(0.0f, 0.0f, 0.0f, 1.0f));
+
+    editor_render_fold_markers(editor, first_row, last_row);
+    editor_render_gutter(editor, maxul(first_row, damage_start), minul(last_row, damage_end));
+    editor_render_minimap(editor);
+
+    // Render cursor
+    if(editor->cursor.row >= first_row && editor->cursor.row < last_row) {
+        uint64_t visual_row;
+        float x_pos;
+        editor_locate(editor, editor->cursor.row, editor->cursor.col, &visual_row, &x_pos);
+        float y_pos = visual_row * line_height;
+        renderer_set_shader(editor->renderer, SHADER_SOLID);
+        renderer_solid_rect(editor->renderer,
+            vec2f(editor->gutter.width + x_pos, y_pos),
+            vec2f(2.0f, line_height),
             vec4f(0.0f, 0.0f, 0.0f, 1.0f)
         );
-        
-        // Render cursor
-        if(editor->cursor.row == i) {
-            float x_pos = font_calculate_width(
-                editor->font,
-                editor->lines.lines[i].buffer,
-                editor->cursor.col
-            );
-            float y_pos = (float) (i * line_height);
-            renderer_set_shader(editor->renderer, SHADER_SOLID);
-            renderer_solid_rect(editor->renderer,
-                vec2f(x_pos, y_pos),
-                vec2f(2.0f, line_height),
-                vec4f(0.0f, 0.0f, 0.0f, 1.0f)
-            );
-            renderer_flush(editor->renderer);
-        }
+        renderer_flush(editor->renderer);
     }
+
+    finder_render(&editor->finder, editor->font, renderer);
+    project_search_render(&editor->project_search, editor->font, renderer);
+    profiler_render_hud(editor->font, renderer);
+    renderer_end_frame(renderer);
+
+    damage_reset(&editor->damage);
+    editor->drawn_cursor = editor->cursor;
+    editor->drawn_selection = editor->selection;
 }
 
-bool editor_load_file_from_path(Editor *editor, const char *filepath) {
+// Starts the journal over from the whole buffer
+static void editor_journal_checkpoint(Editor *editor) {
+    char *text;
+    size_t length;
+    lines_range_to_str(
+        &editor->lines,
+        0, 0,
+        editor->lines.lines_size - 1,
+        editor->lines.lines[editor->lines.lines_size - 1].buffer_size,
+        &text, &length
+    );
+    journal_checkpoint(&editor->journal, text, length);
+    free(text);
+}
+
+// Edits are journaled before they are made, this ends one
+static void editor_contents_changed(Editor *editor) {
+    source_info_contents_changed(&editor->source_info);
+    if(journal_needs_checkpoint(&editor->journal))
+        editor_journal_checkpoint(editor);
+}
+
+// Loads filepath into the buffer. Unsaved changes an editor that did not
+// exit cleanly left in the journal are replayed with recover, otherwise
+// the user is asked about them first.
+static bool editor_read_file(Editor *editor, const char *filepath, bool recover) {
     char *buffer;
     size_t length;
     
@@ -143,6 +893,7 @@ bool editor_load_file_from_path(Editor *editor, const char *filepath) {
         return false;
     }
 
+    clipboard_materialize(&editor->clipboard);
     lines_clear(&editor->lines);
     size_t line_start = 0;
     size_t line_length = 0;
@@ -158,34 +909,273 @@ bool editor_load_file_from_path(Editor *editor, const char *filepath) {
     }
     lines_append_line(&editor->lines, buffer + line_start, line_length);
     
+    minimap_load(&editor->minimap, &editor->lines, buffer, length);
     source_info_file_loaded(&editor->source_info, filepath);
+    editor->follow_offset = length;
+    file_identify(filepath, &editor->follow_identity);
+
+    free(editor->recover_path);
+    editor->recover_path = NULL;
+    bool recovered = recover && journal_recover(filepath, &editor->lines);
+    if(!recover && journal_recoverable(filepath)) {
+        // Journaling would replace the swap file before the answer
+        journal_start(&editor->journal, NULL);
+        editor->recover_path = strdup(filepath);
+        if(!dialog_confirm_recover(EDITOR_DIALOG_RECOVER))
+            fprintf(stderr, "Error: Could not ask to recover %s, its swap file is kept and the buffer not journaled\n", filepath);
+    }
+    else {
+        journal_start(&editor->journal, filepath);
+    }
+    if(recovered) {
+        minimap_lines_changed(&editor->minimap, 0, DAMAGE_TO_END);
+        source_info_contents_changed(&editor->source_info);
+        editor_journal_checkpoint(editor);
+    }
 
     editor->renderer->scroll_pos = vec2f(0.0f, 0.0f);
     cursor_set(&editor->cursor, &editor->lines, 0, 0);
     selection_reset(&editor->selection);
+    editor_damage_all(editor);
     return true;
 }
 
+bool editor_load_file_from_path(Editor *editor, const char *filepath) {
+    return editor_read_file(editor, filepath, false);
+}
+
+// The file the recovery question was about, NULL if the buffer holds
+// another one by now
+static char *editor_take_recover_path(Editor *editor) {
+    char *filepath = editor->recover_path;
+    editor->recover_path = NULL;
+    const char *current = source_info_get_save_location(&editor->source_info);
+    if(filepath && (!current || strcmp(filepath, current))) {
+        free(filepath);
+        return NULL;
+    }
+    return filepath;
+}
+
+// Loads the file again with the journal replayed over it, edits made while
+// the question was open are dropped as on a reload
+static void editor_recover_file(Editor *editor) {
+    char *filepath = editor_take_recover_path(editor);
+    if(filepath)
+        editor_read_file(editor, filepath, true);
+    free(filepath);
+}
+
+// Keeps the file as it is on disk and journals from it
+static void editor_decline_recovery(Editor *editor) {
+    char *filepath = editor_take_recover_path(editor);
+    if(!filepath)
+        return;
+    journal_discard(filepath);
+    journal_start(&editor->journal, filepath);
+    // Edits made while the question was open
+    if(editor->source_info.changed_file)
+        editor_journal_checkpoint(editor);
+    free(filepath);
+}
+
+static void editor_select_file(Editor *editor) {
+    char *dir = source_info_get_dir(&editor->source_info);
+    if(dir)
+        dialog_select_file_default_dir(EDITOR_DIALOG_OPEN, dir);
+    else
+        dialog_select_file(EDITOR_DIALOG_OPEN);
+    free(dir);
+}
+
 bool editor_load_file(Editor *editor) {
-    if(editor->source_info.changed_file && !dialog_confirm_unsaved_changes())
+    if(editor->source_info.changed_file)
+        dialog_confirm_unsaved_changes(EDITOR_DIALOG_OPEN_UNSAVED);
+    else
+        editor_select_file(editor);
+    return false;
+}
+
+static bool editor_open_pending_path(Editor *editor) {
+    char *filepath = editor->open_path;
+    editor->open_path = NULL;
+    if(!filepath || !editor_load_file_from_path(editor, filepath)) {
+        free(filepath);
         return false;
+    }
+    free(filepath);
+
+    cursor_set(&editor->cursor, &editor->lines, editor->open_row, editor->open_col);
+    editor_adjust_view_to_cursor(editor);
+    return true;
+}
 
-    char *selected_file = dialog_select_file();
-    if(!selected_file)
+bool editor_open_path(Editor *editor, const char *filepath, size_t row, size_t col) {
+    free(editor->open_path);
+    editor->open_path = strdup(filepath);
+    editor->open_row = row;
+    editor->open_col = col;
+
+    if(editor->source_info.changed_file) {
+        dialog_confirm_unsaved_changes(EDITOR_DIALOG_OPEN_PATH_UNSAVED);
+        return false;
+    }
+    return editor_open_pending_path(editor);
+}
+
+// Replaces only the lines that differ from the file on disk, so the cursor
+// and the view stay where they are
+static bool editor_reload_file(Editor *editor) {
+    const char *filepath = source_info_get_save_location(&editor->source_info);
+    const char *text;
+    size_t length;
+    if(!file_map(filepath, &text, &length))
         return false;
 
-    bool ret = editor_load_file_from_path(editor, selected_file);
-    free(selected_file);
-    return ret;
+    LineHunk *hunks;
+    size_t count = line_diff(&editor->lines, text, length, &hunks);
+    if(count) {
+        clipboard_materialize(&editor->clipboard);
+        selection_reset(&editor->selection);
+    }
+
+    // Last hunk first, the rows of those before stay valid
+    size_t row = editor->cursor.row;
+    for(size_t i = count; i-- > 0; ) {
+        LineHunk *hunk = &hunks[i];
+        lines_replace(
+            &editor->lines, hunk->old_start, hunk->old_count,
+            hunk->src, hunk->src_length, hunk->new_count
+        );
+        editor_lines_replaced(editor, hunk->old_start, hunk->old_count, hunk->new_count);
+        editor_damage_rows(
+            editor,
+            hunk->old_start,
+            hunk->old_count == hunk->new_count ? hunk->old_start + hunk->new_count : DAMAGE_TO_END
+        );
+
+        if(row >= hunk->old_start + hunk->old_count)
+            row = row - hunk->old_count + hunk->new_count;
+        else if(row >= hunk->old_start)
+            row = hunk->old_start + minul(row - hunk->old_start, hunk->new_count ? hunk->new_count - 1 : 0);
+    }
+    free(hunks);
+    file_unmap(text, length);
+    editor->follow_offset = length;
+    file_identify(filepath, &editor->follow_identity);
+
+    cursor_set(&editor->cursor, &editor->lines, row, editor->cursor.col);
+    source_info_file_reloaded(&editor->source_info);
+    journal_start(&editor->journal, filepath);
+    return true;
 }
 
-bool editor_save_file(Editor *editor) {
-    if(!source_info_has_changes(&editor->source_info))
-        return true;
+// Empties the buffer for a rotated or truncated log, which is read again
+// from its start
+static void editor_follow_restart(Editor *editor) {
+    clipboard_materialize(&editor->clipboard);
+    lines_clear(&editor->lines);
+    lines_append_line(&editor->lines, "", 0);
+    editor_damage_rows(editor, 0, DAMAGE_TO_END);
+    cursor_set(&editor->cursor, &editor->lines, 0, 0);
+    selection_reset(&editor->selection);
+    source_info_file_reloaded(&editor->source_info);
+    editor->follow_offset = 0;
+}
 
-    if(!source_info_assure_save_location(&editor->source_info))
+// Appends what was written to the followed file since the last read
+static void editor_follow_read(Editor *editor) {
+    const char *filepath = source_info_get_save_location(&editor->source_info);
+    FileIdentity identity;
+    char *text;
+    size_t length;
+    if(!file_read_from(filepath, editor->follow_offset, &text, &length, &identity))
+        return;
+
+    // A rotated or truncated log starts over, edits are only dropped once
+    // the user agrees
+    if(identity.device != editor->follow_identity.device ||
+        identity.inode != editor->follow_identity.inode ||
+        identity.size < editor->follow_offset) {
+        free(text);
+        if(editor->source_info.changed_file) {
+            dialog_confirm_follow_restart(EDITOR_DIALOG_FOLLOW_RESTART_UNSAVED);
+            return;
+        }
+        if(!file_read_from(filepath, 0, &text, &length, &identity))
+            return;
+        editor_follow_restart(editor);
+    }
+    editor->follow_identity = identity;
+
+    bool journaled = editor->source_info.changed_file && journal_has_snapshot(&editor->journal);
+    if(length) {
+        bool pinned = editor->cursor.row + 1 == editor->lines.lines_size;
+        size_t row = editor->lines.lines_size - 1;
+        size_t end_row, end_col;
+        clipboard_materialize(&editor->clipboard);
+        if(journaled)
+            journal_insert(&editor->journal, row, editor->lines.lines[row].buffer_size, text, length);
+        lines_insert_at(
+            &editor->lines, row, editor->lines.lines[row].buffer_size, text, length,
+            &end_row, &end_col
+        );
+        editor_lines_replaced(editor, row + 1, 0, end_row - row);
+        editor_damage_rows(editor, row, end_row != row ? DAMAGE_TO_END : row + 1);
+        editor->follow_offset += length;
+
+        if(pinned) {
+            cursor_set(&editor->cursor, &editor->lines, end_row, end_col);
+            editor_adjust_view_to_cursor(editor);
+        }
+    }
+    free(text);
+
+    // A clean buffer is the file as it is now. The journal of a dirty one
+    // takes the new text like any insert once it is based on a snapshot,
+    // the file it was based on just grew.
+    if(!editor->source_info.changed_file)
+        journal_start(&editor->journal, filepath);
+    else if(length && (!journaled || journal_needs_checkpoint(&editor->journal)))
+        editor_journal_checkpoint(editor);
+}
+
+void editor_toggle_follow(Editor *editor) {
+    SourceInfo *si = &editor->source_info;
+    if(si->following) {
+        source_info_set_following(si, false);
+        return;
+    }
+    if(!source_info_has_save_location(si))
+        return;
+
+    // Catch up with what was written since the file was loaded or saved. A
+    // clean buffer takes the file as it is now, a dirty one keeps its edits
+    // and gets what was appended after the size it was loaded at.
+    if(!si->changed_file && !editor_reload_file(editor))
+        return;
+
+    source_info_set_following(si, true);
+    editor_follow_read(editor);
+}
+
+bool editor_handle_file_change(Editor *editor, SDL_Event *event) {
+    bool changed;
+    if(!source_info_handle_event(&editor->source_info, event, &changed))
         return false;
 
+    if(changed) {
+        if(editor->source_info.following)
+            editor_follow_read(editor);
+        else if(editor->source_info.changed_file)
+            dialog_confirm_reload(EDITOR_DIALOG_RELOAD_UNSAVED);
+        else
+            editor_reload_file(editor);
+    }
+    return true;
+}
+
+static bool editor_write_file(Editor *editor) {
     char *buffer;
     size_t buffer_length;
 
@@ -206,6 +1196,10 @@ bool editor_save_file(Editor *editor) {
 
     source_info_file_saved(&editor->source_info);
     selection_reset(&editor->selection);
+    journal_start(&editor->journal, source_info_get_save_location(&editor->source_info));
+    // The file now ends where the buffer does
+    if(file_identify(source_info_get_save_location(&editor->source_info), &editor->follow_identity))
+        editor->follow_offset = editor->follow_identity.size;
 
     free(buffer);
     return true;
@@ -214,16 +1208,75 @@ fail:
     return false;
 }
 
-bool editor_new_file(Editor *editor) {
-    if(!source_info_new_file(&editor->source_info))
+bool editor_save_file(Editor *editor) {
+    if(!source_info_has_changes(&editor->source_info))
+        return true;
+
+    if(!source_info_has_save_location(&editor->source_info)) {
+        dialog_save_file(EDITOR_DIALOG_SAVE);
         return false;
-    
+    }
+    return editor_write_file(editor);
+}
+
+static void editor_clear_file(Editor *editor) {
+    source_info_new_file(&editor->source_info);
+    journal_start(&editor->journal, NULL);
+    clipboard_materialize(&editor->clipboard);
     lines_clear(&editor->lines);
     lines_append_line(&editor->lines, "", 0);
+    minimap_lines_changed(&editor->minimap, 0, DAMAGE_TO_END);
 
     editor->renderer->scroll_pos = vec2f(0.0f, 0.0f);
     cursor_set(&editor->cursor, &editor->lines, 0, 0);
     selection_reset(&editor->selection);
+    editor_damage_all(editor);
+}
+
+bool editor_new_file(Editor *editor) {
+    if(editor->source_info.changed_file) {
+        dialog_confirm_unsaved_changes(EDITOR_DIALOG_NEW_UNSAVED);
+        return false;
+    }
+    editor_clear_file(editor);
+    return true;
+}
+
+bool editor_handle_dialog(Editor *editor, SDL_Event *event, bool *quit) {
+    DialogResult result;
+    if(!dialog_take_result(event, &result))
+        return false;
+
+    if(result.accepted) {
+        switch(result.purpose) {
+            case EDITOR_DIALOG_OPEN_UNSAVED: { editor_select_file(editor); } break;
+            case EDITOR_DIALOG_OPEN: { editor_load_file_from_path(editor, result.path); } break;
+            case EDITOR_DIALOG_NEW_UNSAVED: { editor_clear_file(editor); } break;
+            case EDITOR_DIALOG_SAVE: {
+                source_info_set_save_location(&editor->source_info, result.path);
+                editor_write_file(editor);
+            } break;
+            case EDITOR_DIALOG_QUIT_UNSAVED: { *quit = true; } break;
+            case EDITOR_DIALOG_OPEN_PATH_UNSAVED: { editor_open_pending_path(editor); } break;
+            case EDITOR_DIALOG_RELOAD_UNSAVED: { editor_reload_file(editor); } break;
+            case EDITOR_DIALOG_FOLLOW_RESTART_UNSAVED: {
+                if(editor->source_info.following) {
+                    editor_follow_restart(editor);
+                    editor_follow_read(editor);
+                }
+            } break;
+            case EDITOR_DIALOG_RECOVER: { editor_recover_file(editor); } break;
+            default: break;
+        }
+    }
+    // Kept edits and a log that started over do not go together
+    else if(result.purpose == EDITOR_DIALOG_FOLLOW_RESTART_UNSAVED) {
+        source_info_set_following(&editor->source_info, false);
+    }
+    else if(result.purpose == EDITOR_DIALOG_RECOVER) {
+        editor_decline_recovery(editor);
+    }
+    free(result.path);
     return true;
 }
 
@@ -233,9 +1286,13 @@ static void editor_remove_selection(Editor *editor) {
     if(!selection_is_nonempty(&editor->selection))
         return;
 
+    clipboard_materialize(&editor->clipboard);
+    journal_delete(&editor->journal, rs, cs, re, ce);
     lines_delete_range(&editor->lines, rs, cs, re, ce);
+    editor_lines_replaced(editor, rs + 1, re - rs, 0);
+    editor_damage_rows(editor, rs, rs == re ? rs + 1 : DAMAGE_TO_END);
     selection_reset(&editor->selection);
-    source_info_contents_changed(&editor->source_info);
+    editor_contents_changed(editor);
 
     cursor_set(&editor->cursor, &editor->lines, rs, cs);
     editor_adjust_view_to_cursor(editor);
@@ -243,13 +1300,28 @@ static void editor_remove_selection(Editor *editor) {
 }
 
 void editor_insert_text_at_cursor(Editor *editor, const char *text) {
+    editor_insert_text_at_cursor_n(editor, text, strlen(text));
+}
+
+void editor_insert_text_at_cursor_n(Editor *editor, const char *text, size_t text_length) {
     editor_remove_selection(editor);
+    clipboard_materialize(&editor->clipboard);
 
-    size_t text_length = strlen(text);
-    lines_insert_at(&editor->lines, editor->cursor.row, editor->cursor.col, text, text_length);
-    source_info_contents_changed(&editor->source_info);
+    size_t end_row, end_col;
+    journal_insert(&editor->journal, editor->cursor.row, editor->cursor.col, text, text_length);
+    lines_insert_at(
+        &editor->lines, editor->cursor.row, editor->cursor.col, text, text_length,
+        &end_row, &end_col
+    );
+    editor_lines_replaced(editor, editor->cursor.row + 1, 0, end_row - editor->cursor.row);
+    editor_damage_rows(
+        editor,
+        editor->cursor.row,
+        end_row != editor->cursor.row ? DAMAGE_TO_END : editor->cursor.row + 1
+    );
+    editor_contents_changed(editor);
 
-    cursor_advance(&editor->cursor, &editor->lines, text_length);
+    cursor_set(&editor->cursor, &editor->lines, end_row, end_col);
     editor_adjust_view_to_cursor(editor);
 }
 
@@ -258,13 +1330,7 @@ void editor_try_copy(Editor *editor) {
         return;
     size_t rs, cs, re, ce;
     selection_get_ordered_range(&editor->selection, &rs, &cs, &re, &ce);
-    
-    char *text;
-    size_t text_length;
-    lines_range_to_str(&editor->lines, rs, cs, re, ce, &text, &text_length);
-    
-    SDL_SetClipboardText(text); // TODO error checking
-    free(text);
+    clipboard_copy(&editor->clipboard, &editor->lines, rs, cs, re, ce);
 }
 
 void editor_try_cut(Editor *editor) {
@@ -274,6 +1340,22 @@ void editor_try_cut(Editor *editor) {
     editor_remove_selection(editor);
 }
 
+void editor_paste(Editor *editor) {
+    // Our own copy is pasted without a round trip through the system
+    size_t text_length;
+    const char *text = clipboard_owned_text(&editor->clipboard, &text_length);
+    if(text) {
+        editor_insert_text_at_cursor_n(editor, text, text_length);
+        return;
+    }
+
+    if(SDL_HasClipboardText() == SDL_TRUE) {
+        char *clipboard = SDL_GetClipboardText();
+        editor_insert_text_at_cursor(editor, clipboard);
+        SDL_free(clipboard);
+    }
+}
+
 void editor_select_all(Editor *editor) {
     selection_set(
         &editor->selection,
@@ -296,13 +1378,22 @@ void editor_delete_char_before_cursor(Editor *editor) {
         return;
     }
 
+    clipboard_materialize(&editor->clipboard);
     if(editor->cursor.col) {
+        // The whole UTF-8 character goes
+        size_t start = line_prev_char(&editor->lines.lines[editor->cursor.row], editor->cursor.col);
+        journal_delete(
+            &editor->journal,
+            editor->cursor.row, start,
+            editor->cursor.row, editor->cursor.col
+        );
         lines_delete_range(
             &editor->lines,
-            editor->cursor.row, editor->cursor.col - 1,
+            editor->cursor.row, start,
             editor->cursor.row, editor->cursor.col
         );
-        --editor->cursor.col;
+        editor_damage_rows(editor, editor->cursor.row, editor->cursor.row + 1);
+        editor->cursor.col = start;
         goto epilog;
     }
 
@@ -313,6 +1404,7 @@ void editor_delete_char_before_cursor(Editor *editor) {
     Line *prev_line = &editor->lines.lines[editor->cursor.row - 1];
     size_t prev_line_end = prev_line->buffer_size;
 
+    journal_delete(&editor->journal, editor->cursor.row - 1, prev_line_end, editor->cursor.row, 0);
     line_insert_text(prev_line, prev_line->buffer_size, this_line->buffer, this_line->buffer_size);
     line_destroy(this_line);
     lines_move_raw(
@@ -322,12 +1414,14 @@ void editor_delete_char_before_cursor(Editor *editor) {
         editor->lines.lines_size - (editor->cursor.row + 1)
     );
     --editor->lines.lines_size;
+    editor_lines_replaced(editor, editor->cursor.row, 1, 0);
+    editor_damage_rows(editor, editor->cursor.row - 1, DAMAGE_TO_END);
     
     --editor->cursor.row;
     editor->cursor.col = prev_line_end;
 
 epilog:
-    source_info_contents_changed(&editor->source_info);
+    editor_contents_changed(editor);
     editor_adjust_view_to_cursor(editor);
 }
 
@@ -337,12 +1431,20 @@ void editor_delete_char_after_cursor(Editor *editor) {
         return;
     }
 
+    clipboard_materialize(&editor->clipboard);
     if(editor->cursor.col < editor->lines.lines[editor->cursor.row].buffer_size) {
+        size_t end = line_next_char(&editor->lines.lines[editor->cursor.row], editor->cursor.col);
+        journal_delete(
+            &editor->journal,
+            editor->cursor.row, editor->cursor.col,
+            editor->cursor.row, end
+        );
         lines_delete_range(
             &editor->lines,
             editor->cursor.row, editor->cursor.col,
-            editor->cursor.row, editor->cursor.col + 1
+            editor->cursor.row, end
         );
+        editor_damage_rows(editor, editor->cursor.row, editor->cursor.row + 1);
         goto epilog;
     }
 
@@ -351,6 +1453,7 @@ void editor_delete_char_after_cursor(Editor *editor) {
 
     Line *this_line = &editor->lines.lines[editor->cursor.row];
     Line *next_line = &editor->lines.lines[editor->cursor.row + 1];
+    journal_delete(&editor->journal, editor->cursor.row, this_line->buffer_size, editor->cursor.row + 1, 0);
     line_insert_text(this_line, this_line->buffer_size, next_line->buffer, next_line->buffer_size);
     line_destroy(next_line);
     lines_move_raw(
@@ -360,45 +1463,79 @@ void editor_delete_char_after_cursor(Editor *editor) {
         editor->lines.lines_size - (editor->cursor.row + 2)
     );
     --editor->lines.lines_size;
+    editor_lines_replaced(editor, editor->cursor.row + 1, 1, 0);
+    editor_damage_rows(editor, editor->cursor.row, DAMAGE_TO_END);
     
 epilog:
-    source_info_contents_changed(&editor->source_info);
+    editor_contents_changed(editor);
     editor_adjust_view_to_cursor(editor);
 }
 
 void editor_insert_newline_at_cursor(Editor *editor) {
     editor_remove_selection(editor);
+    clipboard_materialize(&editor->clipboard);
+    journal_insert(&editor->journal, editor->cursor.row, editor->cursor.col, "\n", 1);
     lines_split(&editor->lines, editor->cursor.row, editor->cursor.col);
+    editor_lines_replaced(editor, editor->cursor.row + 1, 0, 1);
+    editor_damage_rows(editor, editor->cursor.row, DAMAGE_TO_END);
 
     ++editor->cursor.row;
     editor->cursor.col = 0;
-    source_info_contents_changed(&editor->source_info);
+    editor_contents_changed(editor);
     editor_adjust_view_to_cursor(editor);
 }
 
+// Buffer position at x on a visual row, hidden lines are never hit
+static void editor_get_pos_at_row(Editor *editor, uint64_t visual_row, float x, size_t *row, size_t *col) {
+    editor_sync_row_map(editor);
+
+    // Past the end of the document is on the last visual row
+    uint64_t total = row_map_total(&editor->row_map);
+    if(visual_row >= total)
+        visual_row = total - 1;
+    *row = row_map_line_at_row(&editor->row_map, visual_row);
+    editor_wrap_line(editor, *row);
+
+    const LineAdvances *advances = editor_line_advances(editor, *row);
+    uint64_t line_row = row_map_row_of_line(&editor->row_map, *row);
+    size_t k = (size_t) minul(visual_row - line_row, advances->rows - 1);
+    size_t start = advances->starts[k];
+    *col = advance_cache_x_to_col(advances, x + advance_cache_col_to_x(advances, start));
+
+    // The end of a wrapped row is the start of the next one, stay before it
+    size_t row_end = advance_cache_row_end(advances, k);
+    if(k + 1 < advances->rows && *col >= row_end)
+        *col = advance_cache_char_start(advances, row_end - 1);
+    if(*col < start)
+        *col = start;
+}
+
 static void editor_get_cursor_pos_from_coords(Editor *editor, int32_t x, int32_t y, size_t *row, size_t *col) {
-    float line_height = (float) editor->font->atlas.height;
-    // since we're using a monospace font, all characters should have the same advance_x
-    float char_width = (float) editor->font->atlas.metrics['0'].advance_x;
+    float line_height = font_line_height(editor->font);
     Vec2f scroll_pos = editor->renderer->scroll_pos;
 
-    *row = minul(
-        (scroll_pos.y + y) / line_height,
-        editor->lines.lines_size - 1
-    );
-    *col = minul(
-        (scroll_pos.x + x + (char_width / 2)) / char_width,
-        editor->lines.lines[*row].buffer_size
-    );
+    uint64_t visual_row = (uint64_t) fmaxf((scroll_pos.y + y) / line_height, 0.0f);
+    editor_get_pos_at_row(editor, visual_row, scroll_pos.x + x - editor->gutter.width, row, col);
 }
 
 void editor_handle_single_click(Editor *editor, int32_t x, int32_t y) {
+    if(editor_minimap_hit(editor, x)) {
+        editor->minimap_dragging = true;
+        editor_minimap_jump(editor, y);
+        return;
+    }
+
     editor_get_cursor_pos_from_coords(editor, x, y, &editor->cursor.row, &editor->cursor.col);
     selection_start_selecting(&editor->selection, editor->cursor.row, editor->cursor.col);
     editor_adjust_view_to_cursor(editor);
 }
 
 void editor_handle_shift_click(Editor *editor, int32_t x, int32_t y) {
+    if(editor_minimap_hit(editor, x)) {
+        editor_handle_single_click(editor, x, y);
+        return;
+    }
+
     size_t new_row, new_col;
     editor_get_cursor_pos_from_coords(editor, x, y, &new_row, &new_col);
 
@@ -410,10 +1547,16 @@ void editor_handle_shift_click(Editor *editor, int32_t x, int32_t y) {
 }
 
 void editor_handle_click_release(Editor *editor) {
+    editor->minimap_dragging = false;
     selection_stop_selecting(&editor->selection);
 }
 
 void editor_handle_mouse_drag(Editor *editor, int32_t x, int32_t y) {
+    if(editor->minimap_dragging) {
+        editor_minimap_jump(editor, y);
+        return;
+    }
+
     if(!selection_is_selecting(&editor->selection))
         return;
 
@@ -444,44 +1587,109 @@ void editor_deselect_and_set_cursor_after(Editor *editor) {
     }
 }
 
+// Horizontal movement steps over folded lines, forward to the next line on
+// screen and backward to the end of the fold header
+static void editor_skip_hidden(Editor *editor, bool forward) {
+    editor_sync_row_map(editor);
+    Cursor *cursor = &editor->cursor;
+    if(!editor->lines.lines[cursor->row].hidden)
+        return;
+
+    size_t next = editor_next_visible_line(editor, cursor->row);
+    if(forward && next < editor->lines.lines_size) {
+        cursor->row = next;
+        cursor->col = 0;
+    }
+    else {
+        cursor->row = row_map_line_at_row(&editor->row_map, row_map_row_of_line(&editor->row_map, cursor->row) - 1);
+        cursor->col = editor->lines.lines[cursor->row].buffer_size;
+    }
+    cursor->col_persist = cursor->col;
+}
+
+// Moves the cursor by one visual row, keeping its pixel column
+static bool editor_move_cursor_vertically(Editor *editor, bool down) {
+    Cursor *cursor = &editor->cursor;
+    editor_sync_row_map(editor);
+
+    uint64_t visual_row;
+    float x;
+    editor_locate(editor, cursor->row, cursor->col, &visual_row, &x);
+    if(editor->sticky && editor->sticky_row == cursor->row && editor->sticky_col == cursor->col)
+        x = editor->sticky_x;
+
+    // Off the first or last row, to the start or end of the document
+    if(!down && !visual_row) {
+        bool moved = cursor->col != 0;
+        cursor->col_persist = cursor->col = 0;
+        return moved;
+    }
+    if(down && visual_row + 1 >= row_map_total(&editor->row_map)) {
+        size_t end = editor->lines.lines[cursor->row].buffer_size;
+        bool moved = cursor->col != end;
+        cursor->col_persist = cursor->col = end;
+        return moved;
+    }
+
+    editor_get_pos_at_row(editor, down ? visual_row + 1 : visual_row - 1, x, &cursor->row, &cursor->col);
+    cursor->col_persist = cursor->col;
+    editor->sticky = true;
+    editor->sticky_x = x;
+    editor->sticky_row = cursor->row;
+    editor->sticky_col = cursor->col;
+    return true;
+}
+
 void editor_move_cursor_right(Editor *editor) {
-    if(cursor_move_right(&editor->cursor, &editor->lines))
+    if(cursor_move_right(&editor->cursor, &editor->lines)) {
+        editor_skip_hidden(editor, true);
         editor_adjust_view_to_cursor(editor);
+    }
 }
 
 void editor_move_cursor_left(Editor *editor) {
-    if(cursor_move_left(&editor->cursor, &editor->lines))
+    if(cursor_move_left(&editor->cursor, &editor->lines)) {
+        editor_skip_hidden(editor, false);
         editor_adjust_view_to_cursor(editor);
+    }
 }
 
 void editor_move_cursor_up(Editor *editor) {
-    if(cursor_move_up(&editor->cursor, &editor->lines))
+    if(editor_move_cursor_vertically(editor, false))
         editor_adjust_view_to_cursor(editor);
 }
 
 void editor_move_cursor_down(Editor *editor) {
-    if(cursor_move_down(&editor->cursor, &editor->lines))
+    if(editor_move_cursor_vertically(editor, true))
         editor_adjust_view_to_cursor(editor);
 }
 
 void editor_skip_word_right(Editor *editor) {
-    if(cursor_skip_word_right(&editor->cursor, &editor->lines))
+    if(cursor_skip_word_right(&editor->cursor, &editor->lines)) {
+        editor_skip_hidden(editor, true);
         editor_adjust_view_to_cursor(editor);
+    }
 }
 
 void editor_skip_word_left(Editor *editor) {
-    if(cursor_skip_word_left(&editor->cursor, &editor->lines))
+    if(cursor_skip_word_left(&editor->cursor, &editor->lines)) {
+        editor_skip_hidden(editor, false);
         editor_adjust_view_to_cursor(editor);
+    }
 }
 
 void editor_swap_lines_up(Editor *editor) {
     if(!editor->cursor.row)
         return;
 
+    clipboard_materialize(&editor->clipboard);
+    journal_swap(&editor->journal, editor->cursor.row - 1, editor->cursor.row);
     lines_swap(&editor->lines, editor->cursor.row - 1, editor->cursor.row);
+    editor_lines_swapped(editor, editor->cursor.row - 1, editor->cursor.row);
+    editor_damage_rows(editor, editor->cursor.row - 1, editor->cursor.row + 1);
 
     --editor->cursor.row;
-    source_info_contents_changed(&editor->source_info);
+    editor_contents_changed(editor);
     editor_adjust_view_to_cursor(editor);
 }
 
@@ -489,30 +1697,82 @@ void editor_swap_lines_down(Editor *editor) {
     if(editor->cursor.row == editor->lines.lines_size - 1)
         return;
 
+    clipboard_materialize(&editor->clipboard);
+    journal_swap(&editor->journal, editor->cursor.row, editor->cursor.row + 1);
     lines_swap(&editor->lines, editor->cursor.row, editor->cursor.row + 1);
+    editor_lines_swapped(editor, editor->cursor.row, editor->cursor.row + 1);
+    editor_damage_rows(editor, editor->cursor.row, editor->cursor.row + 2);
     
     ++editor->cursor.row;
-    source_info_contents_changed(&editor->source_info);
+    editor_contents_changed(editor);
     editor_adjust_view_to_cursor(editor);
 }
 
 void editor_scroll_x(Editor *editor, float val) {
+    // Nothing sticks out to the right of wrapped lines
+    if(editor->wrap)
+        return;
+
+    float old = editor->renderer->scroll_pos.x;
     editor->renderer->scroll_pos.x += /*SCROLL_SPEED * */val;
     if(editor->renderer->scroll_pos.x < 0.0f)
         editor->renderer->scroll_pos.x = 0.0f;
+    if(editor->renderer->scroll_pos.x != old)
+        editor_damage_all(editor);
 }
 
 void editor_scroll_y(Editor *editor, float val) {
+    float old = editor->renderer->scroll_pos.y;
     editor->renderer->scroll_pos.y += /*SCROLL_INVERTED * SCROLL_SPEED * */val;
     if(editor->renderer->scroll_pos.y < 0.0f)
         editor->renderer->scroll_pos.y = 0.0f;
+    if(editor->renderer->scroll_pos.y != old)
+        editor_damage_all(editor);
+}
+
+static void editor_set_zoom(Editor *editor, float zoom) {
+    float old = font_zoom(editor->font);
+    font_set_zoom(editor->font, zoom);
+    float ratio = font_zoom(editor->font) / old;
+    if(ratio == 1.0f)
+        return;
+
+    editor->renderer->scroll_pos.x *= ratio;
+    editor->renderer->scroll_pos.y *= ratio;
+    editor_damage_all(editor);
+    editor_adjust_view_to_cursor(editor);
+}
+
+void editor_zoom(Editor *editor, float factor) {
+    editor_set_zoom(editor, font_zoom(editor->font) * factor);
+}
+
+void editor_zoom_reset(Editor *editor) {
+    editor_set_zoom(editor, 1.0f);
 }
 
 bool editor_try_quit(Editor *editor) {
-    return source_info_assure_no_changes(&editor->source_info);
+    if(!editor->source_info.changed_file)
+        return true;
+    dialog_confirm_unsaved_changes(EDITOR_DIALOG_QUIT_UNSAVED);
+    return false;
 }
 
 void editor_destroy(Editor *editor) {
+    mesh_cache_destroy(&editor->line_meshes);
+    advance_cache_destroy(&editor->line_advances);
+    minimap_destroy(&editor->minimap);
+    clipboard_destroy(&editor->clipboard);
+    dialog_destroy();
+    finder_destroy(&editor->finder);
+    project_search_destroy(&editor->project_search);
+    journal_destroy(&editor->journal);
+    free(editor->open_path);
+    free(editor->recover_path);
+    selection_pass_destroy(&editor->selection_pass);
+    row_map_destroy(&editor->row_map);
+    fold_set_destroy(&editor->folds);
+    free(editor->wrap_scratch);
     lines_destroy(&editor->lines);
     cursor_destroy(&editor->cursor);
     source_info_destroy(&editor->source_info);
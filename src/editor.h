@@ -10,8 +10,42 @@
 #include "editor/cursor.h"
 #include "editor/selection.h"
 #include "editor/source_info.h"
+#include "editor/damage.h"
+#include "editor/row_map.h"
+#include "editor/fold.h"
+#include "editor/gutter.h"
 #include "renderer.h"
 #include "font.h"
+#include "mesh_cache.h"
+#include "advance_cache.h"
+#include "minimap.h"
+#include "selection_pass.h"
+#include "clipboard.h"
+#include "finder.h"
+#include "search.h"
+#include "file.h"
+#include "journal.h"
+
+#define EDITOR_ZOOM_STEP 1.1f
+
+// Space left free right of soft wrapped lines
+#define EDITOR_WRAP_MARGIN 16.0f
+// Lines rewrapped per frame in the background, and lines checked at most
+#define EDITOR_WRAP_SWEEP_LINES 2048
+#define EDITOR_WRAP_SWEEP_SCAN 65536
+
+// What a dialog was opened for, its answer finishes the job
+typedef enum {
+    EDITOR_DIALOG_OPEN_UNSAVED = 0,
+    EDITOR_DIALOG_OPEN,
+    EDITOR_DIALOG_NEW_UNSAVED,
+    EDITOR_DIALOG_SAVE,
+    EDITOR_DIALOG_QUIT_UNSAVED,
+    EDITOR_DIALOG_OPEN_PATH_UNSAVED,
+    EDITOR_DIALOG_RELOAD_UNSAVED,
+    EDITOR_DIALOG_FOLLOW_RESTART_UNSAVED,
+    EDITOR_DIALOG_RECOVER
+} EditorDialog;
 
 typedef struct {
     SDL_Window *window;
@@ -22,26 +56,121 @@ typedef struct {
     Selection selection;
     SourceInfo source_info;
     Cursor cursor;
+
+    MeshCache line_meshes;
+    uint64_t font_generation;
+    AdvanceCache line_advances;
+    // Text starts right of the gutter
+    Gutter gutter;
+    // Document overview right of the text, dragging in it scrolls
+    Minimap minimap;
+    bool minimap_dragging;
+    SelectionPass selection_pass;
+    Clipboard clipboard;
+    Finder finder;
+    ProjectSearch project_search;
+
+    // The file as the buffer was last loaded, reloaded or saved. Follow mode
+    // (SourceInfo.following) appends what is written to it after
+    // follow_offset, the file is expected to stay the one follow_identity
+    // describes.
+    uint64_t follow_offset;
+    FileIdentity follow_identity;
+
+    // Edits since the file was loaded or saved, for crash recovery
+    Journal journal;
+    // File whose swap file the user was asked to recover, it is not
+    // journaled until the answer arrives
+    char *recover_path;
+
+    // File to open once the user agreed to drop the unsaved changes
+    char *open_path;
+    size_t open_row;
+    size_t open_col;
+
+    // Between editor_begin_batch and editor_end_batch the view follows the
+    // cursor only once, at the end
+    bool batching;
+    bool view_pending;
+
+    // Soft wrap. Visual rows of every line are kept in row_map, lines are
+    // rewrapped when edited, the visible ones first and the rest a few
+    // thousand per frame (wrap_sweep is the next one to look at).
+    bool wrap;
+    float wrap_width;
+    float wrap_font_scale;
+    unsigned int wrap_font_size;
+    uint32_t wrap_generation;
+    RowMap row_map;
+    uint64_t row_map_structure;
+    Damage wrap_dirty;
+    size_t wrap_sweep;
+    float *wrap_scratch;
+    size_t wrap_scratch_capacity;
+
+    // Folds ordered by header. Hidden lines take up 0 rows in row_map, edits
+    // shift the folds after them and drop the ones they cut into.
+    FoldSet folds;
+
+    // Pixel column kept by vertical cursor movement, valid while the cursor
+    // stays at sticky_row/sticky_col
+    float sticky_x;
+    size_t sticky_row;
+    size_t sticky_col;
+    bool sticky;
+
+    // What changed since the last editor_render
+    Damage damage;
+    Cursor drawn_cursor;
+    Selection drawn_selection;
 } Editor;
 
 bool editor_init(Editor *editor, SDL_Window *window, Renderer *renderer, Font *font);
 
 void editor_render(Editor *editor);
 
+// Groups the edits of a burst of input events
+void editor_begin_batch(Editor *editor);
+
+void editor_end_batch(Editor *editor);
+
+bool editor_needs_redraw(Editor *editor);
+
+void editor_damage_all(Editor *editor);
+
 bool editor_load_file_from_path(Editor *editor, const char *filepath);
 
+// These return false when they have to ask the user first (opening a file
+// always does), the job is then done by editor_handle_dialog once the
+// answer arrives
 bool editor_load_file(Editor *editor);
 
+// Opens filepath with the cursor at row and col
+bool editor_open_path(Editor *editor, const char *filepath, size_t row, size_t col);
+
 bool editor_save_file(Editor *editor);
 
 bool editor_new_file(Editor *editor);
 
 bool editor_try_quit(Editor *editor);
 
+// Acts on the answer of a dialog, returns whether event was one
+bool editor_handle_dialog(Editor *editor, SDL_Event *event, bool *quit);
+
+// Takes over changes other programs made to the open file, returns whether
+// event was a notice of one
+bool editor_handle_file_change(Editor *editor, SDL_Event *event);
+
+// Follow mode for growing files such as logs: only the bytes appended are
+// read, and the view stays at the end while the cursor is on the last line
+void editor_toggle_follow(Editor *editor);
+
 void editor_destroy(Editor *editor);
 
 void editor_insert_text_at_cursor(Editor *editor, const char *text);
 
+void editor_insert_text_at_cursor_n(Editor *editor, const char *text, size_t text_length);
+
 void editor_delete_char_before_cursor(Editor *editor);
 
 void editor_delete_char_after_cursor(Editor *editor);
@@ -52,6 +181,8 @@ void editor_try_copy(Editor *editor);
 
 void editor_try_cut(Editor *editor);
 
+void editor_paste(Editor *editor);
+
 void editor_select_all(Editor *editor);
 
 void editor_handle_single_click(Editor *editor, int32_t x, int32_t y);
@@ -86,4 +217,17 @@ void editor_scroll_x(Editor *editor, float val);
 
 void editor_scroll_y(Editor *editor, float val);
 
+void editor_toggle_wrap(Editor *editor);
+
+// Folds the region starting at the cursor line, or the block the cursor is
+// in, or unfolds the cursor line if it is folded
+void editor_toggle_fold(Editor *editor);
+
+void editor_unfold_all(Editor *editor);
+
+// Multiplies the zoom by factor, keeping the same text at the top left
+void editor_zoom(Editor *editor, float factor);
+
+void editor_zoom_reset(Editor *editor);
+
 #endif // EDITOR_H_
\ No newline at end of file
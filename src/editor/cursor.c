@@ -31,7 +31,7 @@ void cursor_advance(Cursor *cursor, LineBuffer *lb, size_t n) {
 
 bool cursor_move_left(Cursor *cursor, LineBuffer *lb) {
     if(cursor->col)
-        return cursor->col_persist = --cursor->col, true;
+        return cursor->col_persist = cursor->col = line_prev_char(&lb->lines[cursor->row], cursor->col), true;
     if(cursor->row)
         return cursor->col_persist = cursor->col = lb->lines[--cursor->row].buffer_size, true;
     return false;
@@ -39,7 +39,7 @@ bool cursor_move_left(Cursor *cursor, LineBuffer *lb) {
 
 bool cursor_move_right(Cursor *cursor, LineBuffer *lb) {
     if(cursor->col < lb->lines[cursor->row].buffer_size)
-        return cursor->col_persist = ++cursor->col, true;
+        return cursor->col_persist = cursor->col = line_next_char(&lb->lines[cursor->row], cursor->col), true;
     if(cursor->row < lb->lines_size - 1)
         return ++cursor->row, cursor->col_persist = cursor->col = 0, true;
     return false;
@@ -75,16 +75,19 @@ bool cursor_skip_word_left(Cursor *cursor, LineBuffer *lb) {
     if(!cursor->col)
         return cursor_move_left(cursor, lb);
     
+    // Looks at the character before the cursor, the one at it may be past
+    // the end of the line
+    Line *line = &lb->lines[cursor->row];
     while(
         cursor->col &&
-        utils_is_word_boundary(lb->lines[cursor->row].buffer[cursor->col])
+        utils_is_word_boundary(line->buffer[line_prev_char(line, cursor->col)])
     )
-        cursor->col_persist = --cursor->col;
+        cursor->col_persist = cursor->col = line_prev_char(line, cursor->col);
     while(
         cursor->col &&
-        !utils_is_word_boundary(lb->lines[cursor->row].buffer[cursor->col])
+        !utils_is_word_boundary(line->buffer[line_prev_char(line, cursor->col)])
     )
-        cursor->col_persist = --cursor->col;
+        cursor->col_persist = cursor->col = line_prev_char(line, cursor->col);
     return true;
 }
 
@@ -92,17 +95,18 @@ bool cursor_skip_word_right(Cursor *cursor, LineBuffer *lb) {
     if(cursor->col == lb->lines[cursor->row].buffer_size)
         return cursor_move_right(cursor, lb);
 
+    Line *line = &lb->lines[cursor->row];
     while(
-        cursor->col < lb->lines[cursor->row].buffer_size &&
-        utils_is_word_boundary(lb->lines[cursor->row].buffer[cursor->col])
+        cursor->col < line->buffer_size &&
+        utils_is_word_boundary(line->buffer[cursor->col])
     )
-        cursor->col_persist = ++cursor->col;
+        cursor->col_persist = cursor->col = line_next_char(line, cursor->col);
 
     while(
-        cursor->col < lb->lines[cursor->row].buffer_size &&
-        !utils_is_word_boundary(lb->lines[cursor->row].buffer[cursor->col])
+        cursor->col < line->buffer_size &&
+        !utils_is_word_boundary(line->buffer[cursor->col])
     )
-        cursor->col_persist = ++cursor->col;
+        cursor->col_persist = cursor->col = line_next_char(line, cursor->col);
     return true;
 }
 
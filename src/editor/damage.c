@@ -0,0 +1,28 @@
+#include "damage.h"
+
+void damage_reset(Damage *damage) {
+    *damage = (Damage) {0};
+}
+
+void damage_mark_all(Damage *damage) {
+    damage->full = true;
+}
+
+void damage_mark_rows(Damage *damage, size_t start, size_t end) {
+    if(end <= start)
+        return;
+    if(!damage->rows) {
+        damage->rows = true;
+        damage->row_start = start;
+        damage->row_end = end;
+        return;
+    }
+    if(start < damage->row_start)
+        damage->row_start = start;
+    if(end > damage->row_end)
+        damage->row_end = end;
+}
+
+bool damage_is_empty(Damage *damage) {
+    return !damage->full && !damage->rows;
+}
@@ -0,0 +1,26 @@
+#ifndef DAMAGE_H_
+#define DAMAGE_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Rows are given as [start, end), DAMAGE_TO_END extends a range to the end
+// of the document (lines were inserted or removed)
+#define DAMAGE_TO_END ((size_t) -1)
+
+typedef struct {
+    bool full;
+    bool rows;
+    size_t row_start;
+    size_t row_end;
+} Damage;
+
+void damage_reset(Damage *damage);
+
+void damage_mark_all(Damage *damage);
+
+void damage_mark_rows(Damage *damage, size_t start, size_t end);
+
+bool damage_is_empty(Damage *damage);
+
+#endif // DAMAGE_H_
@@ -0,0 +1,251 @@
+#include "fold.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Line scanning */
+
+// Offset of the first non-blank byte of line
+static size_t fold_indent(Line *line) {
+    size_t i = 0;
+    while(i < line->buffer_size && (line->buffer[i] == ' ' || line->buffer[i] == '\t'))
+        ++i;
+    return i;
+}
+
+static bool fold_starts_with(Line *line, const char *prefix) {
+    size_t i = fold_indent(line);
+    size_t length = strlen(prefix);
+    return line->buffer_size - i >= length && !memcmp(line->buffer + i, prefix, length);
+}
+
+static bool fold_is_directive(Line *line, const char *directive) {
+    size_t i = fold_indent(line);
+    if(i >= line->buffer_size || line->buffer[i] != '#')
+        return false;
+    ++i;
+    while(i < line->buffer_size && (line->buffer[i] == ' ' || line->buffer[i] == '\t'))
+        ++i;
+    size_t length = strlen(directive);
+    return line->buffer_size - i >= length && !memcmp(line->buffer + i, directive, length);
+}
+
+static bool fold_contains(Line *line, size_t from, const char *needle) {
+    size_t length = strlen(needle);
+    for(size_t i = from; i + length <= line->buffer_size; ++i)
+        if(!memcmp(line->buffer + i, needle, length))
+            return true;
+    return false;
+}
+
+typedef struct {
+    size_t opened;   // braces left open at the end of the line
+    size_t closed;   // braces closing blocks opened on earlier lines
+    int depth;       // running depth relative to the start of the scan
+    int min_depth;
+} BraceCount;
+
+// Counts the braces of a line outside of comments and literals, *comment
+// carries an unterminated block comment over to the next line
+static BraceCount fold_count_braces(Line *line, bool *comment, int depth) {
+    BraceCount count = {0, 0, depth, depth};
+    const char *s = line->buffer;
+    size_t n = line->buffer_size;
+
+    for(size_t i = 0; i < n; ++i) {
+        if(*comment) {
+            if(s[i] == '*' && i + 1 < n && s[i + 1] == '/') {
+                *comment = false;
+                ++i;
+            }
+            continue;
+        }
+
+        switch(s[i]) {
+            case '/':
+                if(i + 1 < n && s[i + 1] == '/')
+                    return count;
+                if(i + 1 < n && s[i + 1] == '*') {
+                    *comment = true;
+                    ++i;
+                }
+                break;
+            case '"':
+            case '\'': {
+                char quote = s[i];
+                for(++i; i < n && s[i] != quote; ++i)
+                    if(s[i] == '\\')
+                        ++i;
+            } break;
+            case '{':
+                ++count.opened;
+                ++count.depth;
+                break;
+            case '}':
+                if(count.opened)
+                    --count.opened;
+                else
+                    ++count.closed;
+                if(--count.depth < count.min_depth)
+                    count.min_depth = count.depth;
+                break;
+        }
+    }
+    return count;
+}
+
+/* Regions */
+
+// Block opened at open_row, the closing line stays visible
+static bool fold_find_brace_block(LineBuffer *lb, size_t row, size_t open_row, size_t *last) {
+    bool comment = false;
+    int depth = 0;
+    for(size_t r = open_row; r < lb->lines_size; ++r) {
+        BraceCount count = fold_count_braces(&lb->lines[r], &comment, depth);
+        if(r == open_row) {
+            // "} else {" closes a block before opening this one
+            if(!count.opened)
+                return false;
+            depth = (int) count.opened;
+            continue;
+        }
+        if(count.min_depth <= 0) {
+            *last = r - 1;
+            return *last > row;
+        }
+        depth = count.depth;
+    }
+    return false;
+}
+
+// Group ends before its matching #endif
+static bool fold_find_directive_block(LineBuffer *lb, size_t row, size_t *last) {
+    size_t depth = 1;
+    for(size_t r = row + 1; r < lb->lines_size; ++r) {
+        if(fold_is_directive(&lb->lines[r], "if"))
+            ++depth;
+        else if(fold_is_directive(&lb->lines[r], "endif") && !--depth) {
+            *last = r - 1;
+            return *last > row;
+        }
+    }
+    return false;
+}
+
+bool fold_find_region(LineBuffer *lb, size_t row, size_t *last) {
+    Line *line = &lb->lines[row];
+
+    if(fold_is_directive(line, "if"))
+        return fold_find_directive_block(lb, row, last);
+
+    // Block comment, the closing line is folded too
+    if(fold_starts_with(line, "/*")) {
+        if(fold_contains(line, fold_indent(line) + 2, "*/"))
+            return false;
+        for(size_t r = row + 1; r < lb->lines_size; ++r)
+            if(fold_contains(&lb->lines[r], 0, "*/")) {
+                *last = r;
+                return true;
+            }
+        return false;
+    }
+
+    // Run of line comments
+    if(fold_starts_with(line, "//")) {
+        size_t r = row + 1;
+        while(r < lb->lines_size && fold_starts_with(&lb->lines[r], "//"))
+            ++r;
+        *last = r - 1;
+        return *last > row;
+    }
+
+    bool comment = false;
+    if(fold_count_braces(line, &comment, 0).opened)
+        return fold_find_brace_block(lb, row, row, last);
+    // Brace on the next line
+    if(row + 1 < lb->lines_size && fold_starts_with(&lb->lines[row + 1], "{"))
+        return fold_find_brace_block(lb, row, row + 1, last);
+    return false;
+}
+
+bool fold_find_enclosing(LineBuffer *lb, size_t row, size_t *header) {
+    // Walking up, pending counts the braces closed below that still need an
+    // opening one. Comments spanning lines are not tracked on the way up.
+    size_t pending = 0;
+    for(size_t r = row; r-- > 0;) {
+        bool comment = false;
+        BraceCount count = fold_count_braces(&lb->lines[r], &comment, 0);
+        if(count.opened > pending) {
+            *header = r;
+            // Allman style, the header is the line before the brace
+            if(r > 0 && fold_starts_with(&lb->lines[r], "{"))
+                *header = r - 1;
+            return true;
+        }
+        pending = pending - count.opened + count.closed;
+    }
+    return false;
+}
+
+/* Fold set */
+
+void fold_set_init(FoldSet *fs) {
+    *fs = (FoldSet) {0};
+}
+
+size_t fold_set_lower_bound(FoldSet *fs, size_t row) {
+    size_t lo = 0, hi = fs->size;
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if(fs->folds[mid].header < row)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+Fold *fold_set_find(FoldSet *fs, size_t row) {
+    size_t i = fold_set_lower_bound(fs, row);
+    return i < fs->size && fs->folds[i].header == row ? &fs->folds[i] : NULL;
+}
+
+void fold_set_add(FoldSet *fs, Fold fold) {
+    size_t i = fold_set_lower_bound(fs, fold.header);
+    if(i < fs->size && fs->folds[i].header == fold.header) {
+        fs->folds[i] = fold;
+        return;
+    }
+    if(fs->size == fs->capacity) {
+        fs->capacity = fs->capacity * 2 + 8;
+        fs->folds = (Fold *) realloc(fs->folds, fs->capacity * sizeof(Fold));
+    }
+    memmove(fs->folds + i + 1, fs->folds + i, (fs->size - i) * sizeof(Fold));
+    fs->folds[i] = fold;
+    ++fs->size;
+}
+
+size_t fold_set_take_stale(FoldSet *fs, Fold **dropped) {
+    size_t count = 0, kept = 0;
+    *dropped = NULL;
+    for(size_t i = 0; i < fs->size; ++i) {
+        if(!fs->folds[i].stale) {
+            fs->folds[kept++] = fs->folds[i];
+            continue;
+        }
+        if(!count)
+            *dropped = (Fold *) malloc((fs->size - i) * sizeof(Fold));
+        (*dropped)[count++] = fs->folds[i];
+    }
+    fs->size = kept;
+    return count;
+}
+
+void fold_set_clear(FoldSet *fs) {
+    fs->size = 0;
+}
+
+void fold_set_destroy(FoldSet *fs) {
+    free(fs->folds);
+    *fs = (FoldSet) {0};
+}
@@ -0,0 +1,54 @@
+#ifndef FOLD_H_
+#define FOLD_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "line.h"
+
+// Foldable regions of a C-like buffer: brace blocks, #if/#endif groups and
+// comment blocks. A region is given by its header row, which stays visible,
+// and the last row folded away with it.
+
+// Region starting at row, sets *last to its last hidden row
+bool fold_find_region(LineBuffer *lb, size_t row, size_t *last);
+
+// Header of the innermost brace block that row is in
+bool fold_find_enclosing(LineBuffer *lb, size_t row, size_t *header);
+
+// A folded region, version is that of the header when it was folded.
+// Folds may nest or overlap, stale ones are about to be dropped.
+typedef struct {
+    size_t header;
+    size_t last;
+    uint64_t version;
+    bool stale;
+} Fold;
+
+// Folds ordered by header, at most one per header
+typedef struct {
+    Fold *folds;
+    size_t size;
+    size_t capacity;
+} FoldSet;
+
+void fold_set_init(FoldSet *fs);
+
+// Index of the first fold with a header at or after row
+size_t fold_set_lower_bound(FoldSet *fs, size_t row);
+
+// The fold with header row, NULL if there is none
+Fold *fold_set_find(FoldSet *fs, size_t row);
+
+void fold_set_add(FoldSet *fs, Fold fold);
+
+// Takes the stale folds out in one pass, *dropped gets them and has to be
+// freed. Returns how many there were.
+size_t fold_set_take_stale(FoldSet *fs, Fold **dropped);
+
+void fold_set_clear(FoldSet *fs);
+
+void fold_set_destroy(FoldSet *fs);
+
+#endif // FOLD_H_
@@ -0,0 +1,57 @@
+#include "gutter.h"
+
+// Free space around the numbers, in digits
+#define GUTTER_PADDING 2
+
+void gutter_init(Gutter *gutter) {
+    *gutter = (Gutter) {0};
+}
+
+static void gutter_load_digits(Gutter *gutter, Font *font) {
+    gutter->ready = true;
+    gutter->pages = 0;
+    gutter->digit_advance = 0.0f;
+    for(int d = 0; d < 10; ++d) {
+        // Not rasterized yet, the numbers are drawn on a later frame
+        if(!font_glyph_quad(font, '0' + d, &gutter->digits[d])) {
+            gutter->ready = false;
+            continue;
+        }
+        if(gutter->digits[d].page != FONT_NO_PAGE)
+            gutter->pages |= 1u << gutter->digits[d].page;
+        if(gutter->digits[d].advance > gutter->digit_advance)
+            gutter->digit_advance = gutter->digits[d].advance;
+    }
+    gutter->font_generation = font->atlas.generation;
+}
+
+bool gutter_update(Gutter *gutter, Font *font, size_t lines_count) {
+    if(!gutter->ready || gutter->font_generation != font->atlas.generation)
+        gutter_load_digits(gutter, font);
+    font_touch_pages(font, gutter->pages);
+
+    size_t digit_count = 1;
+    for(size_t n = lines_count; n >= 10; n /= 10)
+        ++digit_count;
+    gutter->digit_count = digit_count;
+
+    float width = (digit_count + GUTTER_PADDING) * gutter->digit_advance;
+    if(width == gutter->width)
+        return false;
+    gutter->width = width;
+    return true;
+}
+
+void gutter_emit_number(Gutter *gutter, Renderer *renderer, size_t number, float right, float baseline, Vec4f color) {
+    if(!gutter->ready)
+        return;
+
+    // Digits are laid out on the widest advance so the columns line up
+    float x = right - gutter->digit_advance;
+    do {
+        const FontQuad *digit = &gutter->digits[number % 10];
+        font_emit_quad(renderer, digit, vec2f(x + (gutter->digit_advance - digit->advance) * 0.5f, baseline), color);
+        x -= gutter->digit_advance;
+        number /= 10;
+    } while(number);
+}
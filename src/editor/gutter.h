@@ -0,0 +1,36 @@
+#ifndef GUTTER_H_
+#define GUTTER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../font.h"
+#include "../renderer.h"
+
+// Line numbers left of the text. The quads of the digits are looked up once
+// per atlas generation, numbers are emitted from them digit by digit.
+
+typedef struct {
+    FontQuad digits[10];
+    bool ready;
+    uint64_t font_generation;
+    // Atlas pages the digits are on, kept from being evicted
+    uint32_t pages;
+    float digit_advance;
+
+    // Digits of the largest line number and the resulting width
+    size_t digit_count;
+    float width;
+} Gutter;
+
+void gutter_init(Gutter *gutter);
+
+// Refreshes the digit quads and the width for lines_count lines, returns
+// whether the width changed
+bool gutter_update(Gutter *gutter, Font *font, size_t lines_count);
+
+// Emits number right aligned to right on baseline
+void gutter_emit_number(Gutter *gutter, Renderer *renderer, size_t number, float right, float baseline, Vec4f color);
+
+#endif // GUTTER_H_
@@ -12,13 +12,20 @@
 #define LINE_INITIAL_CAPACITY 64
 #define LINE_BUFFER_INITIAL_CAPACITY 32
 
+/* Line identity */
+
+static uint64_t line_next_id = 1;
+static uint64_t line_next_version = 1;
+
 /* Line methods */
 
 void line_create(Line *line) {
     *line = (Line) {
         .buffer = (char *) malloc(LINE_INITIAL_CAPACITY),
         .buffer_capacity = LINE_INITIAL_CAPACITY,
-        .buffer_size = 0
+        .buffer_size = 0,
+        .id = line_next_id++,
+        .version = line_next_version++
     };
 }
 
@@ -26,7 +33,9 @@ void line_create_copy(Line *line, const char *src, size_t src_length) {
     *line = (Line) {
         .buffer = (char *) malloc(src_length),
         .buffer_capacity = src_length,
-        .buffer_size = src_length
+        .buffer_size = src_length,
+        .id = line_next_id++,
+        .version = line_next_version++
     };
     memcpy(line->buffer, src, src_length);
 }
@@ -36,6 +45,10 @@ void line_grow(Line *line) {
     line->buffer = (char *) realloc(line->buffer, line->buffer_capacity * sizeof(char));
 }
 
+void line_touch(Line *line) {
+    line->version = line_next_version++;
+}
+
 void line_insert_text(Line *line, size_t pos, const char *text, size_t text_length) {
     while(line->buffer_size + text_length > line->buffer_capacity)
         line_grow(line);
@@ -53,6 +66,27 @@ void line_insert_text(Line *line, size_t pos, const char *text, size_t text_leng
     );
 
     line->buffer_size += text_length;
+    line_touch(line);
+}
+
+static bool line_is_continuation(char c) {
+    return ((unsigned char) c & 0xC0) == 0x80;
+}
+
+size_t line_prev_char(const Line *line, size_t col) {
+    if(col)
+        --col;
+    while(col && line_is_continuation(line->buffer[col]))
+        --col;
+    return col;
+}
+
+size_t line_next_char(const Line *line, size_t col) {
+    if(col < line->buffer_size)
+        ++col;
+    while(col < line->buffer_size && line_is_continuation(line->buffer[col]))
+        ++col;
+    return col;
 }
 
 void line_delete_text(Line *line, size_t start, size_t end) {
@@ -66,6 +100,7 @@ void line_delete_text(Line *line, size_t start, size_t end) {
     );
 
     line->buffer_size -= end - start;
+    line_touch(line);
 }
 
 void line_destroy(Line *line) {
@@ -98,6 +133,7 @@ void lines_swap(LineBuffer *lb, size_t i, size_t j) {
     Line tmp = lb->lines[i];
     lb->lines[i] = lb->lines[j];
     lb->lines[j] = tmp; 
+    ++lb->structure_version;
 }
 
 void lines_move_raw(LineBuffer *lb, size_t from, size_t to, size_t n) {
@@ -106,6 +142,7 @@ void lines_move_raw(LineBuffer *lb, size_t from, size_t to, size_t n) {
         lb->lines + from,
         n * sizeof(*lb->lines)
     );
+    ++lb->structure_version;
 }
 
 void lines_split(LineBuffer *lb, size_t row, size_t col) {
@@ -121,6 +158,7 @@ void lines_split(LineBuffer *lb, size_t row, size_t col) {
     );
 
     selected_line->buffer_size = col;
+    line_touch(selected_line);
     lines_move_raw(lb, row + 1, row + 2, lb->lines_size - (row + 1));
 
     lb->lines[row + 1] = new_line;
@@ -131,6 +169,7 @@ void lines_clear(LineBuffer *lb) {
     for(size_t i = 0; i < lb->lines_size; ++i)
         line_destroy(&lb->lines[i]);
     lb->lines_size = 0;
+    ++lb->structure_version;
 }
 
 void lines_append_line(LineBuffer *lb, const char *src, size_t src_length) {
@@ -138,6 +177,7 @@ void lines_append_line(LineBuffer *lb, const char *src, size_t src_length) {
     line_create_copy(
         &lb->lines[lb->lines_size++], src, src_length
     );
+    ++lb->structure_version;
 }
 
 void lines_insert_line(
@@ -148,28 +188,76 @@ void lines_insert_line(
     line_create_copy(&lb->lines[i], src, src_length);
 }
 
+void lines_reserve(LineBuffer *lb, size_t capacity) {
+    if(capacity <= lb->lines_capacity)
+        return;
+    lb->lines_capacity = capacity;
+    lb->lines = (Line *) realloc(lb->lines, lb->lines_capacity * sizeof(Line));
+}
+
 void lines_insert_at(
-    LineBuffer *lb, size_t row, size_t col, const char *src, size_t src_length
+    LineBuffer *lb, size_t row, size_t col, const char *src, size_t src_length,
+    size_t *end_row, size_t *end_col
 ) {
-    size_t last_pos = 0,
-                pos = utils_find_next_line(src, 0, src_length);
-    if(pos == src_length) {
+    size_t new_lines = 0;
+    const char *last_start = src;
+    for(const char *p = src; (p = memchr(p, '\n', src + src_length - p)); last_start = ++p)
+        ++new_lines;
+
+    if(!new_lines) {
         line_insert_text(&lb->lines[row], col, src, src_length);
+        *end_row = row;
+        *end_col = col + src_length;
         return;
     }
-    while(pos < src_length) {
-        line_insert_text(&lb->lines[row], col, src + last_pos, pos - last_pos);
-        
-        assert(src[pos] == '\n');
-        lines_split(lb, row, col + pos - last_pos); // TODO not if reached end?
-        ++row;
-        col = 0;
-        
-        last_pos = pos + 1;
-        pos = utils_find_next_line(src, last_pos, src_length);
+
+    // Room for every new line and the tail moved down once
+    if(lb->lines_size + new_lines > lb->lines_capacity)
+        lines_reserve(lb, maxul(lb->lines_size + new_lines, lb->lines_capacity * 2 + LINE_BUFFER_INITIAL_CAPACITY));
+    lines_move_raw(lb, row + 1, row + 1 + new_lines, lb->lines_size - (row + 1));
+    lb->lines_size += new_lines;
+
+    // The last line gets the rest of the text after the insertion point
+    Line *first = &lb->lines[row];
+    size_t last_length = src + src_length - last_start;
+    size_t tail_length = first->buffer_size - col;
+    Line *last = &lb->lines[row + new_lines];
+    line_create_copy(last, last_start, last_length);
+    line_insert_text(last, last_length, first->buffer + col, tail_length);
+
+    const char *pos = memchr(src, '\n', src_length);
+    first->buffer_size = col;
+    line_insert_text(first, col, src, pos - src);
+
+    for(size_t i = row + 1; i < row + new_lines; ++i) {
+        const char *next = memchr(pos + 1, '\n', last_start - (pos + 1));
+        line_create_copy(&lb->lines[i], pos + 1, next - (pos + 1));
+        pos = next;
+    }
+
+    *end_row = row + new_lines;
+    *end_col = last_length;
+}
+
+void lines_replace(
+    LineBuffer *lb, size_t row, size_t count,
+    const char *src, size_t src_length, size_t new_count
+) {
+    for(size_t i = row; i < row + count; ++i)
+        line_destroy(&lb->lines[i]);
+
+    if(lb->lines_size - count + new_count > lb->lines_capacity)
+        lines_reserve(lb, maxul(lb->lines_size - count + new_count, lb->lines_capacity * 2 + LINE_BUFFER_INITIAL_CAPACITY));
+    // Also marks the structure changed when the count stays the same
+    lines_move_raw(lb, row + count, row + new_count, lb->lines_size - (row + count));
+    lb->lines_size = lb->lines_size - count + new_count;
+
+    const char *pos = src, *end = src + src_length;
+    for(size_t i = 0; i < new_count; ++i) {
+        const char *next = i + 1 < new_count ? memchr(pos, '\n', end - pos) : end;
+        line_create_copy(&lb->lines[row + i], pos, next - pos);
+        pos = next + 1;
     }
-    assert(pos == src_length);
-    line_insert_text(&lb->lines[row], col, src + last_pos, pos - last_pos);
 }
 
 void lines_range_to_str(
@@ -206,7 +294,7 @@ void lines_range_to_str(
 
     memcpy(*dest + buffer_pos, lb->lines[re].buffer, ce);
     buffer_pos += ce;
-    (*dest)[buffer_pos] = '\n';
+    (*dest)[buffer_pos] = 0; // null terminator
 
     assert(buffer_pos == *dest_length);
 }
@@ -228,8 +316,8 @@ void lines_delete_range(
     );
     for(size_t i = rs + 1; i <= re; ++i)
         line_destroy(&lb->lines[i]);
-    if(re != lb->lines_size - 1)
-        lines_move_raw(lb, re + 1, rs + 1, lb->lines_size - (re + 1));
+    // Also marks the structure changed when nothing follows the range
+    lines_move_raw(lb, re + 1, rs + 1, lb->lines_size - (re + 1));
     lb->lines_size -= re - rs;
 }
 
@@ -2,17 +2,44 @@
 #define LINE_H_
 
 #include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
 
 typedef struct {
     char *buffer;
     size_t buffer_size;
     size_t buffer_capacity;
+
+    // Unique for the lifetime of the process, used as a key by render caches
+    uint64_t id;
+    // Changes whenever the contents of the line change
+    uint64_t version;
+
+    // Visual rows when soft wrapped, valid while wrap_version matches version
+    // and wrap_generation the editor's wrap generation
+    uint32_t wrap_rows;
+    uint32_t wrap_generation;
+    uint64_t wrap_version;
+
+    // Header of a fold and hidden by one, kept by the editor from its set
+    // of folds
+    bool folded;
+    bool hidden;
+
+    // Minimap columns the text of the line spans, valid while ink_version
+    // matches version
+    uint8_t ink_start;
+    uint8_t ink_end;
+    uint64_t ink_version;
 } Line;
 
 typedef struct {
     Line *lines;
     size_t lines_size;
     size_t lines_capacity;
+
+    // Changes whenever lines are inserted, removed or reordered
+    uint64_t structure_version;
 } LineBuffer;
 
 /* Line methods */
@@ -23,10 +50,18 @@ void line_create_copy(Line *line, const char *src, size_t src_length);
 
 void line_grow(Line *line);
 
+void line_touch(Line *line);
+
 void line_insert_text(Line *line, size_t pos, const char *text, size_t text_length);
 
 void line_delete_text(Line *line, size_t start, size_t end);
 
+// Start of the UTF-8 character before col and of the one after the
+// character at col, continuation bytes are never stopped at
+size_t line_prev_char(const Line *line, size_t col);
+
+size_t line_next_char(const Line *line, size_t col);
+
 void line_destroy(Line *line);
 
 /* LinesBuffer methods */
@@ -37,6 +72,8 @@ void lines_grow(LineBuffer *lb);
 
 void lines_grow_if_full(LineBuffer *lb);
 
+void lines_reserve(LineBuffer *lb, size_t capacity);
+
 void lines_swap(LineBuffer *lb, size_t i, size_t j);
 
 void lines_move_raw(LineBuffer *lb, size_t from, size_t to, size_t n);
@@ -51,8 +88,18 @@ void lines_insert_line(
     LineBuffer *lb, size_t i, const char *src, size_t src_length
 );
 
+// Counts the new lines first so the tail of the buffer moves only once,
+// end_row and end_col are set to the position after the inserted text
 void lines_insert_at(
-    LineBuffer *lb, size_t row, size_t col, const char *src, size_t src_length
+    LineBuffer *lb, size_t row, size_t col, const char *src, size_t src_length,
+    size_t *end_row, size_t *end_col
+);
+
+// Replaces count lines from row on with the new_count lines of src, which
+// are separated by newlines. The tail of the buffer moves only once.
+void lines_replace(
+    LineBuffer *lb, size_t row, size_t count,
+    const char *src, size_t src_length, size_t new_count
 );
 
 void lines_range_to_str(
@@ -0,0 +1,232 @@
+#include "line_diff.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../utils.h"
+
+// Line comparisons Myers' algorithm may make before giving up
+#define LINE_DIFF_MAX_WORK (1 << 26)
+
+typedef struct {
+    LineBuffer *lb;
+    size_t old_start;
+    const char *text;
+    // Start of every middle line of text, and one past the end of the last
+    // one plus one
+    const size_t *starts;
+    const uint64_t *old_hashes;
+    const uint64_t *new_hashes;
+} LineDiff;
+
+typedef struct {
+    ptrdiff_t x, y;
+    ptrdiff_t edit_x, edit_y;
+} LineDiffStep;
+
+static uint64_t line_diff_hash(const char *text, size_t length) {
+    uint64_t hash = 14695981039346656037ull;
+    for(size_t i = 0; i < length; ++i)
+        hash = (hash ^ (unsigned char) text[i]) * 1099511628211ull;
+    return hash;
+}
+
+static bool line_diff_same(const Line *line, const char *text, size_t length) {
+    return line->buffer_size == length && !memcmp(line->buffer, text, length);
+}
+
+static bool line_diff_equal(const LineDiff *ld, size_t x, size_t y) {
+    if(ld->old_hashes[x] != ld->new_hashes[y])
+        return false;
+    size_t start = ld->starts[y];
+    return line_diff_same(&ld->lb->lines[ld->old_start + x], ld->text + start, ld->starts[y + 1] - 1 - start);
+}
+
+static void line_diff_push(
+    LineHunk **hunks, size_t *count, size_t *capacity,
+    const LineDiff *ld, size_t x, size_t y, size_t end_x, size_t end_y
+) {
+    if(*count == *capacity) {
+        *capacity = *capacity * 2 + 16;
+        *hunks = (LineHunk *) realloc(*hunks, *capacity * sizeof(LineHunk));
+    }
+    (*hunks)[(*count)++] = (LineHunk) {
+        .old_start = ld->old_start + x,
+        .old_count = end_x - x,
+        .new_count = end_y - y,
+        .src = ld->text + ld->starts[y],
+        .src_length = end_y > y ? ld->starts[end_y] - 1 - ld->starts[y] : 0
+    };
+}
+
+// Shortest edit script between the n old and m new middle lines, false if
+// it takes too many edits or comparisons
+static bool line_diff_myers(const LineDiff *ld, size_t n, size_t m, LineHunk **hunks, size_t *count) {
+    ptrdiff_t max = (ptrdiff_t) minul(n + m, LINE_DIFF_MAX_EDITS);
+    // Furthest x on every diagonal k, and a copy of [-d, d] after every d
+    ptrdiff_t *v = (ptrdiff_t *) calloc(2 * max + 1, sizeof(ptrdiff_t));
+    ptrdiff_t *trace = NULL;
+    size_t trace_capacity = 0;
+    LineDiffStep *steps = NULL;
+    size_t work = 0;
+    ptrdiff_t edits = -1;
+
+    for(ptrdiff_t d = 0; d <= max && edits < 0 && work < LINE_DIFF_MAX_WORK; ++d) {
+        for(ptrdiff_t k = -d; k <= d; k += 2) {
+            ptrdiff_t x = k == -d || (k != d && v[max + k - 1] < v[max + k + 1])
+                ? v[max + k + 1]
+                : v[max + k - 1] + 1;
+            ptrdiff_t y = x - k;
+            while(x < (ptrdiff_t) n && y < (ptrdiff_t) m && line_diff_equal(ld, x, y)) {
+                ++x;
+                ++y;
+                ++work;
+            }
+            ++work;
+            v[max + k] = x;
+            if(x >= (ptrdiff_t) n && y >= (ptrdiff_t) m) {
+                edits = d;
+                break;
+            }
+        }
+
+        size_t needed = (size_t) ((d + 1) * (d + 1));
+        if(needed > trace_capacity) {
+            trace_capacity = maxul(needed, trace_capacity * 2);
+            trace = (ptrdiff_t *) realloc(trace, trace_capacity * sizeof(ptrdiff_t));
+        }
+        memcpy(trace + d * d, v + max - d, (2 * d + 1) * sizeof(ptrdiff_t));
+    }
+    free(v);
+    if(edits < 0) {
+        free(trace);
+        return false;
+    }
+
+    // Walk back from the end, one edit per d
+    steps = (LineDiffStep *) malloc(maxul(edits, 1) * sizeof(LineDiffStep));
+    ptrdiff_t x = n, y = m;
+    for(ptrdiff_t d = edits; d > 0; --d) {
+        const ptrdiff_t *previous = trace + (d - 1) * (d - 1) + (d - 1);
+        ptrdiff_t k = x - y;
+        bool insertion = k == -d || (k != d && previous[k - 1] < previous[k + 1]);
+        ptrdiff_t previous_k = insertion ? k + 1 : k - 1;
+        ptrdiff_t previous_x = previous[previous_k];
+        ptrdiff_t edit_x = insertion ? previous_x : previous_x + 1;
+        steps[d - 1] = (LineDiffStep) {
+            .x = previous_x, .y = previous_x - previous_k,
+            .edit_x = edit_x, .edit_y = edit_x - k
+        };
+        x = previous_x;
+        y = previous_x - previous_k;
+    }
+    free(trace);
+
+    // Edits with no matching lines between them form one hunk
+    size_t capacity = 0;
+    for(ptrdiff_t i = 0; i < edits; ) {
+        ptrdiff_t j = i;
+        while(j + 1 < edits && steps[j + 1].x == steps[j].edit_x && steps[j + 1].y == steps[j].edit_y)
+            ++j;
+        line_diff_push(hunks, count, &capacity, ld, steps[i].x, steps[i].y, steps[j].edit_x, steps[j].edit_y);
+        i = j + 1;
+    }
+    free(steps);
+    return true;
+}
+
+size_t line_diff(LineBuffer *lb, const char *text, size_t length, LineHunk **hunks) {
+    *hunks = NULL;
+    if(!text)
+        text = "";
+    size_t old_size = lb->lines_size;
+
+    // Matching lines at the start. head is where the first other line of
+    // text starts, unless text ran out of lines.
+    size_t prefix = 0, head = 0;
+    bool text_left = true;
+    while(prefix < old_size && text_left) {
+        const char *newline = (const char *) memchr(text + head, '\n', length - head);
+        size_t end = newline ? (size_t) (newline - text) : length;
+        if(!line_diff_same(&lb->lines[prefix], text + head, end - head))
+            break;
+        ++prefix;
+        if(newline)
+            head = end + 1;
+        else
+            text_left = false;
+    }
+
+    // Matching lines at the end, compared back from where the other lines
+    // of text end without looking for newlines first
+    size_t suffix = 0, tail = length;
+    while(prefix + suffix < old_size && text_left) {
+        const Line *line = &lb->lines[old_size - 1 - suffix];
+        if(tail - head < line->buffer_size)
+            break;
+        size_t start = tail - line->buffer_size;
+        if(memcmp(text + start, line->buffer, line->buffer_size) || (start > head && text[start - 1] != '\n'))
+            break;
+        ++suffix;
+        if(start == head)
+            text_left = false;
+        else
+            tail = start - 1;
+    }
+
+    size_t old_count = old_size - prefix - suffix;
+    size_t new_count = 0;
+    size_t *starts = NULL;
+    if(text_left) {
+        new_count = 1;
+        for(const char *p = text + head; (p = memchr(p, '\n', text + tail - p)); ++p)
+            ++new_count;
+        starts = (size_t *) malloc((new_count + 1) * sizeof(size_t));
+        starts[0] = head;
+        size_t i = 1;
+        for(const char *p = text + head; (p = memchr(p, '\n', text + tail - p)); ++p)
+            starts[i++] = (size_t) (p - text) + 1;
+        starts[new_count] = tail + 1;
+    }
+    else {
+        starts = (size_t *) malloc(sizeof(size_t));
+        starts[0] = head;
+    }
+    if(!old_count && !new_count) {
+        free(starts);
+        return 0;
+    }
+
+    LineDiff ld = { .lb = lb, .old_start = prefix, .text = text, .starts = starts };
+    size_t count = 0;
+    if(old_count && new_count) {
+        uint64_t *old_hashes = (uint64_t *) malloc(old_count * sizeof(uint64_t));
+        uint64_t *new_hashes = (uint64_t *) malloc(new_count * sizeof(uint64_t));
+        for(size_t i = 0; i < old_count; ++i)
+            old_hashes[i] = line_diff_hash(lb->lines[prefix + i].buffer, lb->lines[prefix + i].buffer_size);
+        for(size_t i = 0; i < new_count; ++i)
+            new_hashes[i] = line_diff_hash(text + starts[i], starts[i + 1] - 1 - starts[i]);
+        ld.old_hashes = old_hashes;
+        ld.new_hashes = new_hashes;
+
+        if(!line_diff_myers(&ld, old_count, new_count, hunks, &count)) {
+            free(*hunks);
+            *hunks = NULL;
+            count = 0;
+        }
+        free(old_hashes);
+        free(new_hashes);
+        if(count) {
+            free(starts);
+            return count;
+        }
+    }
+
+    // Everything between the matching ends
+    size_t capacity = 0;
+    line_diff_push(hunks, &count, &capacity, &ld, 0, 0, old_count, new_count);
+    free(starts);
+    return count;
+}
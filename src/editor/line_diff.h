@@ -0,0 +1,30 @@
+#ifndef LINE_DIFF_H_
+#define LINE_DIFF_H_
+
+#include <stddef.h>
+
+#include "line.h"
+
+// Line level difference between a buffer and a text, used to take over
+// changes made to the file by other programs. Lines matching at the start
+// and end are skipped first, the lines in between are compared by their
+// hashes (Myers' algorithm). Past LINE_DIFF_MAX_EDITS the whole middle is
+// one hunk.
+
+#define LINE_DIFF_MAX_EDITS 1024
+
+// old_count lines of the buffer from old_start on become the new_count
+// lines of src, separated by newlines
+typedef struct {
+    size_t old_start;
+    size_t old_count;
+    size_t new_count;
+    const char *src;
+    size_t src_length;
+} LineHunk;
+
+// Hunks turning the lines of lb into those of text, in order. src of the
+// hunks points into text. *hunks has to be freed.
+size_t line_diff(LineBuffer *lb, const char *text, size_t length, LineHunk **hunks);
+
+#endif // LINE_DIFF_H_
@@ -0,0 +1,161 @@
+#include "row_map.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "../utils.h"
+
+void row_map_init(RowMap *map) {
+    *map = (RowMap) {0};
+}
+
+static size_t row_map_slot(RowMap *map, size_t line) {
+    return line < map->gap ? line : line + map->gap_size;
+}
+
+static void row_map_add(RowMap *map, size_t slot, int64_t delta) {
+    for(size_t i = slot + 1; i <= map->capacity; i += i & -i)
+        map->tree[i] += delta;
+}
+
+static void row_map_set_slot(RowMap *map, size_t slot, uint32_t rows) {
+    int64_t delta = (int64_t) rows - (int64_t) map->rows[slot];
+    if(!delta)
+        return;
+    map->rows[slot] = rows;
+    row_map_add(map, slot, delta);
+}
+
+static void row_map_reserve(RowMap *map, size_t capacity) {
+    if(capacity <= map->capacity)
+        return;
+    map->rows = (uint32_t *) realloc(map->rows, capacity * sizeof(uint32_t));
+    map->tree = (uint64_t *) realloc(map->tree, (capacity + 1) * sizeof(uint64_t));
+    map->capacity = capacity;
+}
+
+static size_t row_map_wanted_gap(size_t size) {
+    return maxul(ROW_MAP_MIN_GAP, size / 8);
+}
+
+void row_map_resize(RowMap *map, size_t size) {
+    row_map_reserve(map, size + row_map_wanted_gap(size));
+    map->size = size;
+    map->gap = size;
+    map->gap_size = map->capacity - size;
+}
+
+void row_map_rebuild(RowMap *map) {
+    memset(map->rows + map->gap, 0, map->gap_size * sizeof(uint32_t));
+    for(size_t i = 1; i <= map->capacity; ++i)
+        map->tree[i] = map->rows[i - 1];
+    for(size_t i = 1; i <= map->capacity; ++i) {
+        size_t parent = i + (i & -i);
+        if(parent <= map->capacity)
+            map->tree[parent] += map->tree[i];
+    }
+}
+
+// Moves the gap in front of line at. Lines close by are moved one by one
+// through the tree, far ones all at once with a rebuild.
+static void row_map_move_gap(RowMap *map, size_t at) {
+    size_t distance = at > map->gap ? at - map->gap : map->gap - at;
+    if(!distance || !map->gap_size)
+        return;
+
+    if(distance > map->capacity / 32) {
+        if(at < map->gap)
+            memmove(map->rows + at + map->gap_size, map->rows + at, distance * sizeof(uint32_t));
+        else
+            memmove(map->rows + map->gap, map->rows + map->gap + map->gap_size, distance * sizeof(uint32_t));
+        map->gap = at;
+        row_map_rebuild(map);
+        return;
+    }
+
+    for(; map->gap > at; --map->gap) {
+        uint32_t rows = map->rows[map->gap - 1];
+        row_map_set_slot(map, map->gap - 1, 0);
+        row_map_set_slot(map, map->gap - 1 + map->gap_size, rows);
+    }
+    for(; map->gap < at; ++map->gap) {
+        uint32_t rows = map->rows[map->gap + map->gap_size];
+        row_map_set_slot(map, map->gap + map->gap_size, 0);
+        row_map_set_slot(map, map->gap, rows);
+    }
+}
+
+void row_map_set(RowMap *map, size_t line, uint32_t rows) {
+    assert(line < map->size);
+    row_map_set_slot(map, row_map_slot(map, line), rows);
+}
+
+uint32_t row_map_get(RowMap *map, size_t line) {
+    assert(line < map->size);
+    return map->rows[row_map_slot(map, line)];
+}
+
+void row_map_insert(RowMap *map, size_t at, size_t count) {
+    assert(at <= map->size);
+    if(count > map->gap_size) {
+        // Out of empty slots, the lines after the gap move to the new end
+        size_t after = map->capacity - map->gap - map->gap_size;
+        size_t capacity = map->size + count + row_map_wanted_gap(map->size + count);
+        row_map_reserve(map, capacity);
+        memmove(map->rows + map->capacity - after, map->rows + map->gap + map->gap_size, after * sizeof(uint32_t));
+        map->gap_size = map->capacity - map->size;
+        row_map_rebuild(map);
+    }
+
+    row_map_move_gap(map, at);
+    map->gap += count;
+    map->gap_size -= count;
+    map->size += count;
+}
+
+void row_map_remove(RowMap *map, size_t at, size_t count) {
+    assert(at + count <= map->size);
+    row_map_move_gap(map, at);
+    for(size_t i = 0; i < count; ++i)
+        row_map_set_slot(map, map->gap + map->gap_size + i, 0);
+    map->gap_size += count;
+    map->size -= count;
+}
+
+uint64_t row_map_row_of_line(RowMap *map, size_t line) {
+    assert(line <= map->size);
+    uint64_t row = 0;
+    for(size_t i = line == map->size ? map->capacity : row_map_slot(map, line); i > 0; i -= i & -i)
+        row += map->tree[i];
+    return row;
+}
+
+size_t row_map_line_at_row(RowMap *map, uint64_t row) {
+    // Descend to the longest prefix of slots whose rows sum to at most row,
+    // the slot after it is never an empty one unless it is past the end
+    size_t step = 1;
+    while(step * 2 <= map->capacity)
+        step *= 2;
+
+    size_t pos = 0;
+    for(; step; step /= 2) {
+        if(pos + step <= map->capacity && map->tree[pos + step] <= row) {
+            pos += step;
+            row -= map->tree[pos];
+        }
+    }
+    if(pos < map->gap)
+        return pos;
+    return pos >= map->gap + map->gap_size ? pos - map->gap_size : map->gap;
+}
+
+uint64_t row_map_total(RowMap *map) {
+    return row_map_row_of_line(map, map->size);
+}
+
+void row_map_destroy(RowMap *map) {
+    free(map->rows);
+    free(map->tree);
+    *map = (RowMap) {0};
+}
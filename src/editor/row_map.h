@@ -0,0 +1,57 @@
+#ifndef ROW_MAP_H_
+#define ROW_MAP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Maps buffer lines to the visual rows they occupy (more than one when soft
+// wrapped) and back. Both directions are O(log n) through a Fenwick tree of
+// the per-line row counts.
+//
+// The slots of the tree hold the lines with a gap of empty slots (0 rows)
+// at the last edit, like a gap buffer. Lines inserted or removed there only
+// touch the slots around the gap, moving the gap costs O(log n) per line it
+// passes.
+
+// Empty slots kept after a rebuild, at least
+#define ROW_MAP_MIN_GAP 1024
+
+typedef struct {
+    uint32_t *rows; // visual rows of every slot
+    uint64_t *tree; // Fenwick tree over rows, 1-based
+    size_t size;
+    size_t capacity;
+    // The empty slots, lines from gap on are in the slots after them
+    size_t gap;
+    size_t gap_size;
+} RowMap;
+
+void row_map_init(RowMap *map);
+
+// Sets the number of lines and moves the gap to the end, so rows can be
+// filled line by line before calling row_map_rebuild
+void row_map_resize(RowMap *map, size_t size);
+
+// Rebuilds the tree from rows in O(n)
+void row_map_rebuild(RowMap *map);
+
+void row_map_set(RowMap *map, size_t line, uint32_t rows);
+
+uint32_t row_map_get(RowMap *map, size_t line);
+
+// count lines with 0 rows are inserted before line at
+void row_map_insert(RowMap *map, size_t at, size_t count);
+
+void row_map_remove(RowMap *map, size_t at, size_t count);
+
+// First visual row of line, line == size gives the total
+uint64_t row_map_row_of_line(RowMap *map, size_t line);
+
+// Line containing visual row, size if row is past the end
+size_t row_map_line_at_row(RowMap *map, uint64_t row);
+
+uint64_t row_map_total(RowMap *map);
+
+void row_map_destroy(RowMap *map);
+
+#endif // ROW_MAP_H_
@@ -1,13 +1,35 @@
+#define _DEFAULT_SOURCE
 #include "source_info.h"
-#include "../dialog.h"
 #include "../utils.h"
 
+#include <sys/inotify.h>
+
 #define TITLE_DEFAULT "Untitled file"
 
+// A file is written and closed, or replaced by renaming another over it
+#define WATCH_RELOAD (IN_CLOSE_WRITE | IN_MOVED_TO)
+// Every write counts, and a rotated log is created anew
+#define WATCH_FOLLOW (WATCH_RELOAD | IN_MODIFY | IN_CREATE)
+
 static void source_info_set_title(SourceInfo *si, const char *title) {
     SDL_SetWindowTitle(si->window, title);
 }
 
+// Remembers the file on disk as the one the buffer matches
+static void source_info_stat_disk(SourceInfo *si) {
+    si->disk_known = si->filepath && stat(si->filepath, &si->disk) == 0;
+}
+
+static void source_info_watch(SourceInfo *si) {
+    file_watch_set(&si->watch, si->filepath, si->following ? WATCH_FOLLOW : WATCH_RELOAD);
+}
+
+static bool source_info_same_disk(const struct stat *a, const struct stat *b) {
+    return a->st_dev == b->st_dev && a->st_ino == b->st_ino &&
+        a->st_size == b->st_size &&
+        a->st_mtim.tv_sec == b->st_mtim.tv_sec && a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
+}
+
 void source_info_init(SourceInfo *si, SDL_Window *window) {
     *si = (SourceInfo) {
         .loaded_file = false,
@@ -16,6 +38,8 @@ void source_info_init(SourceInfo *si, SDL_Window *window) {
         .window = window
     };
     source_info_set_title(si, TITLE_DEFAULT);
+    // Without the watch only changes made by other programs go unnoticed
+    file_watch_init(&si->watch);
 }
 
 void source_info_contents_changed(SourceInfo *si) {
@@ -29,34 +53,72 @@ void source_info_contents_changed(SourceInfo *si) {
     si->changed_file = true;
 }
 
-bool source_info_new_file(SourceInfo *si) {
-    if(si->changed_file && !dialog_confirm_unsaved_changes())
-        return false; 
-
+void source_info_new_file(SourceInfo *si) {
     free(si->filepath);
     si->filepath = NULL;
     si->changed_file = si->loaded_file = false;
-    
-    source_info_set_title(si, TITLE_DEFAULT);
+    si->disk_known = si->following = false;
+    source_info_watch(si);
 
-    return true;
+    source_info_set_title(si, TITLE_DEFAULT);
 }
 
 void source_info_file_saved(SourceInfo *si) {
     source_info_set_title(si, si->filepath);
     si->changed_file = false;
     si->loaded_file = true;
+    source_info_watch(si);
+    source_info_stat_disk(si);
+}
+
+void source_info_file_reloaded(SourceInfo *si) {
+    source_info_set_title(si, si->filepath);
+    si->changed_file = false;
+    source_info_stat_disk(si);
+}
+
+bool source_info_handle_event(SourceInfo *si, SDL_Event *event, bool *changed) {
+    uint32_t mask;
+    if(!file_watch_take(&si->watch, event, &mask))
+        return false;
+
+    // Our own saves are noticed too, they leave the file as it was saved
+    struct stat disk;
+    *changed = (mask & (si->following ? WATCH_FOLLOW : WATCH_RELOAD)) &&
+        si->loaded_file && si->filepath && stat(si->filepath, &disk) == 0 &&
+        (!si->disk_known || !source_info_same_disk(&disk, &si->disk));
+    if(*changed) {
+        si->disk = disk;
+        si->disk_known = true;
+    }
+    return true;
 }
 
 bool source_info_has_changes(SourceInfo *si) {
     return si->changed_file;
 }
 
-bool source_info_assure_save_location(SourceInfo *si) {
-    if(si->loaded_file)
-        return true;
+bool source_info_has_save_location(SourceInfo *si) {
+    return si->loaded_file;
+}
+
+void source_info_set_save_location(SourceInfo *si, const char *filepath) {
+    free(si->filepath);
+    si->filepath = strdup(filepath);
+}
 
-    return (si->filepath = dialog_save_file());
+char *source_info_get_dir(SourceInfo *si) {
+    if(!si->loaded_file)
+        return NULL;
+
+    const char *slash = strrchr(si->filepath, '/');
+    if(!slash)
+        return NULL;
+    size_t length = slash == si->filepath ? 1 : (size_t) (slash - si->filepath);
+    char *dir = (char *) malloc(length + 1);
+    memcpy(dir, si->filepath, length);
+    dir[length] = 0;
+    return dir;
 }
 
 const char *source_info_get_save_location(SourceInfo *si) {
@@ -70,12 +132,17 @@ void source_info_file_loaded(SourceInfo *si, const char *filepath) {
     si->changed_file = false;
 
     source_info_set_title(si, filepath);
+    si->following = false;
+    source_info_watch(si);
+    source_info_stat_disk(si);
 }
 
-bool source_info_assure_no_changes(SourceInfo *si) {
-    return (!si->changed_file) || dialog_confirm_unsaved_changes();
+void source_info_set_following(SourceInfo *si, bool following) {
+    si->following = following;
+    source_info_watch(si);
 }
 
 void source_info_destroy(SourceInfo *si) {
+    file_watch_destroy(&si->watch);
     free(si->filepath);
 }
@@ -2,9 +2,11 @@
 #define SOURCE_INFO_H_
 
 #include <stdbool.h>
+#include <sys/stat.h>
 #include <SDL2/SDL.h>
 
 #include "../utils.h"
+#include "../file_watch.h"
 
 typedef struct {
     bool loaded_file;
@@ -12,13 +14,21 @@ typedef struct {
     char *filepath;
     //void (*set_title)(void *arg, const char *src);
     SDL_Window *window;
+
+    // The file on disk as it was last loaded or saved, other programs
+    // writing it are noticed through watch
+    FileWatch watch;
+    bool disk_known;
+    struct stat disk;
+    // Growing files are watched for every write, not just finished ones
+    bool following;
 } SourceInfo;
 
 /* SourceInfo methods */
 
 void source_info_init(SourceInfo *si, SDL_Window *window);
 
-bool source_info_new_file(SourceInfo *si);
+void source_info_new_file(SourceInfo *si);
 
 void source_info_contents_changed(SourceInfo *si);
 
@@ -26,13 +36,25 @@ void source_info_file_loaded(SourceInfo *si, const char *filepath);
 
 void source_info_file_saved(SourceInfo *si);
 
+// The buffer was brought in line with the file on disk
+void source_info_file_reloaded(SourceInfo *si);
+
+// Returns whether event is a notice of the file watch, changed tells if
+// the file on disk is no longer the one last loaded or saved
+bool source_info_handle_event(SourceInfo *si, SDL_Event *event, bool *changed);
+
+void source_info_set_following(SourceInfo *si, bool following);
+
 bool source_info_has_changes(SourceInfo *si);
 
 const char *source_info_get_save_location(SourceInfo *si);
 
-bool source_info_assure_save_location(SourceInfo *si);
+bool source_info_has_save_location(SourceInfo *si);
+
+void source_info_set_save_location(SourceInfo *si, const char *filepath);
 
-bool source_info_assure_no_changes(SourceInfo *si);
+// Directory of the file, NULL for untitled files. Has to be freed.
+char *source_info_get_dir(SourceInfo *si);
 
 void source_info_destroy(SourceInfo *si);
 
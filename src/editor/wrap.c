@@ -0,0 +1,64 @@
+#include "wrap.h"
+
+#include <stdbool.h>
+
+#include "../utils.h"
+
+static bool wrap_is_continuation(char c) {
+    return ((unsigned char) c & 0xC0) == 0x80;
+}
+
+// Last position in (start, length] whose pen position is at most limit
+static size_t wrap_last_fitting(const float *x, size_t start, size_t length, float limit) {
+    size_t lo = start + 1, hi = length + 1;
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if(x[mid] <= limit)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo - 1;
+}
+
+size_t wrap_line(
+    const char *text,
+    const float *x,
+    size_t length,
+    float width,
+    size_t *starts,
+    size_t starts_capacity
+) {
+    size_t rows = 0;
+    size_t start = 0;
+    for(;;) {
+        if(starts && rows < starts_capacity)
+            starts[rows] = start;
+        ++rows;
+        if(x[length] - x[start] <= width)
+            return rows;
+
+        size_t end = wrap_last_fitting(x, start, length, x[start] + width);
+
+        // Prefer breaking after a word boundary, otherwise in the middle of
+        // the word but never inside a character
+        size_t brk = end;
+        while(brk > start && !utils_is_word_boundary(text[brk - 1]))
+            --brk;
+        if(brk == start) {
+            brk = end;
+            while(brk > start && wrap_is_continuation(text[brk]))
+                --brk;
+        }
+        // Not even one character fits, take it anyway
+        if(brk == start) {
+            brk = start + 1;
+            while(brk < length && wrap_is_continuation(text[brk]))
+                ++brk;
+        }
+
+        start = brk;
+        if(start >= length)
+            return rows;
+    }
+}
@@ -0,0 +1,19 @@
+#ifndef WRAP_H_
+#define WRAP_H_
+
+#include <stddef.h>
+
+// Breaks a line into visual rows no wider than width, after a word boundary
+// where possible. x holds the pen position before every byte (see
+// font_line_advances). The first byte of every row is written to starts if
+// it is not NULL, up to starts_capacity of them. Returns the number of rows.
+size_t wrap_line(
+    const char *text,
+    const float *x,
+    size_t length,
+    float width,
+    size_t *starts,
+    size_t starts_capacity
+);
+
+#endif // WRAP_H_
@@ -1,6 +1,11 @@
+#define _DEFAULT_SOURCE
 #include "./file.h"
 
+#include <fcntl.h>
 #include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 size_t file_size(FILE *fp) {
     long pos = ftell(fp);
@@ -63,6 +68,114 @@ fail:
     return false;
 }
 
+bool file_map(
+    const char *filepath,
+    const char **contents,
+    size_t *length
+) {
+    int fd = open(filepath, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        fprintf(stderr, "Error: Failed to open file %s\n", filepath);
+        perror("open");
+        return false;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) < 0) {
+        perror("fstat");
+        goto fail;
+    }
+    *length = (size_t) st.st_size;
+    *contents = NULL;
+    if(*length) {
+        void *mapping = mmap(NULL, *length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(mapping == MAP_FAILED) {
+            fprintf(stderr, "Error: Failed to map file %s\n", filepath);
+            perror("mmap");
+            goto fail;
+        }
+        *contents = (const char *) mapping;
+    }
+
+    close(fd);
+    return true;
+
+fail:
+    close(fd);
+    return false;
+}
+
+void file_unmap(const char *contents, size_t length) {
+    if(contents)
+        munmap((void *) contents, length);
+}
+
+static void file_identity_from_stat(const struct stat *st, FileIdentity *identity) {
+    *identity = (FileIdentity) {
+        .device = (uint64_t) st->st_dev,
+        .inode = (uint64_t) st->st_ino,
+        .size = (uint64_t) st->st_size
+    };
+}
+
+bool file_identify(const char *filepath, FileIdentity *identity) {
+    struct stat st;
+    if(stat(filepath, &st) < 0)
+        return false;
+    file_identity_from_stat(&st, identity);
+    return true;
+}
+
+bool file_read_from(
+    const char *filepath,
+    uint64_t offset,
+    char **contents,
+    size_t *length,
+    FileIdentity *identity
+) {
+    *contents = NULL;
+    *length = 0;
+    int fd = open(filepath, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return false;
+
+    struct stat st;
+    if(fstat(fd, &st) < 0) {
+        perror("fstat");
+        goto fail;
+    }
+    file_identity_from_stat(&st, identity);
+    if(identity->size <= offset) {
+        close(fd);
+        return true;
+    }
+
+    size_t wanted = (size_t) (identity->size - offset);
+    *contents = (char *) malloc(wanted);
+    while(*length < wanted) {
+        ssize_t n = pread(fd, *contents + *length, wanted - *length, (off_t) (offset + *length));
+        if(n < 0) {
+            fprintf(stderr, "Error reading file %s.\n", filepath);
+            perror("pread");
+            goto fail;
+        }
+        // Shrunk while being read
+        if(!n)
+            break;
+        *length += (size_t) n;
+    }
+
+    close(fd);
+    return true;
+
+fail:
+    free(*contents);
+    *contents = NULL;
+    *length = 0;
+    close(fd);
+    return false;
+}
+
 void file_destroy(char *contents) {
     free(contents);
 }
\ No newline at end of file
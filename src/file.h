@@ -3,11 +3,34 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+
+// Which file a path leads to, and how big it is
+typedef struct {
+    uint64_t device;
+    uint64_t inode;
+    uint64_t size;
+} FileIdentity;
 
 bool file_read(const char *filepath, char **contents, size_t *length);
 
 bool file_write(const char *filepath, char *contents, size_t length);
 
+// Maps the file read only instead of copying it, contents is NULL for an
+// empty file
+bool file_map(const char *filepath, const char **contents, size_t *length);
+
+void file_unmap(const char *contents, size_t length);
+
+bool file_identify(const char *filepath, FileIdentity *identity);
+
+// Reads the file from offset to its end, contents is NULL if nothing is
+// there. identity is that of the file read.
+bool file_read_from(
+    const char *filepath, uint64_t offset,
+    char **contents, size_t *length, FileIdentity *identity
+);
+
 void file_destroy(char *contents);
 
 #endif // FILE_H_
\ No newline at end of file
@@ -0,0 +1,512 @@
+#define _DEFAULT_SOURCE
+#include "./file_index.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "./fuzzy.h"
+#include "./utils.h"
+
+#define FILE_INDEX_INITIAL_CAPACITY 1024
+#define FILE_INDEX_WATCH_MASK \
+    (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK)
+// Removed entries are dropped once there are this many and more than live ones
+#define FILE_INDEX_COMPACT_MIN 4096
+
+char *file_index_full_path(FileIndex *fi, const char *path) {
+    char *full = utils_path_join(fi->root, path);
+    // The root itself has no trailing slash
+    size_t length = strlen(full);
+    if(length > 1 && full[length - 1] == '/')
+        full[length - 1] = 0;
+    return full;
+}
+
+/* Entries, the lock has to be held */
+
+static uint32_t file_index_hash(const char *path, size_t length) {
+    uint32_t hash = 2166136261u;
+    for(size_t i = 0; i < length; ++i)
+        hash = (hash ^ (unsigned char) path[i]) * 16777619u;
+    return hash;
+}
+
+static size_t file_index_find(FileIndex *fi, const char *path, size_t length) {
+    size_t mask = fi->slots_capacity - 1;
+    for(size_t slot = file_index_hash(path, length) & mask; fi->slots[slot]; slot = (slot + 1) & mask) {
+        size_t i = fi->slots[slot] - 1;
+        if(!fi->removed[i] && fi->lengths[i] == length && !memcmp(fi->text + fi->offsets[i], path, length))
+            return i;
+    }
+    return fi->count;
+}
+
+static void file_index_slot_insert(FileIndex *fi, size_t i) {
+    size_t mask = fi->slots_capacity - 1;
+    size_t slot = file_index_hash(fi->text + fi->offsets[i], fi->lengths[i]) & mask;
+    while(fi->slots[slot])
+        slot = (slot + 1) & mask;
+    fi->slots[slot] = (uint32_t) (i + 1);
+    ++fi->slots_used;
+}
+
+// Rebuilds the table at most a quarter full
+static void file_index_rehash(FileIndex *fi) {
+    size_t capacity = FILE_INDEX_INITIAL_CAPACITY;
+    while(capacity < (fi->count - fi->removed_count) * 4)
+        capacity *= 2;
+
+    free(fi->slots);
+    fi->slots_capacity = capacity;
+    fi->slots_used = 0;
+    fi->slots = (uint32_t *) calloc(capacity, sizeof(*fi->slots));
+    for(size_t i = 0; i < fi->count; ++i)
+        if(!fi->removed[i])
+            file_index_slot_insert(fi, i);
+}
+
+static void file_index_grow(FileIndex *fi) {
+    fi->capacity = fi->capacity * 2 + FILE_INDEX_INITIAL_CAPACITY;
+    fi->offsets = (size_t *) realloc(fi->offsets, fi->capacity * sizeof(*fi->offsets));
+    fi->lengths = (uint32_t *) realloc(fi->lengths, fi->capacity * sizeof(*fi->lengths));
+    fi->masks = (uint64_t *) realloc(fi->masks, fi->capacity * sizeof(*fi->masks));
+    fi->removed = (bool *) realloc(fi->removed, fi->capacity * sizeof(*fi->removed));
+}
+
+static void file_index_add(FileIndex *fi, const char *path) {
+    size_t length = strlen(path);
+    if(file_index_find(fi, path, length) != fi->count)
+        return;
+
+    if(fi->count == fi->capacity)
+        file_index_grow(fi);
+    if(fi->text_size + length > fi->text_capacity) {
+        fi->text_capacity = maxul(fi->text_capacity * 2, fi->text_size + length);
+        fi->text = (char *) realloc(fi->text, fi->text_capacity);
+    }
+
+    size_t i = fi->count++;
+    memcpy(fi->text + fi->text_size, path, length);
+    fi->offsets[i] = fi->text_size;
+    fi->lengths[i] = (uint32_t) length;
+    fi->masks[i] = fuzzy_char_mask(path, length);
+    fi->removed[i] = false;
+    fi->text_size += length;
+
+    file_index_slot_insert(fi, i);
+    if(fi->slots_used * 2 > fi->slots_capacity)
+        file_index_rehash(fi);
+    ++fi->version;
+}
+
+static void file_index_compact(FileIndex *fi) {
+    size_t kept = 0, text_size = 0;
+    for(size_t i = 0; i < fi->count; ++i) {
+        if(fi->removed[i])
+            continue;
+        memmove(fi->text + text_size, fi->text + fi->offsets[i], fi->lengths[i]);
+        fi->offsets[kept] = text_size;
+        fi->lengths[kept] = fi->lengths[i];
+        fi->masks[kept] = fi->masks[i];
+        fi->removed[kept] = false;
+        text_size += fi->lengths[i];
+        ++kept;
+    }
+    fi->count = kept;
+    fi->text_size = text_size;
+    fi->removed_count = 0;
+    file_index_rehash(fi);
+}
+
+static void file_index_remove_at(FileIndex *fi, size_t i) {
+    fi->removed[i] = true;
+    ++fi->removed_count;
+    ++fi->version;
+}
+
+// Removes a file, or everything below a directory
+static void file_index_remove(FileIndex *fi, const char *path, bool is_dir) {
+    size_t length = strlen(path);
+    if(!is_dir) {
+        size_t i = file_index_find(fi, path, length);
+        if(i != fi->count)
+            file_index_remove_at(fi, i);
+    }
+    else {
+        for(size_t i = 0; i < fi->count; ++i)
+            if(!fi->removed[i] && fi->lengths[i] > length &&
+                fi->text[fi->offsets[i] + length] == '/' &&
+                !memcmp(fi->text + fi->offsets[i], path, length))
+                file_index_remove_at(fi, i);
+    }
+
+    if(fi->removed_count >= FILE_INDEX_COMPACT_MIN && fi->removed_count * 2 > fi->count)
+        file_index_compact(fi);
+}
+
+static void file_index_post_change(FileIndex *fi) {
+    if(!SDL_AtomicCAS(&fi->event_queued, 0, 1))
+        return;
+    SDL_Event event = { .type = fi->changed_event };
+    event.user.data1 = fi;
+    if(SDL_PushEvent(&event) <= 0)
+        SDL_AtomicSet(&fi->event_queued, 0);
+}
+
+/* Walk */
+
+static void file_index_queue_dirs(FileIndex *fi, FileIndexDir *dirs, size_t count) {
+    if(!count)
+        return;
+    SDL_LockMutex(fi->queue_lock);
+    if(fi->queue_size + count > fi->queue_capacity) {
+        fi->queue_capacity = maxul(fi->queue_capacity * 2, fi->queue_size + count);
+        fi->queue = (FileIndexDir *) realloc(fi->queue, fi->queue_capacity * sizeof(*fi->queue));
+    }
+    memcpy(fi->queue + fi->queue_size, dirs, count * sizeof(*dirs));
+    fi->queue_size += count;
+    SDL_CondBroadcast(fi->work);
+    SDL_UnlockMutex(fi->queue_lock);
+}
+
+static void file_index_watch(FileIndex *fi, const char *full_path, const char *dir, const IgnoreRules *rules) {
+    if(fi->inotify < 0)
+        return;
+    int wd = inotify_add_watch(fi->inotify, full_path, FILE_INDEX_WATCH_MASK);
+    int error = errno;
+
+    SDL_LockMutex(fi->lock);
+    if(wd < 0) {
+        if(error == ENOSPC && !fi->watches_exhausted) {
+            fprintf(stderr, "Error: Out of inotify watches, the file index will miss changes\n");
+            fi->watches_exhausted = true;
+        }
+        SDL_UnlockMutex(fi->lock);
+        return;
+    }
+    if((size_t) wd >= fi->watches_capacity) {
+        size_t capacity = maxul(fi->watches_capacity * 2, (size_t) wd + 1);
+        fi->watches = (FileIndexDir *) realloc(fi->watches, capacity * sizeof(*fi->watches));
+        memset(fi->watches + fi->watches_capacity, 0, (capacity - fi->watches_capacity) * sizeof(*fi->watches));
+        fi->watches_capacity = capacity;
+    }
+    free(fi->watches[wd].dir);
+    fi->watches[wd] = (FileIndexDir) { .dir = strdup(dir), .rules = rules };
+    SDL_UnlockMutex(fi->lock);
+}
+
+// Reads one directory, adds its files and queues its subdirectories
+static void file_index_read_dir(FileIndex *fi, FileIndexDir *dir) {
+    // Rules are read outside of the lock and only published under it
+    IgnoreRules *loaded = NULL;
+    const IgnoreRules *rules = ignore_rules_load(&loaded, dir->rules, fi->root, dir->dir);
+
+    char *full_path = file_index_full_path(fi, dir->dir);
+    // Watched before reading so nothing created meanwhile is missed
+    file_index_watch(fi, full_path, dir->dir, rules);
+    DIR *d = opendir(full_path);
+
+    char **files = NULL;
+    size_t files_count = 0, files_capacity = 0;
+    FileIndexDir *subdirs = NULL;
+    size_t subdirs_count = 0, subdirs_capacity = 0;
+
+    struct dirent *entry;
+    while(d && (entry = readdir(d))) {
+        const char *name = entry->d_name;
+        if(!strcmp(name, ".") || !strcmp(name, "..") || !strcmp(name, ".git"))
+            continue;
+
+        // Symbolic links are left out, they could lead in circles
+        unsigned char type = entry->d_type;
+        if(type == DT_UNKNOWN) {
+            struct stat st;
+            char *entry_path = utils_path_join(full_path, name);
+            type = lstat(entry_path, &st) < 0 ? DT_UNKNOWN
+                : S_ISDIR(st.st_mode) ? DT_DIR
+                : S_ISREG(st.st_mode) ? DT_REG
+                : DT_UNKNOWN;
+            free(entry_path);
+        }
+        if(type != DT_DIR && type != DT_REG)
+            continue;
+
+        char *path = utils_path_join(dir->dir, name);
+        if(ignore_rules_match(rules, path, type == DT_DIR)) {
+            free(path);
+            continue;
+        }
+
+        if(type == DT_DIR) {
+            if(subdirs_count == subdirs_capacity) {
+                subdirs_capacity = subdirs_capacity * 2 + 16;
+                subdirs = (FileIndexDir *) realloc(subdirs, subdirs_capacity * sizeof(*subdirs));
+            }
+            subdirs[subdirs_count++] = (FileIndexDir) { .dir = path, .rules = rules };
+        }
+        else {
+            if(files_count == files_capacity) {
+                files_capacity = files_capacity * 2 + 64;
+                files = (char **) realloc(files, files_capacity * sizeof(*files));
+            }
+            files[files_count++] = path;
+        }
+    }
+    if(d)
+        closedir(d);
+    free(full_path);
+
+    SDL_LockMutex(fi->lock);
+    if(loaded) {
+        loaded->next = fi->rules;
+        fi->rules = loaded;
+    }
+    for(size_t i = 0; i < files_count; ++i)
+        file_index_add(fi, files[i]);
+    SDL_UnlockMutex(fi->lock);
+
+    for(size_t i = 0; i < files_count; ++i)
+        free(files[i]);
+    free(files);
+    file_index_queue_dirs(fi, subdirs, subdirs_count);
+    free(subdirs);
+    if(files_count)
+        file_index_post_change(fi);
+}
+
+static int file_index_worker(void *data) {
+    FileIndex *fi = (FileIndex *) data;
+    for(;;) {
+        SDL_LockMutex(fi->queue_lock);
+        while(!fi->queue_size && !fi->stopping)
+            SDL_CondWait(fi->work, fi->queue_lock);
+        if(fi->stopping) {
+            SDL_UnlockMutex(fi->queue_lock);
+            return 0;
+        }
+        // Last in first out keeps the queue as short as the tree is deep
+        FileIndexDir dir = fi->queue[--fi->queue_size];
+        ++fi->busy;
+        SDL_UnlockMutex(fi->queue_lock);
+
+        file_index_read_dir(fi, &dir);
+        free(dir.dir);
+
+        SDL_LockMutex(fi->queue_lock);
+        bool finished = !--fi->busy && !fi->queue_size;
+        SDL_UnlockMutex(fi->queue_lock);
+        if(finished)
+            file_index_post_change(fi);
+    }
+}
+
+/* Watch */
+
+static void file_index_unwatch_below(FileIndex *fi, const char *path) {
+    size_t length = strlen(path);
+    for(size_t wd = 0; wd < fi->watches_capacity; ++wd) {
+        char *dir = fi->watches[wd].dir;
+        if(!dir || strncmp(dir, path, length) || (dir[length] && dir[length] != '/'))
+            continue;
+        inotify_rm_watch(fi->inotify, (int) wd);
+        free(dir);
+        fi->watches[wd].dir = NULL;
+    }
+}
+
+// Applies one event with the lock held, new directories are collected in
+// dirs to be walked
+static void file_index_apply(
+    FileIndex *fi, const struct inotify_event *event,
+    FileIndexDir **dirs, size_t *dirs_count, size_t *dirs_capacity
+) {
+    if(event->wd < 0 || (size_t) event->wd >= fi->watches_capacity)
+        return;
+    FileIndexDir *watch = &fi->watches[event->wd];
+    if(event->mask & IN_IGNORED) {
+        free(watch->dir);
+        watch->dir = NULL;
+        return;
+    }
+    if(!watch->dir || !event->len)
+        return;
+
+    bool is_dir = (event->mask & IN_ISDIR) != 0;
+    char *path = utils_path_join(watch->dir, event->name);
+    if(event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+        file_index_remove(fi, path, is_dir);
+        // A moved directory keeps its watches under the old name
+        if(is_dir)
+            file_index_unwatch_below(fi, path);
+    }
+    if((event->mask & (IN_CREATE | IN_MOVED_TO)) && !ignore_rules_match(watch->rules, path, is_dir)) {
+        if(is_dir) {
+            if(*dirs_count == *dirs_capacity) {
+                *dirs_capacity = *dirs_capacity * 2 + 8;
+                *dirs = (FileIndexDir *) realloc(*dirs, *dirs_capacity * sizeof(**dirs));
+            }
+            (*dirs)[(*dirs_count)++] = (FileIndexDir) { .dir = path, .rules = watch->rules };
+            return;
+        }
+        file_index_add(fi, path);
+    }
+    free(path);
+}
+
+static int file_index_watcher(void *data) {
+    FileIndex *fi = (FileIndex *) data;
+    _Alignas(struct inotify_event) char buffer[64 * 1024];
+    struct pollfd fds[2] = {
+        { .fd = fi->inotify, .events = POLLIN },
+        { .fd = fi->wake_pipe[0], .events = POLLIN }
+    };
+
+    for(;;) {
+        if(poll(fds, 2, -1) < 0)
+            continue;
+        if(fds[1].revents)
+            return 0;
+
+        ssize_t n = read(fi->inotify, buffer, sizeof(buffer));
+        if(n <= 0)
+            continue;
+
+        FileIndexDir *dirs = NULL;
+        size_t dirs_count = 0, dirs_capacity = 0;
+        SDL_LockMutex(fi->lock);
+        uint64_t version = fi->version;
+        for(char *p = buffer; p < buffer + n; ) {
+            const struct inotify_event *event = (const struct inotify_event *) p;
+            file_index_apply(fi, event, &dirs, &dirs_count, &dirs_capacity);
+            p += sizeof(struct inotify_event) + event->len;
+        }
+        bool changed = fi->version != version;
+        SDL_UnlockMutex(fi->lock);
+
+        file_index_queue_dirs(fi, dirs, dirs_count);
+        free(dirs);
+        if(changed)
+            file_index_post_change(fi);
+    }
+}
+
+/* FileIndex */
+
+bool file_index_start(FileIndex *fi, const char *root) {
+    *fi = (FileIndex) {0};
+    fi->inotify = fi->wake_pipe[0] = fi->wake_pipe[1] = -1;
+    fi->root = strdup(root);
+    fi->lock = SDL_CreateMutex();
+    fi->queue_lock = SDL_CreateMutex();
+    fi->work = SDL_CreateCond();
+    fi->changed_event = SDL_RegisterEvents(1);
+    if(!fi->lock || !fi->queue_lock || !fi->work || fi->changed_event == (Uint32) -1) {
+        fprintf(stderr, "Error: Could not set up the file index: %s\n", SDL_GetError());
+        return false;
+    }
+    file_index_rehash(fi);
+
+    // Without inotify the index is only as fresh as the walk
+    fi->inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(fi->inotify < 0)
+        perror("inotify_init1");
+    else if(pipe(fi->wake_pipe) < 0)
+        perror("pipe");
+    else if(!(fi->watcher = SDL_CreateThread(file_index_watcher, "file watch", fi)))
+        fprintf(stderr, "Error: Could not start file watch thread: %s\n", SDL_GetError());
+
+    FileIndexDir root_dir = { .dir = strdup(""), .rules = NULL };
+    file_index_queue_dirs(fi, &root_dir, 1);
+
+    int cpus = SDL_GetCPUCount();
+    size_t threads = minul(cpus > 0 ? (size_t) cpus : 1, FILE_INDEX_MAX_THREADS);
+    for(; fi->thread_count < threads; ++fi->thread_count) {
+        fi->threads[fi->thread_count] = SDL_CreateThread(file_index_worker, "file index", fi);
+        if(!fi->threads[fi->thread_count])
+            break;
+    }
+    if(!fi->thread_count) {
+        fprintf(stderr, "Error: Could not start file index threads: %s\n", SDL_GetError());
+        return false;
+    }
+    return true;
+}
+
+bool file_index_scanning(FileIndex *fi) {
+    SDL_LockMutex(fi->queue_lock);
+    bool scanning = fi->queue_size || fi->busy;
+    SDL_UnlockMutex(fi->queue_lock);
+    return scanning;
+}
+
+bool file_index_handle_event(FileIndex *fi, SDL_Event *event) {
+    if(!fi->lock || event->type != fi->changed_event || event->user.data1 != fi)
+        return false;
+    SDL_AtomicSet(&fi->event_queued, 0);
+    return true;
+}
+
+void file_index_lock(FileIndex *fi) {
+    SDL_LockMutex(fi->lock);
+}
+
+void file_index_unlock(FileIndex *fi) {
+    SDL_UnlockMutex(fi->lock);
+}
+
+const char *file_index_path(FileIndex *fi, size_t i, size_t *length) {
+    *length = fi->lengths[i];
+    return fi->text + fi->offsets[i];
+}
+
+void file_index_stop(FileIndex *fi) {
+    if(fi->queue_lock) {
+        SDL_LockMutex(fi->queue_lock);
+        fi->stopping = true;
+        SDL_CondBroadcast(fi->work);
+        SDL_UnlockMutex(fi->queue_lock);
+    }
+    for(size_t i = 0; i < fi->thread_count; ++i)
+        SDL_WaitThread(fi->threads[i], NULL);
+
+    if(fi->watcher) {
+        char wake = 0;
+        if(write(fi->wake_pipe[1], &wake, 1) == 1)
+            SDL_WaitThread(fi->watcher, NULL);
+    }
+    if(fi->wake_pipe[0] >= 0) {
+        close(fi->wake_pipe[0]);
+        close(fi->wake_pipe[1]);
+    }
+    if(fi->inotify >= 0)
+        close(fi->inotify);
+
+    for(size_t i = 0; i < fi->queue_size; ++i)
+        free(fi->queue[i].dir);
+    for(size_t wd = 0; wd < fi->watches_capacity; ++wd)
+        free(fi->watches[wd].dir);
+    ignore_rules_free_list(fi->rules);
+    free(fi->queue);
+    free(fi->watches);
+    free(fi->text);
+    free(fi->offsets);
+    free(fi->lengths);
+    free(fi->masks);
+    free(fi->removed);
+    free(fi->slots);
+    free(fi->root);
+    if(fi->work)
+        SDL_DestroyCond(fi->work);
+    if(fi->queue_lock)
+        SDL_DestroyMutex(fi->queue_lock);
+    if(fi->lock)
+        SDL_DestroyMutex(fi->lock);
+    *fi = (FileIndex) {0};
+}
@@ -0,0 +1,93 @@
+#ifndef FILE_INDEX_H_
+#define FILE_INDEX_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <SDL2/SDL.h>
+
+#include "./gitignore.h"
+
+// Paths of the files below a root directory. A pool of threads reads the
+// directories in parallel, skipping what .gitignore excludes, and inotify
+// keeps the index current afterwards. Every change posts changed_event
+// (at most one is queued at a time). Readers hold the lock while they look
+// at the entries.
+
+#define FILE_INDEX_MAX_THREADS 8
+
+typedef struct {
+    char *dir; // relative to the root, "" is the root itself
+    const IgnoreRules *rules;
+} FileIndexDir;
+
+typedef struct {
+    char *root;
+    Uint32 changed_event;
+    SDL_atomic_t event_queued;
+
+    // Entries in parallel arrays. Paths are relative to the root and stored
+    // back to back in text. Removed entries stay until there are many.
+    SDL_mutex *lock;
+    char *text;
+    size_t text_size;
+    size_t text_capacity;
+    size_t *offsets;
+    uint32_t *lengths;
+    uint64_t *masks;
+    bool *removed;
+    size_t count;
+    size_t capacity;
+    size_t removed_count;
+    // Open addressing table of entry index + 1, slots of removed entries
+    // stay taken until the table is rebuilt
+    uint32_t *slots;
+    size_t slots_capacity;
+    size_t slots_used;
+    // Changes whenever an entry is added or removed
+    uint64_t version;
+    // Every rule set loaded, freed with the index
+    IgnoreRules *rules;
+
+    // Directories waiting to be read, and how many are being read
+    SDL_mutex *queue_lock;
+    SDL_cond *work;
+    FileIndexDir *queue;
+    size_t queue_size;
+    size_t queue_capacity;
+    size_t busy;
+    bool stopping;
+    SDL_Thread *threads[FILE_INDEX_MAX_THREADS];
+    size_t thread_count;
+
+    // Watched directories by watch descriptor
+    int inotify;
+    int wake_pipe[2];
+    SDL_Thread *watcher;
+    FileIndexDir *watches;
+    size_t watches_capacity;
+    bool watches_exhausted;
+} FileIndex;
+
+bool file_index_start(FileIndex *fi, const char *root);
+
+// Whether directories are still being read
+bool file_index_scanning(FileIndex *fi);
+
+// Returns whether event is a change notice of fi
+bool file_index_handle_event(FileIndex *fi, SDL_Event *event);
+
+void file_index_lock(FileIndex *fi);
+
+void file_index_unlock(FileIndex *fi);
+
+// Path of entry i, only valid while the lock is held
+const char *file_index_path(FileIndex *fi, size_t i, size_t *length);
+
+// Path of the file relative to the root as an absolute one, to be freed
+char *file_index_full_path(FileIndex *fi, const char *path);
+
+void file_index_stop(FileIndex *fi);
+
+#endif // FILE_INDEX_H_
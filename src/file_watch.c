@@ -0,0 +1,142 @@
+#define _DEFAULT_SOURCE
+#include "./file_watch.h"
+
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "./utils.h"
+
+static void file_watch_post(FileWatch *fw, uint32_t mask) {
+    int old;
+    do {
+        old = SDL_AtomicGet(&fw->mask);
+    } while(!SDL_AtomicCAS(&fw->mask, old, old | (int) mask));
+
+    if(!SDL_AtomicCAS(&fw->event_queued, 0, 1))
+        return;
+    SDL_Event event = { .type = fw->event };
+    event.user.data1 = fw;
+    if(SDL_PushEvent(&event) <= 0)
+        SDL_AtomicSet(&fw->event_queued, 0);
+}
+
+static int file_watch_worker(void *data) {
+    FileWatch *fw = (FileWatch *) data;
+    _Alignas(struct inotify_event) char buffer[16 * 1024];
+    struct pollfd fds[2] = {
+        { .fd = fw->inotify, .events = POLLIN },
+        { .fd = fw->wake_pipe[0], .events = POLLIN }
+    };
+
+    for(;;) {
+        if(poll(fds, 2, -1) < 0)
+            continue;
+        if(fds[1].revents)
+            return 0;
+
+        ssize_t n = read(fw->inotify, buffer, sizeof(buffer));
+        if(n <= 0)
+            continue;
+
+        uint32_t mask = 0;
+        SDL_LockMutex(fw->lock);
+        for(char *p = buffer; p < buffer + n; ) {
+            const struct inotify_event *event = (const struct inotify_event *) p;
+            if(event->wd == fw->wd && event->len && fw->name && !strcmp(event->name, fw->name))
+                mask |= event->mask;
+            p += sizeof(struct inotify_event) + event->len;
+        }
+        SDL_UnlockMutex(fw->lock);
+
+        if(mask)
+            file_watch_post(fw, mask);
+    }
+}
+
+bool file_watch_init(FileWatch *fw) {
+    *fw = (FileWatch) {0};
+    fw->inotify = fw->wake_pipe[0] = fw->wake_pipe[1] = fw->wd = -1;
+    fw->lock = SDL_CreateMutex();
+    fw->event = SDL_RegisterEvents(1);
+    if(!fw->lock || fw->event == (Uint32) -1) {
+        fprintf(stderr, "Error: Could not set up the file watch: %s\n", SDL_GetError());
+        return false;
+    }
+
+    fw->inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(fw->inotify < 0) {
+        perror("inotify_init1");
+        return false;
+    }
+    if(pipe(fw->wake_pipe) < 0) {
+        perror("pipe");
+        fw->wake_pipe[0] = fw->wake_pipe[1] = -1;
+        return false;
+    }
+    if(!(fw->thread = SDL_CreateThread(file_watch_worker, "file watch", fw))) {
+        fprintf(stderr, "Error: Could not start file watch thread: %s\n", SDL_GetError());
+        return false;
+    }
+    return true;
+}
+
+void file_watch_set(FileWatch *fw, const char *filepath, uint32_t events) {
+    if(!fw->thread)
+        return;
+
+    SDL_LockMutex(fw->lock);
+    if(fw->wd >= 0)
+        inotify_rm_watch(fw->inotify, fw->wd);
+    fw->wd = -1;
+    free(fw->name);
+    fw->name = NULL;
+
+    if(filepath) {
+        const char *slash = strrchr(filepath, '/');
+        char *dir;
+        if(!slash)
+            dir = strdup(".");
+        else {
+            size_t length = slash == filepath ? 1 : (size_t) (slash - filepath);
+            dir = (char *) malloc(length + 1);
+            memcpy(dir, filepath, length);
+            dir[length] = 0;
+        }
+        fw->wd = inotify_add_watch(fw->inotify, dir, events | IN_ONLYDIR);
+        if(fw->wd < 0)
+            perror("inotify_add_watch");
+        else
+            fw->name = strdup(slash ? slash + 1 : filepath);
+        free(dir);
+    }
+    SDL_UnlockMutex(fw->lock);
+}
+
+bool file_watch_take(FileWatch *fw, SDL_Event *event, uint32_t *mask) {
+    if(!fw->lock || event->type != fw->event || event->user.data1 != fw)
+        return false;
+    SDL_AtomicSet(&fw->event_queued, 0);
+    *mask = (uint32_t) SDL_AtomicSet(&fw->mask, 0);
+    return true;
+}
+
+void file_watch_destroy(FileWatch *fw) {
+    if(fw->thread) {
+        char wake = 0;
+        if(write(fw->wake_pipe[1], &wake, 1) == 1)
+            SDL_WaitThread(fw->thread, NULL);
+    }
+    if(fw->wake_pipe[0] >= 0) {
+        close(fw->wake_pipe[0]);
+        close(fw->wake_pipe[1]);
+    }
+    if(fw->inotify >= 0)
+        close(fw->inotify);
+    free(fw->name);
+    if(fw->lock)
+        SDL_DestroyMutex(fw->lock);
+}
@@ -0,0 +1,42 @@
+#ifndef FILE_WATCH_H_
+#define FILE_WATCH_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <SDL2/SDL.h>
+
+// Watches one file for changes made by other programs. The directory
+// holding it is watched, so a file replaced by a rename is still seen. A
+// helper thread collects the inotify events of the file and posts event
+// (at most one is queued at a time).
+
+typedef struct {
+    int inotify;
+    int wake_pipe[2];
+    SDL_Thread *thread;
+
+    // The watched directory and the name of the file in it
+    SDL_mutex *lock;
+    int wd;
+    char *name;
+
+    Uint32 event;
+    SDL_atomic_t event_queued;
+    // inotify events of the file since the last file_watch_take
+    SDL_atomic_t mask;
+} FileWatch;
+
+bool file_watch_init(FileWatch *fw);
+
+// Starts watching filepath for the inotify events in events instead of the
+// file watched so far, NULL stops watching
+void file_watch_set(FileWatch *fw, const char *filepath, uint32_t events);
+
+// Returns whether event is a notice of fw, mask is set to what happened to
+// the file since the last one
+bool file_watch_take(FileWatch *fw, SDL_Event *event, uint32_t *mask);
+
+void file_watch_destroy(FileWatch *fw);
+
+#endif // FILE_WATCH_H_
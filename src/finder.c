@@ -0,0 +1,256 @@
+#define _DEFAULT_SOURCE
+#include "./finder.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "./fuzzy.h"
+#include "./utils.h"
+
+#define FINDER_PADDING 8.0f
+#define FINDER_WIDTH_RATIO 0.6f
+#define FINDER_MIN_WIDTH 400.0f
+#define FINDER_TEXT_COLOR vec4f(1.0f, 1.0f, 1.0f, 1.0f)
+#define FINDER_STATUS_COLOR vec4f(0.6f, 0.6f, 0.6f, 1.0f)
+#define FINDER_BACKGROUND_COLOR vec4f(0.0f, 0.0f, 0.0f, 0.85f)
+#define FINDER_SELECTION_COLOR vec4f(0.25f, 0.35f, 0.55f, 1.0f)
+
+typedef struct {
+    int32_t score;
+    uint32_t length;
+    size_t index;
+} FinderRank;
+
+void finder_init(Finder *finder) {
+    *finder = (Finder) {0};
+}
+
+static void finder_clear_results(Finder *finder) {
+    for(size_t i = 0; i < finder->results_count; ++i)
+        free(finder->results[i].path);
+    finder->results_count = 0;
+}
+
+// Higher score first, shorter path on ties
+static bool finder_rank_better(const FinderRank *a, const FinderRank *b) {
+    if(a->score != b->score)
+        return a->score > b->score;
+    return a->length < b->length;
+}
+
+static void finder_rank_insert(FinderRank *top, size_t *count, FinderRank rank) {
+    if(*count == FINDER_MAX_RESULTS && !finder_rank_better(&rank, &top[*count - 1]))
+        return;
+
+    size_t i = *count < FINDER_MAX_RESULTS ? (*count)++ : *count - 1;
+    for(; i > 0 && finder_rank_better(&rank, &top[i - 1]); --i)
+        top[i] = top[i - 1];
+    top[i] = rank;
+}
+
+static void finder_search(Finder *finder) {
+    if(!finder->index_started)
+        return;
+
+    // Spaces only separate the parts of a query
+    char query[FINDER_QUERY_CAPACITY];
+    size_t query_length = 0;
+    for(size_t i = 0; i < finder->query_length; ++i) {
+        char c = finder->query[i];
+        if(c == ' ')
+            continue;
+        query[query_length++] = c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+    }
+    uint64_t query_mask = fuzzy_char_mask(query, query_length);
+
+    FileIndex *fi = &finder->index;
+    file_index_lock(fi);
+
+    // What does not match a query does not match any longer one either
+    bool narrowing = finder->candidates_valid
+        && finder->ranked_version == fi->version
+        && finder->ranked_query_length <= query_length
+        && !memcmp(finder->ranked_query, query, finder->ranked_query_length);
+
+    if(!narrowing && finder->candidates_capacity < fi->count) {
+        finder->candidates_capacity = fi->count;
+        finder->candidates = (uint32_t *) realloc(finder->candidates, finder->candidates_capacity * sizeof(uint32_t));
+    }
+
+    FinderRank top[FINDER_MAX_RESULTS];
+    size_t top_count = 0;
+    size_t matches = 0;
+    size_t total = narrowing ? finder->candidates_count : fi->count;
+    for(size_t k = 0; k < total; ++k) {
+        size_t i = narrowing ? finder->candidates[k] : k;
+        if(fi->removed[i] || (fi->masks[i] & query_mask) != query_mask)
+            continue;
+
+        size_t length;
+        const char *path = file_index_path(fi, i, &length);
+        int32_t score = query_length ? fuzzy_score(query, query_length, path, length) : 0;
+        if(score == FUZZY_NO_MATCH)
+            continue;
+
+        finder->candidates[matches++] = (uint32_t) i;
+        finder_rank_insert(top, &top_count, (FinderRank) { score, (uint32_t) length, i });
+    }
+    finder->candidates_count = matches;
+    finder->candidates_valid = true;
+    finder->ranked_version = fi->version;
+    memcpy(finder->ranked_query, query, query_length);
+    finder->ranked_query_length = query_length;
+    finder->indexed_count = fi->count - fi->removed_count;
+
+    finder_clear_results(finder);
+    for(size_t r = 0; r < top_count; ++r) {
+        size_t length;
+        const char *path = file_index_path(fi, top[r].index, &length);
+        FinderResult *result = &finder->results[r];
+        result->score = top[r].score;
+        result->length = length;
+        result->path = (char *) malloc(length + 1);
+        memcpy(result->path, path, length);
+        result->path[length] = 0;
+    }
+    finder->results_count = top_count;
+
+    file_index_unlock(fi);
+
+    if(finder->selected >= finder->results_count)
+        finder->selected = finder->results_count ? finder->results_count - 1 : 0;
+}
+
+void finder_toggle(Finder *finder) {
+    if(finder->open) {
+        finder_close(finder);
+        return;
+    }
+
+    if(!finder->index_started) {
+        char cwd[PATH_MAX];
+        if(!getcwd(cwd, sizeof(cwd))) {
+            perror("getcwd");
+            return;
+        }
+        // Stopped with the finder even if it failed half way
+        finder->index_started = true;
+        file_index_start(&finder->index, cwd);
+    }
+
+    finder->open = true;
+    finder->dirty = true;
+    finder->query_length = 0;
+    finder->selected = 0;
+    finder_search(finder);
+}
+
+void finder_close(Finder *finder) {
+    finder->open = false;
+    finder->dirty = true;
+    finder_clear_results(finder);
+    finder->candidates_valid = false;
+}
+
+void finder_insert_text(Finder *finder, const char *text) {
+    size_t length = strlen(text);
+    if(finder->query_length + length > FINDER_QUERY_CAPACITY)
+        return;
+    memcpy(finder->query + finder->query_length, text, length);
+    finder->query_length += length;
+    finder->selected = 0;
+    finder->dirty = true;
+    finder_search(finder);
+}
+
+void finder_delete_char(Finder *finder) {
+    if(!finder->query_length)
+        return;
+    // Back to the first byte of the last UTF-8 sequence
+    do {
+        --finder->query_length;
+    } while(finder->query_length && (finder->query[finder->query_length] & 0xC0) == 0x80);
+    finder->selected = 0;
+    finder->dirty = true;
+    finder_search(finder);
+}
+
+void finder_move_selection(Finder *finder, int delta) {
+    if(!finder->results_count)
+        return;
+    if(delta < 0 && (size_t) -delta > finder->selected)
+        finder->selected = 0;
+    else
+        finder->selected = minul(finder->selected + delta, finder->results_count - 1);
+    finder->dirty = true;
+}
+
+char *finder_selected_path(Finder *finder) {
+    if(finder->selected >= finder->results_count)
+        return NULL;
+    return file_index_full_path(&finder->index, finder->results[finder->selected].path);
+}
+
+bool finder_handle_event(Finder *finder, SDL_Event *event) {
+    if(!finder->index_started || !file_index_handle_event(&finder->index, event))
+        return false;
+    if(finder->open) {
+        finder_search(finder);
+        finder->dirty = true;
+    }
+    return true;
+}
+
+void finder_render(Finder *finder, Font *font, Renderer *renderer) {
+    if(!finder->open)
+        return;
+
+    char status[64];
+    snprintf(status, sizeof(status), "%s%zu files",
+        file_index_scanning(&finder->index) ? "indexing... " : "", finder->indexed_count);
+
+    float line_height = font_line_height(font);
+    float width = renderer->resolution.x * FINDER_WIDTH_RATIO;
+    if(width < FINDER_MIN_WIDTH)
+        width = FINDER_MIN_WIDTH < renderer->resolution.x ? FINDER_MIN_WIDTH : renderer->resolution.x;
+    float height = (2 + finder->results_count) * line_height + 3 * FINDER_PADDING;
+    Vec2f origin = vec2f((renderer->resolution.x - width) / 2.0f, 0.0f);
+
+    // The panel is drawn in screen space
+    Vec2f scroll_pos = renderer->scroll_pos;
+    renderer->scroll_pos = vec2f(0.0f, 0.0f);
+
+    renderer_set_shader(renderer, SHADER_SOLID);
+    renderer_solid_rect(renderer, origin, vec2f(width, height), FINDER_BACKGROUND_COLOR);
+    if(finder->results_count) {
+        float y = 2 * FINDER_PADDING + (2 + finder->selected) * line_height;
+        renderer_solid_rect(renderer, vec2f(origin.x, y), vec2f(width, line_height), FINDER_SELECTION_COLOR);
+    }
+    renderer_flush(renderer);
+
+    char query[FINDER_QUERY_CAPACITY + 2] = "> ";
+    memcpy(query + 2, finder->query, finder->query_length);
+    float x = origin.x + FINDER_PADDING;
+    font_render_line(font, renderer, query, finder->query_length + 2,
+        vec2f(x, FINDER_PADDING + line_height), FINDER_TEXT_COLOR);
+    font_render_line(font, renderer, status, strlen(status),
+        vec2f(x, FINDER_PADDING + 2 * line_height), FINDER_STATUS_COLOR);
+    for(size_t i = 0; i < finder->results_count; ++i)
+        font_render_line(
+            font, renderer, finder->results[i].path, finder->results[i].length,
+            vec2f(x, 2 * FINDER_PADDING + (i + 3) * line_height),
+            FINDER_TEXT_COLOR
+        );
+
+    renderer->scroll_pos = scroll_pos;
+}
+
+void finder_destroy(Finder *finder) {
+    finder_clear_results(finder);
+    free(finder->candidates);
+    if(finder->index_started)
+        file_index_stop(&finder->index);
+}
@@ -0,0 +1,78 @@
+#ifndef FINDER_H_
+#define FINDER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <SDL2/SDL.h>
+
+#include "./file_index.h"
+#include "./font.h"
+#include "./renderer.h"
+
+// Quick open panel (Ctrl+P). The working directory is indexed the first
+// time the panel opens, every keystroke ranks the whole index. When the
+// query only grew, just the paths that matched the shorter one are looked
+// at again.
+
+#define FINDER_QUERY_CAPACITY 256
+#define FINDER_MAX_RESULTS 16
+
+typedef struct {
+    int32_t score;
+    char *path;
+    size_t length;
+} FinderResult;
+
+typedef struct {
+    bool open;
+    // The panel changed since it was last drawn
+    bool dirty;
+
+    char query[FINDER_QUERY_CAPACITY];
+    size_t query_length;
+
+    bool index_started;
+    FileIndex index;
+
+    // Entries that matched the last ranked query of the same index version
+    char ranked_query[FINDER_QUERY_CAPACITY];
+    size_t ranked_query_length;
+    uint64_t ranked_version;
+    uint32_t *candidates;
+    size_t candidates_count;
+    size_t candidates_capacity;
+    bool candidates_valid;
+    size_t indexed_count;
+
+    FinderResult results[FINDER_MAX_RESULTS];
+    size_t results_count;
+    size_t selected;
+} Finder;
+
+void finder_init(Finder *finder);
+
+void finder_toggle(Finder *finder);
+
+void finder_close(Finder *finder);
+
+void finder_insert_text(Finder *finder, const char *text);
+
+void finder_delete_char(Finder *finder);
+
+void finder_move_selection(Finder *finder, int delta);
+
+// Absolute path of the selected result, NULL if there is none. Has to be
+// freed.
+char *finder_selected_path(Finder *finder);
+
+// Returns whether event was for the finder
+bool finder_handle_event(Finder *finder, SDL_Event *event);
+
+// Draws the panel in screen space over the current frame
+void finder_render(Finder *finder, Font *font, Renderer *renderer);
+
+void finder_destroy(Finder *finder);
+
+#endif // FINDER_H_
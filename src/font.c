@@ -1,9 +1,430 @@
 #include "./font.h"
+#include "./font_cache.h"
+#include "./font_raster.h"
+#include "./profiler.h"
+#include "./utils.h"
 
-#define FONT_RANGE_LO 32 // inclusive
-#define FONT_RANGE_HI 128 // exclusive
+#include FT_ADVANCES_H
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Glyphs rasterized up front so the first frame is complete
+#define FONT_PRELOAD_LO 32 // inclusive
+#define FONT_PRELOAD_HI 127 // exclusive
+
+#define FONT_GLYPHS_INITIAL_CAPACITY 256
+// Empty texels around every glyph so linear filtering does not bleed. They
+// are uploaded with the glyph, reused pages still hold old texels.
+#define FONT_GLYPH_PADDING 1
+// Shelf heights are rounded up to this so similar glyphs share shelves
+#define FONT_SHELF_ROUNDING 8
+
+/* Glyph table */
+
+static size_t font_glyph_bucket(FontGlyph *glyphs, size_t capacity, FT_UInt glyph_index) {
+    size_t mask = capacity - 1;
+    size_t i = ((size_t) glyph_index * 2654435761u) & mask;
+    while(glyphs[i].key && glyphs[i].key != glyph_index + 1)
+        i = (i + 1) & mask;
+    return i;
+}
+
+static void font_glyphs_rehash(FontAtlas *atlas, size_t capacity, uint32_t dropped_page) {
+    FontGlyph *old = atlas->glyphs;
+    size_t old_capacity = atlas->glyphs_capacity;
+
+    atlas->glyphs = (FontGlyph *) calloc(capacity, sizeof(FontGlyph));
+    atlas->glyphs_capacity = capacity;
+    atlas->glyphs_count = 0;
+
+    for(size_t i = 0; i < old_capacity; ++i) {
+        if(!old[i].key || (old[i].metric.page == dropped_page && dropped_page != FONT_NO_PAGE))
+            continue;
+        size_t bucket = font_glyph_bucket(atlas->glyphs, capacity, old[i].key - 1);
+        atlas->glyphs[bucket] = old[i];
+        ++atlas->glyphs_count;
+    }
+    free(old);
+}
+
+static void font_glyphs_insert(FontAtlas *atlas, FT_UInt glyph_index, GlyphMetric metric) {
+    if((atlas->glyphs_count + 1) * 2 > atlas->glyphs_capacity)
+        font_glyphs_rehash(atlas, atlas->glyphs_capacity * 2, FONT_NO_PAGE);
+
+    size_t bucket = font_glyph_bucket(atlas->glyphs, atlas->glyphs_capacity, glyph_index);
+    atlas->glyphs[bucket] = (FontGlyph) {
+        .key = glyph_index + 1,
+        .metric = metric
+    };
+    ++atlas->glyphs_count;
+}
+
+static FontGlyph *font_glyphs_find(FontAtlas *atlas, FT_UInt glyph_index) {
+    size_t bucket = font_glyph_bucket(atlas->glyphs, atlas->glyphs_capacity, glyph_index);
+    return atlas->glyphs[bucket].key ? &atlas->glyphs[bucket] : NULL;
+}
+
+/* Atlas pages */
+
+static bool font_page_place(FontAtlasPage *page, int width, int height, int *x, int *y) {
+    width += 2 * FONT_GLYPH_PADDING;
+    height += 2 * FONT_GLYPH_PADDING;
+
+    // Lowest shelf the glyph fits on
+    FontShelf *best = NULL;
+    for(size_t i = 0; i < page->shelves_count; ++i) {
+        FontShelf *shelf = &page->shelves[i];
+        if(shelf->height >= height && FONT_ATLAS_PAGE_SIZE - shelf->x >= width &&
+            (!best || shelf->height < best->height))
+            best = shelf;
+    }
+
+    if(!best) {
+        int shelf_height = (height + FONT_SHELF_ROUNDING - 1) / FONT_SHELF_ROUNDING * FONT_SHELF_ROUNDING;
+        if(page->shelves_count == FONT_ATLAS_MAX_SHELVES ||
+            page->shelves_bottom + shelf_height > FONT_ATLAS_PAGE_SIZE ||
+            width > FONT_ATLAS_PAGE_SIZE)
+            return false;
+
+        best = &page->shelves[page->shelves_count++];
+        *best = (FontShelf) {
+            .y = page->shelves_bottom,
+            .height = shelf_height,
+            .x = 0
+        };
+        page->shelves_bottom += shelf_height;
+    }
+
+    *x = best->x;
+    *y = best->y;
+    best->x += width;
+    return true;
+}
+
+static void font_evict_page(Font *font, uint32_t page) {
+    FontAtlas *atlas = &font->atlas;
+    font_glyphs_rehash(atlas, atlas->glyphs_capacity, page);
+    atlas->pages[page] = (FontAtlasPage) {0};
+    ++atlas->generation;
+}
+
+static bool font_allocate(Font *font, int width, int height, uint32_t *page, int *x, int *y) {
+    FontAtlas *atlas = &font->atlas;
+
+    for(uint32_t i = 0; i < atlas->pages_count; ++i)
+        if(font_page_place(&atlas->pages[i], width, height, x, y))
+            return *page = i, true;
+
+    if(atlas->pages_count < FONT_ATLAS_MAX_PAGES) {
+        *page = atlas->pages_count++;
+        atlas->pages[*page] = (FontAtlasPage) {0};
+        return font_page_place(&atlas->pages[*page], width, height, x, y);
+    }
+
+    // All pages are full, evict the least recently used one unless it is
+    // still needed by the frame being drawn
+    uint32_t victim = FONT_NO_PAGE;
+    for(uint32_t i = 0; i < atlas->pages_count; ++i) {
+        if(atlas->pages[i].last_used_frame == font->frame)
+            continue;
+        if(victim == FONT_NO_PAGE || atlas->pages[i].last_used_frame < atlas->pages[victim].last_used_frame)
+            victim = i;
+    }
+    if(victim == FONT_NO_PAGE)
+        return false;
+
+    font_evict_page(font, victim);
+    *page = victim;
+    return font_page_place(&atlas->pages[victim], width, height, x, y);
+}
+
+/* Glyphs */
+
+static FT_UInt font_glyph_index(Font *font, uint32_t codepoint) {
+    if(codepoint < FONT_PRELOAD_LO || codepoint == 127)
+        codepoint = '?';
+    if(codepoint < 128)
+        return font->ascii_glyphs[codepoint];
+    return FT_Get_Char_Index(font->face, codepoint);
+}
+
+// Packs a rasterized glyph into the atlas and uploads its bitmap
+static bool font_place_glyph(Font *font, const RasterGlyph *glyph, GlyphMetric *metric) {
+    *metric = (GlyphMetric) { .page = FONT_NO_PAGE };
+
+    if(!glyph->ok) {
+        // Remember the failure, retrying every frame would not help
+        fprintf(stderr, "Error: Could not render glyph with index %u\n", glyph->glyph_index);
+        font_glyphs_insert(&font->atlas, glyph->glyph_index, *metric);
+        return true;
+    }
+
+    metric->advance_x = glyph->advance_x;
+    metric->advance_y = glyph->advance_y;
+    metric->bitmap_width = glyph->width;
+    metric->bitmap_height = glyph->rows;
+    metric->bitmap_left = glyph->bitmap_left;
+    metric->bitmap_top = glyph->bitmap_top;
+
+    if(glyph->width && glyph->rows) {
+        int x, y;
+        if(!font_allocate(font, glyph->width, glyph->rows, &metric->page, &x, &y))
+            return false;
+
+        metric->texture_x = x + FONT_GLYPH_PADDING;
+        metric->texture_y = y + FONT_GLYPH_PADDING;
+
+        size_t padded_width = glyph->width + 2 * FONT_GLYPH_PADDING;
+        size_t padded_rows = glyph->rows + 2 * FONT_GLYPH_PADDING;
+        unsigned char *padded = (unsigned char *) calloc(padded_width * padded_rows, 1);
+        for(size_t row = 0; row < glyph->rows; ++row)
+            memcpy(
+                padded + (row + FONT_GLYPH_PADDING) * padded_width + FONT_GLYPH_PADDING,
+                glyph->bitmap + row * glyph->width,
+                glyph->width
+            );
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, font->atlas.texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage3D(
+            GL_TEXTURE_2D_ARRAY,
+            0,
+            x, y, metric->page,
+            padded_width, padded_rows, 1,
+            GL_RED,
+            GL_UNSIGNED_BYTE,
+            padded
+        );
+        free(padded);
+    }
+
+    font_glyphs_insert(&font->atlas, glyph->glyph_index, *metric);
+    return true;
+}
+
+static bool font_rasterize_glyph(Font *font, FT_UInt glyph_index, GlyphMetric *metric) {
+    RasterGlyph glyph;
+    font_raster_glyph(font->face, glyph_index, &glyph);
+    bool placed = font_place_glyph(font, &glyph, metric);
+    font_raster_free(&glyph);
+    return placed;
+}
+
+// Fills glyphs with the distinct glyph indices of the preload range
+static size_t font_preload_glyphs(Font *font, RasterGlyph *glyphs) {
+    size_t count = 0;
+    for(uint32_t c = FONT_PRELOAD_LO; c < FONT_PRELOAD_HI; ++c) {
+        FT_UInt glyph_index = font->ascii_glyphs[c];
+        bool seen = false;
+        for(size_t i = 0; i < count && !seen; ++i)
+            seen = glyphs[i].glyph_index == glyph_index;
+        if(!seen)
+            glyphs[count++] = (RasterGlyph) { .glyph_index = glyph_index };
+    }
+    return count;
+}
+
+// Fills glyphs with the preload range followed by the other glyphs in the
+// atlas, so a rebuild keeps everything that is on screen
+static size_t font_resident_glyphs(Font *font, RasterGlyph *glyphs, size_t *preloaded) {
+    FontAtlas *atlas = &font->atlas;
+    size_t count = *preloaded = font_preload_glyphs(font, glyphs);
+    for(size_t i = 0; i < atlas->glyphs_capacity; ++i) {
+        if(!atlas->glyphs[i].key)
+            continue;
+        FT_UInt glyph_index = atlas->glyphs[i].key - 1;
+        bool seen = false;
+        for(size_t k = 0; k < *preloaded && !seen; ++k)
+            seen = glyphs[k].glyph_index == glyph_index;
+        if(!seen)
+            glyphs[count++] = (RasterGlyph) { .glyph_index = glyph_index };
+    }
+    return count;
+}
+
+// Uploads rasterized glyphs and frees their bitmaps. The pages they land on
+// count as used, so placing more glyphs never evicts them. The first
+// required glyphs have to fit, the others are left to be rasterized on
+// demand once the atlas is full.
+static bool font_place_glyphs(Font *font, RasterGlyph *glyphs, size_t count, size_t required) {
+    bool fits = true, ok = true;
+    for(size_t i = 0; i < count; ++i) {
+        GlyphMetric metric;
+        if(fits && !font_place_glyph(font, &glyphs[i], &metric)) {
+            fits = false;
+            if(i < required) {
+                fprintf(stderr, "Error: Could not fit the glyph with index %u\n", glyphs[i].glyph_index);
+                ok = false;
+            }
+        }
+        else if(fits && metric.page != FONT_NO_PAGE) {
+            font->atlas.pages[metric.page].last_used_frame = font->frame;
+        }
+        font_raster_free(&glyphs[i]);
+    }
+    return ok;
+}
+
+// Rasterizes the glyphs of the preload range, on worker threads if there
+// are enough of them, and uploads them from this thread
+static bool font_preload(Font *font) {
+    RasterGlyph glyphs[FONT_PRELOAD_HI - FONT_PRELOAD_LO];
+    size_t count = font_preload_glyphs(font, glyphs);
+
+    if(!font_raster_parallel(&font->raster_pool, font->pixel_size, glyphs, count))
+        for(size_t i = 0; i < count; ++i)
+            font_raster_glyph(font->face, glyphs[i].glyph_index, &glyphs[i]);
+
+    return font_place_glyphs(font, glyphs, count, count);
+}
+
+static void font_update_scale(Font *font) {
+    font->scale = font->zoom * FONT_PIXEL_SIZE / font->pixel_size;
+    ++font->atlas.generation;
+}
+
+// Starts rasterizing the atlas at a size closer to the zoom if the current
+// one is scaled too far
+static void font_maybe_rebuild(Font *font) {
+    if(font->rebuilding ||
+        (font->scale >= FONT_SCALE_GOOD_MIN && font->scale <= FONT_SCALE_GOOD_MAX))
+        return;
+
+    float target = roundf(FONT_PIXEL_SIZE * font->zoom);
+    unsigned int size = (unsigned int) fminf(fmaxf(target, FONT_RASTER_SIZE_MIN), FONT_RASTER_SIZE_MAX);
+    if(size == font->pixel_size)
+        return;
+
+    font->rebuild_glyphs = (RasterGlyph *) malloc(
+        (FONT_PRELOAD_HI - FONT_PRELOAD_LO + font->atlas.glyphs_count) * sizeof(RasterGlyph)
+    );
+    size_t count = font_resident_glyphs(font, font->rebuild_glyphs, &font->rebuild_preloaded);
+    font->rebuilding = font_raster_async_start(
+        &font->raster_pool, &font->rebuild, size, font->rebuild_glyphs, count
+    );
+    if(!font->rebuilding) {
+        free(font->rebuild_glyphs);
+        font->rebuild_glyphs = NULL;
+    }
+}
+
+// Replaces the atlas with the one rasterized in the background
+static void font_finish_rebuild(Font *font) {
+    font->rebuilding = false;
+    RasterJob *job = &font->rebuild;
+
+    font_raster_async_finish(&font->raster_pool, job);
+    if(FT_Set_Pixel_Sizes(font->face, 0, job->pixel_size)) {
+        fprintf(stderr, "Error: Could not set font size %u\n", job->pixel_size);
+        for(size_t i = 0; i < job->count; ++i)
+            font_raster_free(&job->glyphs[i]);
+    }
+    else {
+        FontAtlas *atlas = &font->atlas;
+        memset(atlas->glyphs, 0, atlas->glyphs_capacity * sizeof(FontGlyph));
+        atlas->glyphs_count = 0;
+        memset(atlas->pages, 0, sizeof(atlas->pages));
+        atlas->pages_count = 0;
+
+        font->pixel_size = job->pixel_size;
+        font->line_height = font->face->size->metrics.height / 64;
+#ifdef TE_HARFBUZZ
+        font_shaper_face_changed(&font->shaper);
+#endif
+        font_place_glyphs(font, job->glyphs, job->count, font->rebuild_preloaded);
+        font_update_scale(font);
+    }
+
+    free(font->rebuild_glyphs);
+    font->rebuild_glyphs = NULL;
+
+    // The zoom may have moved on while rasterizing
+    font_maybe_rebuild(font);
+}
+
+static void font_use_page(Font *font, uint32_t page) {
+    if(page == FONT_NO_PAGE)
+        return;
+    font->atlas.pages[page].last_used_frame = font->frame;
+    font->emitted_pages |= 1u << page;
+}
+
+// Looks a glyph up, rasterizing it if the frame budget allows
+static bool font_get_glyph(Font *font, FT_UInt glyph_index, GlyphMetric *metric) {
+    FontGlyph *glyph = font_glyphs_find(&font->atlas, glyph_index);
+    if(glyph) {
+        *metric = glyph->metric;
+    }
+    else {
+        if(font->rasterized_this_frame >= FONT_GLYPH_BUDGET_PER_FRAME ||
+            !font_rasterize_glyph(font, glyph_index, metric)) {
+            ++font->skipped_this_frame;
+            return false;
+        }
+        ++font->rasterized_this_frame;
+    }
+
+    font_use_page(font, metric->page);
+    return true;
+}
+
+static float font_glyph_advance(Font *font, FT_UInt glyph_index) {
+    FontGlyph *glyph = font_glyphs_find(&font->atlas, glyph_index);
+    if(glyph)
+        return glyph->metric.advance_x;
+
+    // Not rasterized yet, ask for the advance alone
+    FT_Fixed advance = 0;
+    FT_Get_Advance(font->face, glyph_index, FT_LOAD_DEFAULT, &advance);
+    return advance >> 16;
+}
+
+static void font_queue_glyph(Font *font, FT_UInt glyph_index) {
+    if(font->rasterized_this_frame + font->prefetch_count >= FONT_GLYPH_BUDGET_PER_FRAME ||
+        font_glyphs_find(&font->atlas, glyph_index))
+        return;
+    for(size_t i = 0; i < font->prefetch_count; ++i)
+        if(font->prefetch[i].glyph_index == glyph_index)
+            return;
+    font->prefetch[font->prefetch_count++] = (RasterGlyph) { .glyph_index = glyph_index };
+}
+
+void font_prefetch(Font *font, const char *text, size_t text_length) {
+#ifdef TE_HARFBUZZ
+    const ShapedRun *run = font_shaper_shape(&font->shaper, text, text_length, font->pixel_size);
+    for(size_t i = 0; i < run->count; ++i)
+        font_queue_glyph(font, run->glyphs[i].glyph_index);
+#else
+    for(size_t i = 0; i < text_length;) {
+        uint32_t codepoint;
+        i += utils_utf8_decode(text + i, text_length - i, &codepoint);
+        font_queue_glyph(font, font_glyph_index(font, codepoint));
+    }
+#endif
+}
+
+void font_rasterize_prefetched(Font *font) {
+    size_t count = font->prefetch_count;
+    if(!count)
+        return;
+    font->prefetch_count = 0;
+
+    if(!font_raster_parallel(&font->raster_pool, font->pixel_size, font->prefetch, count))
+        for(size_t i = 0; i < count; ++i)
+            font_raster_glyph(font->face, font->prefetch[i].glyph_index, &font->prefetch[i]);
+    font_place_glyphs(font, font->prefetch, count, 0);
+    font->rasterized_this_frame += count;
+}
 
 bool font_init(Font *font, const char *filepath) {
+    *font = (Font) {0};
+    font->pixel_size = FONT_PIXEL_SIZE;
+    font->zoom = 1.0f;
+    font->scale = 1.0f;
+
     // Initialize the Freetype library
     if(FT_Init_FreeType(&font->library)) {
         fprintf(stderr, "Error: Could not initialize FreeType\n");
@@ -21,97 +442,210 @@ bool font_init(Font *font, const char *filepath) {
         goto fail_lib;
     }
 
-    // Initialize atlas
-    font->atlas = (FontAtlas) {0};
-    font->atlas.count = FONT_RANGE_HI;
-    font->atlas.metrics = (GlyphMetric *) calloc(font->atlas.count, sizeof(GlyphMetric));
-
-    FT_Int32 load_flags = FT_LOAD_RENDER | FT_LOAD_TARGET_(FT_RENDER_MODE_SDF);
-    for(int i = FONT_RANGE_LO; i < FONT_RANGE_HI; ++i) {
-        if(FT_Load_Char(font->face, i, load_flags)) {
-            fprintf(stderr, "Error: Could not load glyph of the character with code %d\n", i);
-            goto fail_glyphs;
-        }
-        if(FT_Render_Glyph(font->face->glyph, FT_RENDER_MODE_SDF)) {
-            fprintf(stderr, "Error: Could not render glyph of the character with code %d\n", i);
-            goto fail_glyphs;
-        }
-
-        font->atlas.width += font->face->glyph->bitmap.width;
-        if(font->atlas.height < font->face->glyph->bitmap.rows) {
-            font->atlas.height = font->face->glyph->bitmap.rows;
-        }
+    if(FT_Set_Pixel_Sizes(font->face, 0, font->pixel_size)) {
+        fprintf(stderr, "Error: Could not set font size %u\n", font->pixel_size);
+        goto fail_face;
     }
+    font->filepath = strdup(filepath);
+    font_raster_pool_init(&font->raster_pool, font->filepath, font->face->face_index);
+    font->line_height = font->face->size->metrics.height / 64;
+
+    for(uint32_t c = 0; c < 128; ++c)
+        font->ascii_glyphs[c] = FT_Get_Char_Index(font->face, c);
+
+    // Initialize atlas
+    font->atlas.glyphs_capacity = FONT_GLYPHS_INITIAL_CAPACITY;
+    font->atlas.glyphs = (FontGlyph *) calloc(font->atlas.glyphs_capacity, sizeof(FontGlyph));
 
     glActiveTexture(GL_TEXTURE0);
     glGenTextures(1, &font->atlas.texture);
-    glBindTexture(GL_TEXTURE_2D, font->atlas.texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, font->atlas.texture);
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    
-    glTexImage2D(
-        GL_TEXTURE_2D,
+    glTexImage3D(
+        GL_TEXTURE_2D_ARRAY,
         0,
-        GL_RED,
-        font->atlas.width,
-        font->atlas.height,
+        GL_R8,
+        FONT_ATLAS_PAGE_SIZE,
+        FONT_ATLAS_PAGE_SIZE,
+        FONT_ATLAS_MAX_PAGES,
         0,
         GL_RED,
         GL_UNSIGNED_BYTE,
         NULL
     );
 
-    // Render all ASCII glyphs into a single GL texture
-    int x = 0;
-    for(int i = FONT_RANGE_LO; i < FONT_RANGE_HI; ++i) {
-        if(FT_Load_Char(font->face, i, load_flags)) {
-            fprintf(stderr, "Error: Could not load glyph of the character with code %d\n", i);
-            goto fail_glyphs;
-        }
-
-        if(FT_Render_Glyph(font->face->glyph, FT_RENDER_MODE_SDF)) {
-            fprintf(stderr, "Error: Could not render glyph of the character with code %d\n", i);
+    // A warm cache holds the preloaded glyphs already
+    FontCacheKey cache_key;
+    bool cacheable = font_cache_key(font, filepath, &cache_key);
+    if(!cacheable || !font_cache_load(font, &cache_key)) {
+        // Rasterize the printable ASCII range up front
+        if(!font_preload(font))
             goto fail_glyphs;
-        }
-
-        font->atlas.metrics[i].advance_x = font->face->glyph->advance.x / 64;
-        font->atlas.metrics[i].advance_y = font->face->glyph->advance.y / 64;
-        font->atlas.metrics[i].bitmap_width = font->face->glyph->bitmap.width;
-        font->atlas.metrics[i].bitmap_height = font->face->glyph->bitmap.rows;
-        font->atlas.metrics[i].bitmap_left = font->face->glyph->bitmap_left;
-        font->atlas.metrics[i].bitmap_top = font->face->glyph->bitmap_top;
-        font->atlas.metrics[i].texture_x = (float) x / (float) font->atlas.width;
-
-        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-        glTexSubImage2D(
-            GL_TEXTURE_2D,
-            0,
-            x,
-            0,
-            font->face->glyph->bitmap.width,
-            font->face->glyph->bitmap.rows,
-            GL_RED,
-            GL_UNSIGNED_BYTE,
-            font->face->glyph->bitmap.buffer
-        );
-        x += font->face->glyph->bitmap.width;
+        if(cacheable)
+            font_cache_save(font, &cache_key);
     }
 
+#ifdef TE_HARFBUZZ
+    if(!font_shaper_init(&font->shaper, font->face))
+        goto fail_glyphs;
+#endif
     return true;
 
 fail_glyphs:
-    free(font->atlas.metrics);
+    font_raster_pool_destroy(&font->raster_pool);
+    free(font->atlas.glyphs);
+    free(font->filepath);
+    glDeleteTextures(1, &font->atlas.texture);
+fail_face:
     FT_Done_Face(font->face);
 fail_lib:
     FT_Done_FreeType(font->library);
     return false;
 }
 
+void font_begin_frame(Font *font) {
+    if(font_rebuild_ready(font))
+        font_finish_rebuild(font);
+
+    ++font->frame;
+    font->rasterized_this_frame = 0;
+    font->skipped_this_frame = 0;
+}
+
+bool font_frame_incomplete(Font *font) {
+    return font->skipped_this_frame > 0;
+}
+
+bool font_rebuild_ready(Font *font) {
+    return font->rebuilding && font_raster_async_done(&font->raster_pool, &font->rebuild);
+}
+
+void font_touch_pages(Font *font, uint32_t pages) {
+    for(uint32_t page = 0; page < font->atlas.pages_count; ++page)
+        if(pages & (1u << page))
+            font->atlas.pages[page].last_used_frame = font->frame;
+}
+
+void font_set_zoom(Font *font, float zoom) {
+    zoom = fminf(fmaxf(zoom, FONT_ZOOM_MIN), FONT_ZOOM_MAX);
+    if(zoom == font->zoom)
+        return;
+
+    font->zoom = zoom;
+    font_update_scale(font);
+    font_maybe_rebuild(font);
+}
+
+float font_zoom(Font *font) {
+    return font->zoom;
+}
+
+float font_line_height(Font *font) {
+    return font->line_height * font->scale;
+}
+
+float font_advance(Font *font, uint32_t codepoint) {
+    return font_glyph_advance(font, font_glyph_index(font, codepoint)) * font->scale;
+}
+
+// Appends the quad of a glyph whose pen position is pen
+static FontQuad font_metric_quad(Font *font, const GlyphMetric *metric) {
+    return (FontQuad) {
+        .offset = vec2f(metric->bitmap_left * font->scale, -metric->bitmap_top * font->scale),
+        .size = vec2f(metric->bitmap_width * font->scale, metric->bitmap_height * font->scale),
+        .uv = vec2f(
+            metric->texture_x / (float) FONT_ATLAS_PAGE_SIZE,
+            metric->texture_y / (float) FONT_ATLAS_PAGE_SIZE
+        ),
+        .uv_size = vec2f(
+            metric->bitmap_width / (float) FONT_ATLAS_PAGE_SIZE,
+            metric->bitmap_height / (float) FONT_ATLAS_PAGE_SIZE
+        ),
+        .page = metric->page,
+        .advance = metric->advance_x * font->scale
+    };
+}
+
+bool font_glyph_quad(Font *font, uint32_t codepoint, FontQuad *quad) {
+    GlyphMetric metric;
+    if(!font_get_glyph(font, font_glyph_index(font, codepoint), &metric))
+        return false;
+    *quad = font_metric_quad(font, &metric);
+    return true;
+}
+
+void font_emit_quad(Renderer *renderer, const FontQuad *quad, Vec2f pen, Vec4f color) {
+    if(quad->page == FONT_NO_PAGE)
+        return;
+
+    renderer_textured_rect(
+        renderer,
+        vec2f(pen.x + quad->offset.x, pen.y + quad->offset.y),
+        quad->size, quad->uv, quad->uv_size,
+        quad->page,
+        color
+    );
+}
+
+static void font_emit_glyph(Font *font, Renderer *renderer, Vec2f pen, const GlyphMetric *metric, Vec4f color) {
+    FontQuad quad = font_metric_quad(font, metric);
+    font_emit_quad(renderer, &quad, pen, color);
+}
+
+void font_emit_line(
+    Font *font,
+    Renderer *renderer,
+    const char *text,
+    size_t text_length,
+    Vec2f pos,
+    Vec4f color
+) {
+    profiler_section_begin(PROFILE_FONT_RENDER_LINE);
+#ifdef TE_HARFBUZZ
+    const ShapedRun *run = font_shaper_shape(&font->shaper, text, text_length, font->pixel_size);
+    for(size_t i = 0; i < run->count; ++i) {
+        const ShapedGlyph *shaped = &run->glyphs[i];
+
+        // Over the rasterization budget glyphs are drawn later, the layout
+        // stays the same
+        GlyphMetric metric;
+        if(font_get_glyph(font, shaped->glyph_index, &metric))
+            font_emit_glyph(
+                font, renderer,
+                vec2f(pos.x + shaped->x_offset * font->scale, pos.y - shaped->y_offset * font->scale),
+                &metric, color
+            );
+
+        // HarfBuzz advances point up, screen space points down
+        pos.x += shaped->x_advance * font->scale;
+        pos.y -= shaped->y_advance * font->scale;
+    }
+#else
+    for(size_t i = 0; i < text_length;) {
+        uint32_t codepoint;
+        i += utils_utf8_decode(text + i, text_length - i, &codepoint);
+        FT_UInt glyph_index = font_glyph_index(font, codepoint);
+
+        // Over the rasterization budget, keep the layout and draw it later
+        GlyphMetric metric;
+        if(!font_get_glyph(font, glyph_index, &metric)) {
+            pos.x += font_glyph_advance(font, glyph_index) * font->scale;
+            continue;
+        }
+
+        font_emit_glyph(font, renderer, pos, &metric, color);
+        pos.x += metric.advance_x * font->scale;
+        pos.y += metric.advance_y * font->scale;
+    }
+#endif
+    profiler_section_end(PROFILE_FONT_RENDER_LINE);
+}
+
 void font_render_line(
     Font *font,
     Renderer *renderer,
@@ -121,33 +655,43 @@ void font_render_line(
     Vec4f color
 ) {
     renderer_set_shader(renderer, SHADER_TEXT);
-    for(size_t i = 0; i < text_length; ++i) {
-        size_t glyph = text[i];
-        if(glyph < FONT_RANGE_LO || glyph >= FONT_RANGE_HI)
-            glyph = '?';
-        GlyphMetric metric = font->atlas.metrics[glyph];
-
-        float x = pos.x + metric.bitmap_left;
-        float y = pos.y - metric.bitmap_top;
-        
-        pos.x += metric.advance_x;
-        pos.y += metric.advance_y;
-
-        renderer_textured_rect(
-            renderer,
-            vec2f(x, y),
-            vec2f(metric.bitmap_width, metric.bitmap_height),
-            vec2f(metric.texture_x, 0),
-            vec2f(
-                metric.bitmap_width / (float) font->atlas.width,
-                metric.bitmap_height / (float) font->atlas.height
-            ),
-            color
-        );
-    }
+    font_emit_line(font, renderer, text, text_length, pos, color);
     renderer_flush(renderer);
 }
 
+void font_line_advances(
+    Font *font,
+    const char *text,
+    size_t text_length,
+    float *x
+) {
+    float pen = 0.0f;
+#ifdef TE_HARFBUZZ
+    const ShapedRun *run = font_shaper_shape(&font->shaper, text, text_length, font->pixel_size);
+    for(size_t i = 0; i < text_length; ++i)
+        x[i] = -1.0f;
+    for(size_t i = 0; i < run->count; ++i) {
+        uint32_t cluster = run->glyphs[i].cluster;
+        if(cluster < text_length && x[cluster] < 0.0f)
+            x[cluster] = pen;
+        pen += run->glyphs[i].x_advance * font->scale;
+    }
+    for(size_t i = 0; i < text_length; ++i)
+        if(x[i] < 0.0f)
+            x[i] = i ? x[i - 1] : 0.0f;
+#else
+    for(size_t i = 0; i < text_length;) {
+        uint32_t codepoint;
+        size_t length = utils_utf8_decode(text + i, text_length - i, &codepoint);
+        for(size_t j = 0; j < length; ++j)
+            x[i + j] = pen;
+        pen += font_glyph_advance(font, font_glyph_index(font, codepoint)) * font->scale;
+        i += length;
+    }
+#endif
+    x[text_length] = pen;
+}
+
 float font_calculate_width(
     Font *font,
     char *text,
@@ -155,22 +699,31 @@ float font_calculate_width(
 ) {
     float width = 0.0f;
     
-    for(size_t i = 0; i < text_length; ++i) {
-        size_t glyph = text[i];
-        if(glyph < FONT_RANGE_LO || glyph >= FONT_RANGE_HI)
-            glyph = '?';
-        GlyphMetric metric = font->atlas.metrics[glyph];
-
-        width += metric.advance_x;
+    for(size_t i = 0; i < text_length;) {
+        uint32_t codepoint;
+        i += utils_utf8_decode(text + i, text_length - i, &codepoint);
+        width += font_glyph_advance(font, font_glyph_index(font, codepoint));
     }
-    return width;
+    return width * font->scale;
 }
 
 void font_destroy(Font *font) {
     if(!font)
         return;
-    
-    free(font->atlas.metrics);
+
+    if(font->rebuilding) {
+        font_raster_async_finish(&font->raster_pool, &font->rebuild);
+        for(size_t i = 0; i < font->rebuild.count; ++i)
+            font_raster_free(&font->rebuild.glyphs[i]);
+    }
+    font_raster_pool_destroy(&font->raster_pool);
+    free(font->rebuild_glyphs);
+    free(font->filepath);
+#ifdef TE_HARFBUZZ
+    font_shaper_destroy(&font->shaper);
+#endif
+    free(font->atlas.glyphs);
+    glDeleteTextures(1, &font->atlas.texture);
     FT_Done_Face(font->face);
     FT_Done_FreeType(font->library);
 }
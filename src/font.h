@@ -2,6 +2,7 @@
 #define FONT_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #define GLEW_STATIC
 #include <GL/glew.h>
@@ -12,36 +13,182 @@
 
 #include "./vec.h"
 #include "./renderer.h"
+#include "./font_raster.h"
+#ifdef TE_HARFBUZZ
+#include "./font_shaper.h"
+#endif
+
+#define FONT_PIXEL_SIZE 32
+
+// Zoom scales the SDF quads. Once the scale relative to the size the atlas
+// was rasterized at leaves the good range, the atlas is rebuilt at a closer
+// size in the background.
+#define FONT_ZOOM_MIN 0.25f
+#define FONT_ZOOM_MAX 8.0f
+#define FONT_SCALE_GOOD_MIN 0.5f
+#define FONT_SCALE_GOOD_MAX 2.0f
+#define FONT_RASTER_SIZE_MIN 8
+#define FONT_RASTER_SIZE_MAX 128
+
+// Glyphs are rasterized on demand into the layers of a texture array
+#define FONT_ATLAS_PAGE_SIZE 1024
+#define FONT_ATLAS_MAX_PAGES 4
+#define FONT_ATLAS_MAX_SHELVES 64
+
+// At most this many glyphs are rasterized per frame, the rest are drawn on
+// the following frames
+#define FONT_GLYPH_BUDGET_PER_FRAME 64
 
 typedef struct {
     float advance_x;
     float advance_y;
-    
+
     float bitmap_width;
     float bitmap_height;
-    
+
     float bitmap_left;
     float bitmap_top;
 
+    // Texel position inside its atlas page
     float texture_x;
+    float texture_y;
+    uint32_t page;
 } GlyphMetric;
 
+// GlyphMetric.page of glyphs without a bitmap (e.g. space)
+#define FONT_NO_PAGE UINT32_MAX
+
+typedef struct {
+    FT_UInt key; // glyph index + 1, 0 marks an empty bucket
+    GlyphMetric metric;
+} FontGlyph;
+
+typedef struct {
+    int y;
+    int height;
+    int x; // first free column
+} FontShelf;
+
+typedef struct {
+    FontShelf shelves[FONT_ATLAS_MAX_SHELVES];
+    size_t shelves_count;
+    int shelves_bottom;
+    uint64_t last_used_frame;
+} FontAtlasPage;
+
 typedef struct {
-    FT_UInt width;
-    FT_UInt height;
     GLuint texture;
-    size_t count;
-    GlyphMetric *metrics;
+    FontAtlasPage pages[FONT_ATLAS_MAX_PAGES];
+    size_t pages_count;
+
+    // Open addressing table of rasterized glyphs keyed by glyph index
+    FontGlyph *glyphs;
+    size_t glyphs_capacity;
+    size_t glyphs_count;
+
+    // Bumped whenever a page is evicted or the scale changes, geometry built
+    // before is stale
+    uint64_t generation;
 } FontAtlas;
 
 typedef struct {
+    char *filepath;
     FT_Library library;
     FT_Face face;
     FontAtlas atlas;
+    // Empty if no worker could start, glyphs are then rasterized on this
+    // thread and the atlas is never rebuilt at another size
+    RasterPool raster_pool;
+
+    // Size the atlas is rasterized at
+    unsigned int pixel_size;
+    // Zoom relative to FONT_PIXEL_SIZE and the resulting scale of the atlas
+    float zoom;
+    float scale;
+
+    // Atlas being rasterized at another size in the background, the
+    // preloaded glyphs come first and the rest of the resident ones after
+    bool rebuilding;
+    RasterJob rebuild;
+    RasterGlyph *rebuild_glyphs;
+    size_t rebuild_preloaded;
+
+#ifdef TE_HARFBUZZ
+    FontShaper shaper;
+#endif
+
+    // Unscaled, at pixel_size
+    float line_height;
+    FT_UInt ascii_glyphs[128];
+
+    // Glyphs missing from the atlas that are rasterized together before
+    // the frame is drawn
+    RasterGlyph prefetch[FONT_GLYPH_BUDGET_PER_FRAME];
+    size_t prefetch_count;
+
+    uint64_t frame;
+    size_t rasterized_this_frame;
+    // Glyphs that could not be rasterized this frame
+    size_t skipped_this_frame;
+    // Bit mask of the pages used by the glyphs emitted since the last reset
+    uint32_t emitted_pages;
 } Font;
 
 bool font_init(Font *font, const char *filepath);
 
+// Resets the per-frame rasterization budget and swaps in a rebuilt atlas
+void font_begin_frame(Font *font);
+
+void font_set_zoom(Font *font, float zoom);
+
+float font_zoom(Font *font);
+
+// Queues the glyphs of text that are not in the atlas yet, within the
+// per-frame budget
+void font_prefetch(Font *font, const char *text, size_t text_length);
+
+// Rasterizes the queued glyphs on worker threads and uploads them
+void font_rasterize_prefetched(Font *font);
+
+// Whether glyphs were skipped this frame and another frame is needed
+bool font_frame_incomplete(Font *font);
+
+// Whether an atlas rasterized in the background waits for the next frame
+bool font_rebuild_ready(Font *font);
+
+// Marks atlas pages as in use, for geometry that is drawn from a cache
+void font_touch_pages(Font *font, uint32_t pages);
+
+float font_line_height(Font *font);
+
+float font_advance(Font *font, uint32_t codepoint);
+
+// Glyph quad at the current scale, relative to the pen on the baseline
+typedef struct {
+    Vec2f offset;
+    Vec2f size;
+    Vec2f uv;
+    Vec2f uv_size;
+    uint32_t page;
+    float advance;
+} FontQuad;
+
+// Fills the quad of a character, false if it could not be rasterized this
+// frame. The quad stays valid until the atlas generation changes.
+bool font_glyph_quad(Font *font, uint32_t codepoint, FontQuad *quad);
+
+void font_emit_quad(Renderer *renderer, const FontQuad *quad, Vec2f pen, Vec4f color);
+
+// Appends the glyph quads of a line to the renderer without flushing
+void font_emit_line(
+    Font *font,
+    Renderer *renderer,
+    const char *text,
+    size_t text_length,
+    Vec2f pos,
+    Vec4f color
+);
+
 void font_render_line(
     Font *font,
     Renderer *renderer,
@@ -51,6 +198,16 @@ void font_render_line(
     Vec4f color
 );
 
+// Fills x[0..text_length] with the pen position before every byte of text,
+// x[text_length] is the width of the whole text. Bytes inside a character
+// (or a shaped cluster) share the position of its first byte.
+void font_line_advances(
+    Font *font,
+    const char *text,
+    size_t text_length,
+    float *x
+);
+
 float font_calculate_width(
     Font *font,
     char *text,
@@ -59,4 +216,4 @@ float font_calculate_width(
 
 void font_destroy(Font *font);
 
-#endif // FONT_H_
\ No newline at end of file
+#endif // FONT_H_
@@ -0,0 +1,267 @@
+#define _DEFAULT_SOURCE
+#include "./font_cache.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define FONT_CACHE_MAGIC "TEATLAS"
+// Bump whenever the layout of the file or of the dumped structs changes
+#define FONT_CACHE_FORMAT_VERSION 2
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+
+typedef struct {
+    char magic[8];
+    uint32_t format_version;
+    uint32_t page_size;
+    uint32_t glyph_size;
+    uint32_t page_struct_size;
+    FontCacheKey key;
+    uint32_t pages_count;
+    uint32_t glyphs_capacity;
+    uint32_t glyphs_count;
+    uint32_t padding;
+} FontCacheHeader;
+
+// The file is laid out as the header, FontAtlasPage[pages_count],
+// FontGlyph[glyphs_capacity] (the hash table as is) and the texels of
+// every page down to its lowest shelf
+
+static uint64_t font_cache_hash(const unsigned char *data, size_t length) {
+    uint64_t h = FNV_OFFSET_BASIS;
+    for(size_t i = 0; i < length; ++i) {
+        h ^= data[i];
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+static bool font_cache_key_equal(const FontCacheKey *a, const FontCacheKey *b) {
+    return a->font_hash == b->font_hash &&
+        a->face_index == b->face_index &&
+        a->pixel_size == b->pixel_size &&
+        a->freetype_version == b->freetype_version;
+}
+
+static bool font_cache_dir(char *dir, size_t dir_size) {
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    int n;
+    if(xdg && *xdg)
+        n = snprintf(dir, dir_size, "%s/" FONT_CACHE_DIR, xdg);
+    else if(home && *home)
+        n = snprintf(dir, dir_size, "%s/.cache/" FONT_CACHE_DIR, home);
+    else
+        return false;
+    return n > 0 && (size_t) n < dir_size;
+}
+
+static bool font_cache_path(const FontCacheKey *key, char *path, size_t path_size) {
+    char dir[PATH_MAX];
+    if(!font_cache_dir(dir, sizeof(dir)))
+        return false;
+    int n = snprintf(path, path_size, "%s/atlas-%016llx-%u-%u.bin", dir,
+        (unsigned long long) key->font_hash, key->face_index, key->pixel_size);
+    return n > 0 && (size_t) n < path_size;
+}
+
+// mkdir -p, the cache home itself may not exist yet
+static bool font_cache_make_dirs(char *dir) {
+    for(char *p = dir + 1; ; ++p) {
+        if(*p != '/' && *p != '\0')
+            continue;
+        char c = *p;
+        *p = '\0';
+        bool ok = mkdir(dir, 0755) == 0 || errno == EEXIST;
+        *p = c;
+        if(!ok || c == '\0')
+            return ok;
+    }
+}
+
+bool font_cache_key(Font *font, const char *font_path, FontCacheKey *key) {
+    int fd = open(font_path, O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    struct stat st;
+    if(fstat(fd, &st) < 0 || st.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED)
+        return false;
+
+    FT_Int major, minor, patch;
+    FT_Library_Version(font->library, &major, &minor, &patch);
+
+    *key = (FontCacheKey) {
+        .font_hash = font_cache_hash((const unsigned char *) data, st.st_size),
+        .face_index = (uint32_t) font->face->face_index,
+        .pixel_size = font->pixel_size,
+        .freetype_version = (uint32_t) (major << 16 | minor << 8 | patch)
+    };
+    munmap(data, st.st_size);
+    return true;
+}
+
+bool font_cache_load(Font *font, const FontCacheKey *key) {
+    char path[PATH_MAX];
+    if(!font_cache_path(key, path, sizeof(path)))
+        return false;
+
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    struct stat st;
+    if(fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(FontCacheHeader)) {
+        close(fd);
+        return false;
+    }
+
+    size_t size = st.st_size;
+    const unsigned char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED)
+        return false;
+
+    const FontCacheHeader *header = (const FontCacheHeader *) data;
+    if(memcmp(header->magic, FONT_CACHE_MAGIC, sizeof(FONT_CACHE_MAGIC)) ||
+        header->format_version != FONT_CACHE_FORMAT_VERSION ||
+        header->page_size != FONT_ATLAS_PAGE_SIZE ||
+        header->glyph_size != sizeof(FontGlyph) ||
+        header->page_struct_size != sizeof(FontAtlasPage) ||
+        !font_cache_key_equal(&header->key, key) ||
+        header->pages_count > FONT_ATLAS_MAX_PAGES ||
+        !header->glyphs_capacity ||
+        (header->glyphs_capacity & (header->glyphs_capacity - 1)) ||
+        header->glyphs_count * 2 > header->glyphs_capacity)
+        goto miss;
+
+    const FontAtlasPage *pages = (const FontAtlasPage *) (data + sizeof(*header));
+    const FontGlyph *glyphs = (const FontGlyph *) (pages + header->pages_count);
+    const unsigned char *texels = (const unsigned char *) (glyphs + header->glyphs_capacity);
+
+    size_t expected = texels - data;
+    if(expected > size)
+        goto miss;
+    for(uint32_t i = 0; i < header->pages_count; ++i) {
+        if(pages[i].shelves_bottom < 0 || pages[i].shelves_bottom > FONT_ATLAS_PAGE_SIZE ||
+            pages[i].shelves_count > FONT_ATLAS_MAX_SHELVES)
+            goto miss;
+        expected += (size_t) pages[i].shelves_bottom * FONT_ATLAS_PAGE_SIZE;
+    }
+    if(expected != size)
+        goto miss;
+
+    FontAtlas *atlas = &font->atlas;
+    FontGlyph *table = (FontGlyph *) malloc(header->glyphs_capacity * sizeof(FontGlyph));
+    memcpy(table, glyphs, header->glyphs_capacity * sizeof(FontGlyph));
+    free(atlas->glyphs);
+    atlas->glyphs = table;
+    atlas->glyphs_capacity = header->glyphs_capacity;
+    atlas->glyphs_count = header->glyphs_count;
+
+    atlas->pages_count = header->pages_count;
+    glBindTexture(GL_TEXTURE_2D_ARRAY, atlas->texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for(uint32_t i = 0; i < header->pages_count; ++i) {
+        atlas->pages[i] = pages[i];
+        atlas->pages[i].last_used_frame = 0;
+        if(!pages[i].shelves_bottom)
+            continue;
+
+        glTexSubImage3D(
+            GL_TEXTURE_2D_ARRAY,
+            0,
+            0, 0, i,
+            FONT_ATLAS_PAGE_SIZE, pages[i].shelves_bottom, 1,
+            GL_RED,
+            GL_UNSIGNED_BYTE,
+            texels
+        );
+        texels += (size_t) pages[i].shelves_bottom * FONT_ATLAS_PAGE_SIZE;
+    }
+
+    munmap((void *) data, size);
+    return true;
+
+miss:
+    munmap((void *) data, size);
+    return false;
+}
+
+bool font_cache_save(Font *font, const FontCacheKey *key) {
+    // Room for the path, a dot and any pid
+    char dir[PATH_MAX], path[PATH_MAX], temp_path[PATH_MAX + 1 + 20];
+    if(!font_cache_dir(dir, sizeof(dir)) || !font_cache_path(key, path, sizeof(path)))
+        return false;
+    snprintf(temp_path, sizeof(temp_path), "%s.%ld", path, (long) getpid());
+
+    if(!font_cache_make_dirs(dir)) {
+        fprintf(stderr, "Error: Could not create cache directory %s\n", dir);
+        return false;
+    }
+
+    FontAtlas *atlas = &font->atlas;
+    size_t texture_size = (size_t) FONT_ATLAS_PAGE_SIZE * FONT_ATLAS_PAGE_SIZE * FONT_ATLAS_MAX_PAGES;
+    unsigned char *texels = (unsigned char *) malloc(texture_size);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, atlas->texture);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glGetTexImage(GL_TEXTURE_2D_ARRAY, 0, GL_RED, GL_UNSIGNED_BYTE, texels);
+
+    FILE *fp = fopen(temp_path, "wb");
+    if(!fp) {
+        fprintf(stderr, "Error: Failed to open file %s for writing\n", temp_path);
+        perror("fopen");
+        goto fail_texels;
+    }
+
+    FontCacheHeader header = {
+        .magic = FONT_CACHE_MAGIC,
+        .format_version = FONT_CACHE_FORMAT_VERSION,
+        .page_size = FONT_ATLAS_PAGE_SIZE,
+        .glyph_size = sizeof(FontGlyph),
+        .page_struct_size = sizeof(FontAtlasPage),
+        .key = *key,
+        .pages_count = atlas->pages_count,
+        .glyphs_capacity = atlas->glyphs_capacity,
+        .glyphs_count = atlas->glyphs_count
+    };
+
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+        fwrite(atlas->pages, sizeof(FontAtlasPage), atlas->pages_count, fp) == atlas->pages_count &&
+        fwrite(atlas->glyphs, sizeof(FontGlyph), atlas->glyphs_capacity, fp) == atlas->glyphs_capacity;
+    for(size_t i = 0; ok && i < atlas->pages_count; ++i) {
+        size_t page_size = (size_t) atlas->pages[i].shelves_bottom * FONT_ATLAS_PAGE_SIZE;
+        ok = fwrite(texels + i * FONT_ATLAS_PAGE_SIZE * FONT_ATLAS_PAGE_SIZE, 1, page_size, fp) == page_size;
+    }
+    ok = (fclose(fp) == 0) && ok;
+
+    // Readers only ever see a complete file
+    if(!ok || rename(temp_path, path) < 0) {
+        fprintf(stderr, "Error: Could not write font cache %s\n", path);
+        remove(temp_path);
+        goto fail_texels;
+    }
+
+    free(texels);
+    return true;
+
+fail_texels:
+    free(texels);
+    return false;
+}
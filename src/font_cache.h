@@ -0,0 +1,28 @@
+#ifndef FONT_CACHE_H_
+#define FONT_CACHE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "./font.h"
+
+// Snapshot of the glyph atlas stored under $XDG_CACHE_HOME/te, so a warm
+// start uploads the preloaded glyphs without rasterizing anything
+
+#define FONT_CACHE_DIR "te"
+
+typedef struct {
+    uint64_t font_hash; // of the font file contents
+    uint32_t face_index;
+    uint32_t pixel_size;
+    uint32_t freetype_version;
+} FontCacheKey;
+
+bool font_cache_key(Font *font, const char *font_path, FontCacheKey *key);
+
+// Fills the atlas from the cache file, returns false on a miss
+bool font_cache_load(Font *font, const FontCacheKey *key);
+
+bool font_cache_save(Font *font, const FontCacheKey *key);
+
+#endif // FONT_CACHE_H_
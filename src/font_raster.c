@@ -0,0 +1,227 @@
+#include "./font_raster.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+bool font_raster_glyph(FT_Face face, FT_UInt glyph_index, RasterGlyph *glyph) {
+    FT_GlyphSlot slot = face->glyph;
+    *glyph = (RasterGlyph) { .glyph_index = glyph_index };
+
+    if(FT_Load_Glyph(face, glyph_index, FT_LOAD_DEFAULT) ||
+        FT_Render_Glyph(slot, FT_RENDER_MODE_SDF))
+        return false;
+
+    glyph->advance_x = slot->advance.x / 64;
+    glyph->advance_y = slot->advance.y / 64;
+    glyph->bitmap_left = slot->bitmap_left;
+    glyph->bitmap_top = slot->bitmap_top;
+    glyph->width = slot->bitmap.width;
+    glyph->rows = slot->bitmap.rows;
+
+    if(glyph->width && glyph->rows) {
+        glyph->bitmap = (unsigned char *) malloc((size_t) glyph->width * glyph->rows);
+        for(unsigned int y = 0; y < glyph->rows; ++y)
+            memcpy(
+                glyph->bitmap + (size_t) y * glyph->width,
+                slot->bitmap.buffer + (ptrdiff_t) y * slot->bitmap.pitch,
+                glyph->width
+            );
+    }
+
+    glyph->ok = true;
+    return true;
+}
+
+static int font_raster_worker(void *data) {
+    RasterPool *pool = (RasterPool *) data;
+
+    FT_Library library;
+    FT_Face face;
+    bool opened = false;
+    if(!FT_Init_FreeType(&library)) {
+        opened = !FT_New_Face(library, pool->filepath, pool->face_index, &face);
+        if(!opened)
+            FT_Done_FreeType(library);
+    }
+
+    SDL_LockMutex(pool->lock);
+    ++pool->started;
+    if(opened)
+        ++pool->ready;
+    SDL_CondBroadcast(pool->finished);
+    if(!opened) {
+        SDL_UnlockMutex(pool->lock);
+        return 1;
+    }
+
+    FT_UInt pixel_size = 0;
+    for(;;) {
+        while(!pool->quit && !pool->queue_head)
+            SDL_CondWait(pool->work, pool->lock);
+        if(pool->quit)
+            break;
+
+        // Glyphs are handed out one at a time, their cost varies a lot
+        RasterJob *job = pool->queue_head;
+        size_t i = job->next++;
+        if(job->next == job->count) {
+            pool->queue_head = job->queue_next;
+            if(!pool->queue_head)
+                pool->queue_tail = NULL;
+        }
+        SDL_UnlockMutex(pool->lock);
+
+        if(job->pixel_size != pixel_size)
+            pixel_size = FT_Set_Pixel_Sizes(face, 0, job->pixel_size) ? 0 : job->pixel_size;
+        if(pixel_size)
+            font_raster_glyph(face, job->glyphs[i].glyph_index, &job->glyphs[i]);
+
+        // The job may be gone once it is finished
+        SDL_LockMutex(pool->lock);
+        if(++job->done == job->count)
+            SDL_CondBroadcast(pool->finished);
+    }
+    SDL_UnlockMutex(pool->lock);
+
+    FT_Done_Face(face);
+    FT_Done_FreeType(library);
+    return 0;
+}
+
+bool font_raster_pool_init(RasterPool *pool, const char *filepath, FT_Long face_index) {
+    *pool = (RasterPool) {
+        .filepath = filepath,
+        .face_index = face_index
+    };
+    pool->lock = SDL_CreateMutex();
+    pool->work = SDL_CreateCond();
+    pool->finished = SDL_CreateCond();
+    if(!pool->lock || !pool->work || !pool->finished) {
+        fprintf(stderr, "Error: Could not set up glyph rasterization: %s\n", SDL_GetError());
+        goto fail;
+    }
+
+    int cpus = SDL_GetCPUCount();
+    size_t workers = cpus > 1 ? (size_t) cpus : 1;
+    if(workers > FONT_RASTER_MAX_WORKERS)
+        workers = FONT_RASTER_MAX_WORKERS;
+    for(size_t i = 0; i < workers; ++i) {
+        pool->threads[pool->threads_count] = SDL_CreateThread(font_raster_worker, "glyph raster", pool);
+        if(pool->threads[pool->threads_count])
+            ++pool->threads_count;
+    }
+
+    SDL_LockMutex(pool->lock);
+    while(pool->started < pool->threads_count)
+        SDL_CondWait(pool->finished, pool->lock);
+    SDL_UnlockMutex(pool->lock);
+    if(!pool->ready) {
+        fprintf(stderr, "Error: Could not start glyph rasterization workers\n");
+        goto fail;
+    }
+    return true;
+
+fail:
+    font_raster_pool_destroy(pool);
+    *pool = (RasterPool) {0};
+    return false;
+}
+
+void font_raster_pool_destroy(RasterPool *pool) {
+    if(pool->lock) {
+        SDL_LockMutex(pool->lock);
+        pool->quit = true;
+        SDL_CondBroadcast(pool->work);
+        SDL_UnlockMutex(pool->lock);
+    }
+    for(size_t i = 0; i < pool->threads_count; ++i)
+        SDL_WaitThread(pool->threads[i], NULL);
+
+    if(pool->finished)
+        SDL_DestroyCond(pool->finished);
+    if(pool->work)
+        SDL_DestroyCond(pool->work);
+    if(pool->lock)
+        SDL_DestroyMutex(pool->lock);
+}
+
+static void font_raster_submit(
+    RasterPool *pool,
+    RasterJob *job,
+    FT_UInt pixel_size,
+    RasterGlyph *glyphs,
+    size_t count,
+    bool urgent
+) {
+    *job = (RasterJob) {
+        .pixel_size = pixel_size,
+        .glyphs = glyphs,
+        .count = count
+    };
+    if(!count)
+        return;
+
+    SDL_LockMutex(pool->lock);
+    if(!pool->queue_head) {
+        pool->queue_head = pool->queue_tail = job;
+    }
+    else if(urgent) {
+        job->queue_next = pool->queue_head;
+        pool->queue_head = job;
+    }
+    else {
+        pool->queue_tail->queue_next = job;
+        pool->queue_tail = job;
+    }
+    SDL_CondBroadcast(pool->work);
+    SDL_UnlockMutex(pool->lock);
+}
+
+static void font_raster_wait(RasterPool *pool, RasterJob *job) {
+    SDL_LockMutex(pool->lock);
+    while(job->done < job->count)
+        SDL_CondWait(pool->finished, pool->lock);
+    SDL_UnlockMutex(pool->lock);
+}
+
+bool font_raster_parallel(RasterPool *pool, FT_UInt pixel_size, RasterGlyph *glyphs, size_t count) {
+    // A lone worker is no faster than the caller
+    if(pool->ready < 2 || count < FONT_RASTER_MIN_PARALLEL_GLYPHS)
+        return false;
+
+    RasterJob job;
+    font_raster_submit(pool, &job, pixel_size, glyphs, count, true);
+    font_raster_wait(pool, &job);
+    return true;
+}
+
+bool font_raster_async_start(
+    RasterPool *pool,
+    RasterJob *job,
+    FT_UInt pixel_size,
+    RasterGlyph *glyphs,
+    size_t count
+) {
+    if(!pool->ready)
+        return false;
+    font_raster_submit(pool, job, pixel_size, glyphs, count, false);
+    return true;
+}
+
+bool font_raster_async_done(RasterPool *pool, RasterJob *job) {
+    SDL_LockMutex(pool->lock);
+    bool done = job->done == job->count;
+    SDL_UnlockMutex(pool->lock);
+    return done;
+}
+
+void font_raster_async_finish(RasterPool *pool, RasterJob *job) {
+    font_raster_wait(pool, job);
+}
+
+void font_raster_free(RasterGlyph *glyph) {
+    free(glyph->bitmap);
+    glyph->bitmap = NULL;
+}
@@ -0,0 +1,102 @@
+#ifndef FONT_RASTER_H_
+#define FONT_RASTER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <SDL2/SDL.h>
+
+// Glyph rasterization that does not touch GL, so it can run on worker
+// threads. Every worker keeps its own FT_Face open, faces are not
+// thread-safe.
+
+// Smaller batches are rendered on the calling thread, handing them to the
+// workers costs more than it saves
+#define FONT_RASTER_MIN_PARALLEL_GLYPHS 8
+#define FONT_RASTER_MAX_WORKERS 16
+
+typedef struct {
+    FT_UInt glyph_index;
+    bool ok;
+
+    float advance_x;
+    float advance_y;
+    int bitmap_left;
+    int bitmap_top;
+    unsigned int width;
+    unsigned int rows;
+    unsigned char *bitmap; // tightly packed, width * rows bytes
+} RasterGlyph;
+
+typedef struct RasterJob {
+    FT_UInt pixel_size;
+    RasterGlyph *glyphs;
+    size_t count;
+
+    // Under the pool lock. Next glyph to be taken by a worker and glyphs
+    // finished so far.
+    size_t next;
+    size_t done;
+    struct RasterJob *queue_next;
+} RasterJob;
+
+// Workers that live as long as the font. Each opens the face once and only
+// sets its size again when a job asks for another one. Jobs are queued and
+// their glyphs handed out one at a time.
+typedef struct {
+    SDL_mutex *lock;
+    // Signaled when a job is queued or the workers have to quit
+    SDL_cond *work;
+    // Broadcast when a job is finished or a worker has started
+    SDL_cond *finished;
+    RasterJob *queue_head;
+    RasterJob *queue_tail;
+    bool quit;
+
+    // Only read while the workers start
+    const char *filepath;
+    FT_Long face_index;
+    size_t started;
+    // Workers that could open the face
+    size_t ready;
+
+    SDL_Thread *threads[FONT_RASTER_MAX_WORKERS];
+    size_t threads_count;
+} RasterPool;
+
+// Renders one glyph with face into a newly allocated bitmap
+bool font_raster_glyph(FT_Face face, FT_UInt glyph_index, RasterGlyph *glyph);
+
+// Starts a worker per CPU. Returns false if none could open the face, the
+// pool then takes no jobs.
+bool font_raster_pool_init(RasterPool *pool, const char *filepath, FT_Long face_index);
+
+// Waits for the workers, no job may be running
+void font_raster_pool_destroy(RasterPool *pool);
+
+// Renders the glyphs on the pool, ahead of any queued job.
+// glyphs[i].glyph_index must be set. Returns false if the batch is not
+// worth it, the caller should then rasterize on its own.
+bool font_raster_parallel(RasterPool *pool, FT_UInt pixel_size, RasterGlyph *glyphs, size_t count);
+
+// Renders the glyphs in the background. job must stay alive until
+// font_raster_async_finish. glyphs[i].glyph_index must be set.
+bool font_raster_async_start(
+    RasterPool *pool,
+    RasterJob *job,
+    FT_UInt pixel_size,
+    RasterGlyph *glyphs,
+    size_t count
+);
+
+bool font_raster_async_done(RasterPool *pool, RasterJob *job);
+
+// Waits for the glyphs, those that failed are not ok
+void font_raster_async_finish(RasterPool *pool, RasterJob *job);
+
+void font_raster_free(RasterGlyph *glyph);
+
+#endif // FONT_RASTER_H_
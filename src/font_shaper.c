@@ -0,0 +1,107 @@
+#include "./font_shaper.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <harfbuzz/hb-ft.h>
+
+#include "./profiler.h"
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+
+static uint64_t font_shaper_hash(const char *text, size_t text_length) {
+    uint64_t h = FNV_OFFSET_BASIS;
+    for(size_t i = 0; i < text_length; ++i) {
+        h ^= (unsigned char) text[i];
+        h *= FNV_PRIME;
+    }
+    // Lengths keep prefixes of a line from colliding cheaply
+    return h ^ ((uint64_t) text_length * FNV_PRIME);
+}
+
+bool font_shaper_init(FontShaper *shaper, FT_Face face) {
+    *shaper = (FontShaper) {0};
+
+    shaper->hb_font = hb_ft_font_create_referenced(face);
+    if(!shaper->hb_font) {
+        fprintf(stderr, "Error: Could not create a HarfBuzz font\n");
+        return false;
+    }
+
+    shaper->buffer = hb_buffer_create();
+    if(!hb_buffer_allocation_successful(shaper->buffer)) {
+        fprintf(stderr, "Error: Could not create a HarfBuzz buffer\n");
+        goto fail_font;
+    }
+
+    line_cache_init(&shaper->cache, SHAPE_CACHE_SLOTS);
+    return true;
+
+fail_font:
+    hb_buffer_destroy(shaper->buffer);
+    hb_font_destroy(shaper->hb_font);
+    return false;
+}
+
+void font_shaper_face_changed(FontShaper *shaper) {
+    hb_ft_font_changed(shaper->hb_font);
+}
+
+static void font_shaper_fill(FontShaper *shaper, ShapedRun *run, const char *text, size_t text_length) {
+    hb_buffer_clear_contents(shaper->buffer);
+    hb_buffer_add_utf8(shaper->buffer, text, (int) text_length, 0, (int) text_length);
+    hb_buffer_guess_segment_properties(shaper->buffer);
+    hb_shape(shaper->hb_font, shaper->buffer, NULL, 0);
+
+    unsigned int count;
+    hb_glyph_info_t *infos = hb_buffer_get_glyph_infos(shaper->buffer, &count);
+    hb_glyph_position_t *positions = hb_buffer_get_glyph_positions(shaper->buffer, &count);
+
+    if(count > run->capacity) {
+        run->capacity = count;
+        run->glyphs = (ShapedGlyph *) realloc(run->glyphs, run->capacity * sizeof(ShapedGlyph));
+    }
+    run->count = count;
+    run->text_length = text_length;
+
+    // Positions come in 26.6 fixed point
+    for(unsigned int i = 0; i < count; ++i)
+        run->glyphs[i] = (ShapedGlyph) {
+            .glyph_index = infos[i].codepoint,
+            .x_advance = positions[i].x_advance / 64.0f,
+            .y_advance = positions[i].y_advance / 64.0f,
+            .x_offset = positions[i].x_offset / 64.0f,
+            .y_offset = positions[i].y_offset / 64.0f,
+            .cluster = infos[i].cluster
+        };
+}
+
+const ShapedRun *font_shaper_shape(
+    FontShaper *shaper,
+    const char *text,
+    size_t text_length,
+    unsigned int pixel_size
+) {
+    size_t slot;
+    uint64_t key = font_shaper_hash(text, text_length);
+    // A hash collision would have to match the length as well
+    bool hit = line_cache_get(&shaper->cache, key, pixel_size, &slot) &&
+        shaper->runs[slot].text_length == text_length;
+    profiler_count_shape(hit);
+    if(hit)
+        return &shaper->runs[slot];
+
+    profiler_section_begin(PROFILE_SHAPE);
+    font_shaper_fill(shaper, &shaper->runs[slot], text, text_length);
+    profiler_section_end(PROFILE_SHAPE);
+    return &shaper->runs[slot];
+}
+
+void font_shaper_destroy(FontShaper *shaper) {
+    for(size_t i = 0; i < SHAPE_CACHE_SLOTS; ++i)
+        free(shaper->runs[i].glyphs);
+    line_cache_destroy(&shaper->cache);
+    hb_buffer_destroy(shaper->buffer);
+    hb_font_destroy(shaper->hb_font);
+}
@@ -0,0 +1,63 @@
+#ifndef FONT_SHAPER_H_
+#define FONT_SHAPER_H_
+
+// Optional HarfBuzz shaping, only built with make HARFBUZZ=1 (TE_HARFBUZZ).
+// Shaped runs are cached per line content, so only edited lines are ever
+// reshaped.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <harfbuzz/hb.h>
+
+#include "./line_cache.h"
+
+#define SHAPE_CACHE_SLOTS 1024
+
+typedef struct {
+    FT_UInt glyph_index;
+    // Unscaled pixels at the size the run was shaped at
+    float x_advance;
+    float y_advance;
+    float x_offset;
+    float y_offset;
+    // Byte offset of the first character the glyph belongs to
+    uint32_t cluster;
+} ShapedGlyph;
+
+typedef struct {
+    ShapedGlyph *glyphs;
+    size_t count;
+    size_t capacity;
+    size_t text_length;
+} ShapedRun;
+
+typedef struct {
+    hb_font_t *hb_font;
+    hb_buffer_t *buffer;
+
+    // Keyed by a hash of the line contents, versioned by the face size
+    LineCache cache;
+    ShapedRun runs[SHAPE_CACHE_SLOTS];
+} FontShaper;
+
+bool font_shaper_init(FontShaper *shaper, FT_Face face);
+
+// Must be called after the size of the face changes
+void font_shaper_face_changed(FontShaper *shaper);
+
+// Returns the shaped run of text. It stays valid until the next call.
+const ShapedRun *font_shaper_shape(
+    FontShaper *shaper,
+    const char *text,
+    size_t text_length,
+    unsigned int pixel_size
+);
+
+void font_shaper_destroy(FontShaper *shaper);
+
+#endif // FONT_SHAPER_H_
@@ -0,0 +1,89 @@
+#include "./fuzzy.h"
+
+#include <stdbool.h>
+
+#define FUZZY_SCORE_MATCH 16
+#define FUZZY_BONUS_BOUNDARY 8
+#define FUZZY_BONUS_SEPARATOR 10
+#define FUZZY_BONUS_CAMEL 7
+#define FUZZY_BONUS_CONSECUTIVE 4
+#define FUZZY_BONUS_NAME 12
+#define FUZZY_PENALTY_GAP_START 3
+#define FUZZY_PENALTY_GAP 1
+
+static inline char fuzzy_lower(char c) {
+    return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+static inline uint64_t fuzzy_char_bit(char c) {
+    c = fuzzy_lower(c);
+    if(c >= 'a' && c <= 'z')
+        return 1ull << (c - 'a');
+    if(c >= '0' && c <= '9')
+        return 1ull << (26 + c - '0');
+    return 1ull << (36 + (unsigned char) c % 28);
+}
+
+uint64_t fuzzy_char_mask(const char *text, size_t length) {
+    uint64_t mask = 0;
+    for(size_t i = 0; i < length; ++i)
+        mask |= fuzzy_char_bit(text[i]);
+    return mask;
+}
+
+static inline bool fuzzy_is_separator(char c) {
+    return c == '/' || c == '_' || c == '-' || c == '.' || c == ' ';
+}
+
+static int32_t fuzzy_bonus(const char *text, size_t i) {
+    if(!i || text[i - 1] == '/')
+        return FUZZY_BONUS_SEPARATOR;
+    if(fuzzy_is_separator(text[i - 1]))
+        return FUZZY_BONUS_BOUNDARY;
+    if(text[i - 1] >= 'a' && text[i - 1] <= 'z' && text[i] >= 'A' && text[i] <= 'Z')
+        return FUZZY_BONUS_CAMEL;
+    return 0;
+}
+
+int32_t fuzzy_score(const char *query, size_t query_length, const char *text, size_t length) {
+    if(!query_length)
+        return 0;
+
+    // The first place the whole query fits ends at end...
+    size_t q = 0, end = 0;
+    for(size_t i = 0; i < length; ++i)
+        if(fuzzy_lower(text[i]) == query[q] && ++q == query_length) {
+            end = i + 1;
+            break;
+        }
+    if(q < query_length)
+        return FUZZY_NO_MATCH;
+
+    // ...and the tightest occurrence within it starts at start
+    size_t start = end;
+    for(q = query_length; q > 0; )
+        if(fuzzy_lower(text[--start]) == query[q - 1])
+            --q;
+
+    size_t name = length;
+    while(name > 0 && text[name - 1] != '/')
+        --name;
+
+    int32_t score = 0;
+    size_t last = start;
+    q = 0;
+    for(size_t i = start; i < end && q < query_length; ++i) {
+        if(fuzzy_lower(text[i]) != query[q])
+            continue;
+        score += FUZZY_SCORE_MATCH + fuzzy_bonus(text, i);
+        if(i >= name)
+            score += FUZZY_BONUS_NAME;
+        if(q && i == last + 1)
+            score += FUZZY_BONUS_CONSECUTIVE;
+        else if(q)
+            score -= FUZZY_PENALTY_GAP_START + FUZZY_PENALTY_GAP * (int32_t) (i - last - 2);
+        last = i;
+        ++q;
+    }
+    return score;
+}
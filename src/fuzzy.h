@@ -0,0 +1,20 @@
+#ifndef FUZZY_H_
+#define FUZZY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Fuzzy matching of a query against paths. A path can only match if its
+// character mask covers the mask of the query, which rules out most paths
+// with one AND per path before any scoring.
+
+#define FUZZY_NO_MATCH INT32_MIN
+
+// Set of the (case folded) characters in text
+uint64_t fuzzy_char_mask(const char *text, size_t length);
+
+// Score of the best occurrence of the characters of query in order, higher
+// is better. query has to be lower case.
+int32_t fuzzy_score(const char *query, size_t query_length, const char *text, size_t length);
+
+#endif // FUZZY_H_
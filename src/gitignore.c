@@ -0,0 +1,127 @@
+#define _DEFAULT_SOURCE
+#include "./gitignore.h"
+
+#include <fnmatch.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GITIGNORE_NAME ".gitignore"
+
+// Parses one line, returns false for blank lines and comments
+static bool ignore_pattern_parse(char *line, size_t length, IgnorePattern *pattern) {
+    while(length && (line[length - 1] == ' ' || line[length - 1] == '\r'))
+        --length;
+    if(!length || line[0] == '#')
+        return false;
+
+    *pattern = (IgnorePattern) {0};
+    if(line[0] == '!') {
+        pattern->negate = true;
+        ++line;
+        --length;
+    }
+    else if(line[0] == '\\') {
+        ++line;
+        --length;
+    }
+    if(length && line[length - 1] == '/') {
+        pattern->dir_only = true;
+        --length;
+    }
+
+    // "**/name" matches name at any depth, "dir/**" everything below dir,
+    // which is the same as dir itself since ignored directories are skipped
+    if(length > 3 && !strncmp(line, "**/", 3)) {
+        line += 3;
+        length -= 3;
+    }
+    if(length > 3 && !strncmp(line + length - 3, "/**", 3))
+        length -= 3;
+    if(length && line[0] == '/') {
+        pattern->anchored = true;
+        ++line;
+        --length;
+    }
+    if(!length)
+        return false;
+
+    if(memchr(line, '/', length))
+        pattern->anchored = true;
+    pattern->glob = (char *) malloc(length + 1);
+    memcpy(pattern->glob, line, length);
+    pattern->glob[length] = 0;
+    return true;
+}
+
+const IgnoreRules *ignore_rules_load(
+    IgnoreRules **list, const IgnoreRules *parent, const char *root, const char *dir
+) {
+    size_t size = strlen(root) + strlen(dir) + sizeof(GITIGNORE_NAME) + 2;
+    char *path = (char *) malloc(size);
+    snprintf(path, size, *dir ? "%s/%s/" GITIGNORE_NAME : "%s%s/" GITIGNORE_NAME, root, dir);
+
+    FILE *fp = fopen(path, "r");
+    free(path);
+    if(!fp)
+        return parent;
+
+    IgnoreRules *rules = (IgnoreRules *) calloc(1, sizeof(*rules));
+    rules->parent = parent;
+    rules->base = strdup(dir);
+
+    size_t capacity = 0;
+    char line[1024];
+    while(fgets(line, sizeof(line), fp)) {
+        size_t length = strlen(line);
+        if(length && line[length - 1] == '\n')
+            --length;
+        IgnorePattern pattern;
+        if(!ignore_pattern_parse(line, length, &pattern))
+            continue;
+        if(rules->count == capacity) {
+            capacity = capacity * 2 + 8;
+            rules->patterns = (IgnorePattern *) realloc(rules->patterns, capacity * sizeof(*rules->patterns));
+        }
+        rules->patterns[rules->count++] = pattern;
+    }
+    fclose(fp);
+
+    rules->next = *list;
+    *list = rules;
+    return rules;
+}
+
+bool ignore_rules_match(const IgnoreRules *rules, const char *path, bool is_dir) {
+    const char *name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+
+    // Deeper files override the ones above, later lines the earlier ones
+    for(; rules; rules = rules->parent) {
+        size_t base_length = strlen(rules->base);
+        const char *below = path + base_length + (base_length ? 1 : 0);
+        for(size_t i = rules->count; i-- > 0;) {
+            const IgnorePattern *pattern = &rules->patterns[i];
+            if(pattern->dir_only && !is_dir)
+                continue;
+            bool matched = pattern->anchored
+                ? !fnmatch(pattern->glob, below, FNM_PATHNAME)
+                : !fnmatch(pattern->glob, name, 0);
+            if(matched)
+                return !pattern->negate;
+        }
+    }
+    return false;
+}
+
+void ignore_rules_free_list(IgnoreRules *list) {
+    while(list) {
+        IgnoreRules *next = list->next;
+        for(size_t i = 0; i < list->count; ++i)
+            free(list->patterns[i].glob);
+        free(list->patterns);
+        free(list->base);
+        free(list);
+        list = next;
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef GITIGNORE_H_
+#define GITIGNORE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// The rules of one .gitignore, chained to those of the directories above.
+// Paths are relative to the root of the walk, rule sets are immutable once
+// loaded and live as long as the list they were allocated into.
+
+typedef struct {
+    char *glob;
+    bool negate;
+    bool dir_only;
+    // Matched against the whole path below base instead of the name
+    bool anchored;
+} IgnorePattern;
+
+typedef struct IgnoreRules {
+    const struct IgnoreRules *parent;
+    char *base;
+    IgnorePattern *patterns;
+    size_t count;
+
+    // Next rule set allocated into the same list
+    struct IgnoreRules *next;
+} IgnoreRules;
+
+// Loads the .gitignore of dir (relative to root) into a new rule set
+// pushed onto *list, returns parent if dir has none
+const IgnoreRules *ignore_rules_load(
+    IgnoreRules **list, const IgnoreRules *parent, const char *root, const char *dir
+);
+
+bool ignore_rules_match(const IgnoreRules *rules, const char *path, bool is_dir);
+
+void ignore_rules_free_list(IgnoreRules *list);
+
+#endif // GITIGNORE_H_
@@ -1,18 +1,37 @@
 #include "./input.h"
 #include "./editor.h"
+#include "./profiler.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #define SCROLL_SPEED 60.0f
 #define SCROLL_INVERTED -1
 
 #define TEXT_TAB "    "
 
+// Typed text waiting to be inserted with the rest of its batch
+#define PENDING_TEXT_CAPACITY 1024
+
 // TODO make an input structure
 static unsigned long is_shift_down = 0;
+static char pending_text[PENDING_TEXT_CAPACITY];
+static size_t pending_text_size = 0;
+
+static void flush_pending_text(Editor *editor) {
+    if(!pending_text_size)
+        return;
+    editor_insert_text_at_cursor_n(editor, pending_text, pending_text_size);
+    pending_text_size = 0;
+}
 
 static void handle_textinput(SDL_TextInputEvent *text, Editor *editor) {
-    editor_insert_text_at_cursor(editor, text->text);
+    size_t text_size = strlen(text->text);
+    if(pending_text_size + text_size > PENDING_TEXT_CAPACITY)
+        flush_pending_text(editor);
+    memcpy(pending_text + pending_text_size, text->text, text_size);
+    pending_text_size += text_size;
 }
 
 static void handle_mouse_button_press(SDL_MouseButtonEvent *button, Editor *editor) {
@@ -68,6 +87,9 @@ static void handle_ctrl_shift_and_key_down(SDL_KeyboardEvent *key, Editor *edito
         } break;
         case SDLK_UP:   { } break;
         case SDLK_DOWN: { } break;
+        case SDLK_f: { project_search_toggle(&editor->project_search); } break;
+        case SDLK_LEFTBRACKET: { editor_toggle_fold(editor); } break;
+        case SDLK_RIGHTBRACKET: { editor_unfold_all(editor); } break;
         default: return;
     }
 }
@@ -93,22 +115,22 @@ static void handle_ctrl_and_key_down(SDL_KeyboardEvent *key, Editor *editor) {
 
         case SDLK_a: { editor_select_all(editor); } break;
         case SDLK_o: { editor_load_file(editor); } break;
+        case SDLK_p: { finder_toggle(&editor->finder); } break;
         case SDLK_s: { editor_save_file(editor); } break;
         case SDLK_n: { editor_new_file(editor); } break;
         // Quickfix, will probably remove later
         case SDLK_e: {
             editor_handle_single_click(editor, 0, 1 << 31);
         } break;
+        case SDLK_EQUALS:
+        case SDLK_PLUS:
+        case SDLK_KP_PLUS: { editor_zoom(editor, EDITOR_ZOOM_STEP); } break;
+        case SDLK_MINUS:
+        case SDLK_KP_MINUS: { editor_zoom(editor, 1.0f / EDITOR_ZOOM_STEP); } break;
+        case SDLK_0: { editor_zoom_reset(editor); } break;
         case SDLK_c: { editor_try_copy(editor); } break;
         case SDLK_x: { editor_try_cut(editor); } break;
-        case SDLK_v: {
-            if(SDL_HasClipboardText() == SDL_TRUE) {
-                char *clipboard = SDL_GetClipboardText();
-                //printf("Debug: Clipboard text:\n===\n%s\n===\n", clipboard);
-                editor_insert_text_at_cursor(editor, clipboard);
-                SDL_free(clipboard);
-            }
-        } break;
+        case SDLK_v: { editor_paste(editor); } break;
         default: return;
     }
 }
@@ -171,6 +193,14 @@ static void handle_key_down_no_mod(SDL_KeyboardEvent *key, Editor *editor) {
         case SDLK_DELETE: { editor_delete_char_after_cursor(editor); } break;
         case SDLK_RETURN: { editor_insert_newline_at_cursor(editor); } break;
         case SDLK_TAB: { editor_insert_text_at_cursor(editor, TEXT_TAB); } break;
+
+        case SDLK_F2: { editor_toggle_wrap(editor); } break;
+        case SDLK_F3: {
+            profiler_toggle();
+            editor_damage_all(editor);
+        } break;
+        case SDLK_F4: { profiler_dump_csv(PROFILER_CSV_PATH); } break;
+        case SDLK_F5: { editor_toggle_follow(editor); } break;
         default: return;
     }
 }
@@ -206,7 +236,123 @@ static void handle_key_up(SDL_KeyboardEvent *key, Editor *editor) {
     }
 }
 
+static void handle_finder_key_down(SDL_KeyboardEvent *key, Editor *editor) {
+    Finder *finder = &editor->finder;
+    if((key->keysym.mod & KMOD_CTRL) && key->keysym.sym == SDLK_p) {
+        finder_toggle(finder);
+        return;
+    }
+
+    switch(key->keysym.sym) {
+        case SDLK_ESCAPE: { finder_close(finder); } break;
+        case SDLK_BACKSPACE: { finder_delete_char(finder); } break;
+        case SDLK_UP: { finder_move_selection(finder, -1); } break;
+        case SDLK_DOWN: { finder_move_selection(finder, 1); } break;
+        case SDLK_RETURN: {
+            char *path = finder_selected_path(finder);
+            finder_close(finder);
+            if(path)
+                editor_open_path(editor, path, 0, 0);
+            free(path);
+        } break;
+        default: return;
+    }
+}
+
+// The open finder takes the keyboard and swallows the mouse, returns
+// whether event went to it
+static bool handle_finder_input(SDL_Event *event, Editor *editor) {
+    if(!editor->finder.open)
+        return false;
+
+    switch(event->type) {
+        case SDL_TEXTINPUT: { finder_insert_text(&editor->finder, event->text.text); } return true;
+        case SDL_KEYDOWN: {
+            if(event->key.keysym.sym == SDLK_LSHIFT || event->key.keysym.sym == SDLK_RSHIFT)
+                return false;
+            handle_finder_key_down(&event->key, editor);
+        } return true;
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP:
+        case SDL_MOUSEMOTION:
+        case SDL_MOUSEWHEEL: return true;
+        default: return false;
+    }
+}
+
+static void handle_project_search_key_down(SDL_KeyboardEvent *key, Editor *editor) {
+    ProjectSearch *ps = &editor->project_search;
+    if((key->keysym.mod & KMOD_CTRL) && (key->keysym.mod & KMOD_SHIFT) && key->keysym.sym == SDLK_f) {
+        project_search_toggle(ps);
+        return;
+    }
+
+    switch(key->keysym.sym) {
+        case SDLK_ESCAPE: { project_search_close(ps); } break;
+        case SDLK_BACKSPACE: { project_search_delete_char(ps); } break;
+        case SDLK_UP: { project_search_move_selection(ps, -1); } break;
+        case SDLK_DOWN: { project_search_move_selection(ps, 1); } break;
+        case SDLK_PAGEUP: { project_search_move_selection(ps, -PROJECT_SEARCH_VISIBLE_HITS); } break;
+        case SDLK_PAGEDOWN: { project_search_move_selection(ps, PROJECT_SEARCH_VISIBLE_HITS); } break;
+        case SDLK_RETURN: {
+            size_t row, col;
+            char *path = project_search_selected_hit(ps, &row, &col);
+            project_search_close(ps);
+            if(path)
+                editor_open_path(editor, path, row, col);
+            free(path);
+        } break;
+        default: return;
+    }
+}
+
+// Same as handle_finder_input for the project search panel
+static bool handle_project_search_input(SDL_Event *event, Editor *editor) {
+    if(!editor->project_search.open)
+        return false;
+
+    switch(event->type) {
+        case SDL_TEXTINPUT: { project_search_insert_text(&editor->project_search, event->text.text); } return true;
+        case SDL_KEYDOWN: {
+            if(event->key.keysym.sym == SDLK_LSHIFT || event->key.keysym.sym == SDLK_RSHIFT)
+                return false;
+            handle_project_search_key_down(&event->key, editor);
+        } return true;
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP:
+        case SDL_MOUSEMOTION:
+        case SDL_MOUSEWHEEL: return true;
+        default: return false;
+    }
+}
+
+void handle_input_batch_begin(Editor *editor) {
+    editor_begin_batch(editor);
+}
+
+void handle_input_batch_end(Editor *editor) {
+    flush_pending_text(editor);
+    editor_end_batch(editor);
+}
+
 void handle_input(SDL_Event *event, Editor *editor, bool *quit) {
+    // Anything but more text sees the edits typed before it
+    if(event->type != SDL_TEXTINPUT)
+        flush_pending_text(editor);
+
+    if(editor_handle_dialog(editor, event, quit))
+        return;
+    if(editor_handle_file_change(editor, event))
+        return;
+    if(finder_handle_event(&editor->finder, event))
+        return;
+    if(project_search_handle_event(&editor->project_search, event))
+        return;
+    if(handle_finder_input(event, editor))
+        return;
+    if(handle_project_search_input(event, editor))
+        return;
+
     switch(event->type) {
         case SDL_QUIT: { *quit = editor_try_quit(editor); } return;
         case SDL_TEXTINPUT: { handle_textinput(&event->text, editor); } return;
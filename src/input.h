@@ -5,6 +5,12 @@
 
 #include "editor.h"
 
+// Events handled between these are applied as one batch: typed text is
+// inserted in one piece and the view follows the cursor once at the end
+void handle_input_batch_begin(Editor *editor);
+
+void handle_input_batch_end(Editor *editor);
+
 void handle_input(SDL_Event *event, Editor *editor, bool *quit);
 
 #endif // INPUT_H_
\ No newline at end of file
@@ -0,0 +1,494 @@
+#define _DEFAULT_SOURCE
+#include "./journal.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "./utils.h"
+
+#define JOURNAL_MAGIC "TEJRNL01"
+#define JOURNAL_MAGIC_LENGTH 8
+
+typedef enum {
+    JOURNAL_BASE_FILE = 1,
+    JOURNAL_BASE_TEXT,
+    JOURNAL_INSERT,
+    JOURNAL_DELETE,
+    JOURNAL_SWAP
+} JournalRecordType;
+
+// Every record starts with this, followed by length bytes: the positions
+// as uint64_t and then the text, if any. check covers type and those bytes
+// so a record torn by the crash ends the replay.
+typedef struct {
+    uint32_t type;
+    uint32_t check;
+    uint64_t length;
+} JournalRecord;
+
+// Base file payload, the file the records apply to
+typedef struct {
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+} JournalFile;
+
+static uint32_t journal_check(uint32_t type, const char *data, size_t length) {
+    uint32_t hash = 2166136261u;
+    for(int i = 0; i < 4; ++i)
+        hash = (hash ^ ((type >> (8 * i)) & 0xff)) * 16777619u;
+    for(size_t i = 0; i < length; ++i)
+        hash = (hash ^ (unsigned char) data[i]) * 16777619u;
+    return hash;
+}
+
+static void journal_buffer_append(JournalBuffer *b, const void *data, size_t length) {
+    if(b->size + length > b->capacity) {
+        b->capacity = maxul(b->size + length, b->capacity * 2 + 4096);
+        b->data = (char *) realloc(b->data, b->capacity);
+    }
+    memcpy(b->data + b->size, data, length);
+    b->size += length;
+}
+
+// A record of the values followed by text
+static void journal_buffer_record(
+    JournalBuffer *b, uint32_t type,
+    const uint64_t *values, size_t count, const char *text, size_t length
+) {
+    size_t start = b->size;
+    JournalRecord record = { .type = type, .length = count * sizeof(uint64_t) + length };
+    journal_buffer_append(b, &record, sizeof(record));
+    if(count)
+        journal_buffer_append(b, values, count * sizeof(uint64_t));
+    if(length)
+        journal_buffer_append(b, text, length);
+
+    char *payload = b->data + start + sizeof(record);
+    record.check = journal_check(type, payload, record.length);
+    memcpy(b->data + start, &record, sizeof(record));
+}
+
+static char *journal_path(const char *filepath) {
+    const char *slash = strrchr(filepath, '/');
+    const char *name = slash ? slash + 1 : filepath;
+    size_t dir_length = slash ? (size_t) (slash + 1 - filepath) : 0;
+    size_t length = dir_length + 1 + strlen(name) + strlen(".te-swap");
+    char *path = (char *) malloc(length + 1);
+    memcpy(path, filepath, dir_length);
+    sprintf(path + dir_length, ".%s.te-swap", name);
+    return path;
+}
+
+static bool journal_write_all(int fd, const char *data, size_t length) {
+    while(length) {
+        ssize_t n = write(fd, data, length);
+        if(n < 0)
+            return false;
+        data += n;
+        length -= n;
+    }
+    return true;
+}
+
+/* Writer */
+
+// Writes header to a new swap file and moves it over the one at path, the
+// old one stays valid until the new one is synced
+static int journal_create(const char *path, const JournalBuffer *header) {
+    char *tmp = (char *) malloc(strlen(path) + sizeof(".tmp"));
+    sprintf(tmp, "%s.tmp", path);
+    int fd = -1;
+
+    // Another instance editing the same file keeps its swap file locked
+    int old = open(path, O_RDONLY | O_CLOEXEC);
+    if(old >= 0) {
+        bool busy = flock(old, LOCK_EX | LOCK_NB) < 0;
+        close(old);
+        if(busy) {
+            fprintf(stderr, "Error: %s is in use by another editor, not journaling\n", path);
+            goto fail;
+        }
+    }
+
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if(fd < 0 || flock(fd, LOCK_EX | LOCK_NB) < 0 ||
+        !journal_write_all(fd, header->data, header->size) ||
+        fdatasync(fd) < 0 || rename(tmp, path) < 0) {
+        fprintf(stderr, "Error: Could not create journal %s\n", path);
+        perror("journal");
+        if(fd >= 0)
+            unlink(tmp);
+        goto fail;
+    }
+    free(tmp);
+    return fd;
+
+fail:
+    if(fd >= 0)
+        close(fd);
+    free(tmp);
+    return -1;
+}
+
+static void journal_write(Journal *j, bool reset, const char *path) {
+    if(reset) {
+        if(j->fd >= 0)
+            close(j->fd);
+        j->fd = -1;
+        j->broken = false;
+
+        // A swap file that is not about to be replaced is stale now
+        if(j->owned_path && ((!j->out.size && !j->out_snapshot) || !path || strcmp(j->owned_path, path))) {
+            unlink(j->owned_path);
+            free(j->owned_path);
+            j->owned_path = NULL;
+        }
+    }
+    // Snapshots are written even without records
+    if((!j->out.size && !(reset && j->out_snapshot)) || !path || j->broken)
+        return;
+
+    if(j->fd < 0) {
+        j->fd = journal_create(path, &j->out_header);
+        if(j->fd < 0) {
+            j->broken = true;
+            if(j->owned_path)
+                unlink(j->owned_path);
+            free(j->owned_path);
+            j->owned_path = NULL;
+            return;
+        }
+        free(j->owned_path);
+        j->owned_path = strdup(path);
+    }
+
+    if(!journal_write_all(j->fd, j->out.data, j->out.size) || fdatasync(j->fd) < 0) {
+        fprintf(stderr, "Error: Could not write journal %s\n", path);
+        perror("journal");
+        j->broken = true;
+    }
+}
+
+static int journal_worker(void *data) {
+    Journal *j = (Journal *) data;
+
+    SDL_LockMutex(j->lock);
+    for(;;) {
+        while(!j->quit && !j->reset && !j->pending.size)
+            SDL_CondWait(j->wake, j->lock);
+        if(j->quit)
+            break;
+        // Let more records gather, they are synced together
+        if(j->pending.size)
+            SDL_CondWaitTimeout(j->wake, j->lock, JOURNAL_SYNC_MS);
+        if(j->quit)
+            break;
+
+        bool reset = j->reset;
+        j->reset = false;
+        if(reset) {
+            // The header is handed over, not copied
+            JournalBuffer header = j->out_header;
+            j->out_snapshot = j->snapshot;
+            j->out_header = j->header;
+            j->header = header;
+            j->header.size = 0;
+        }
+        JournalBuffer out = j->out;
+        j->out = j->pending;
+        j->pending = out;
+        j->pending.size = 0;
+        char *path = j->path ? strdup(j->path) : NULL;
+        SDL_UnlockMutex(j->lock);
+
+        journal_write(j, reset, path);
+        free(path);
+
+        SDL_LockMutex(j->lock);
+        j->out.size = 0;
+    }
+    SDL_UnlockMutex(j->lock);
+    return 0;
+}
+
+/* Journal */
+
+bool journal_init(Journal *j) {
+    *j = (Journal) {0};
+    j->fd = -1;
+    j->lock = SDL_CreateMutex();
+    j->wake = SDL_CreateCond();
+    if(!j->lock || !j->wake) {
+        fprintf(stderr, "Error: Could not set up the journal: %s\n", SDL_GetError());
+        return false;
+    }
+    if(!(j->thread = SDL_CreateThread(journal_worker, "journal", j))) {
+        fprintf(stderr, "Error: Could not start journal thread: %s\n", SDL_GetError());
+        return false;
+    }
+    return true;
+}
+
+// Makes header the new base, the records so far are dropped. Takes over
+// header and path.
+static void journal_reset(Journal *j, char *path, JournalBuffer *header, bool snapshot, size_t base_size) {
+    SDL_LockMutex(j->lock);
+    char *old_path = j->path;
+    JournalBuffer old_header = j->header;
+    j->path = path;
+    j->snapshot = snapshot;
+    j->header = header ? *header : (JournalBuffer) {0};
+    j->pending.size = 0;
+    j->reset = true;
+    SDL_CondSignal(j->wake);
+    SDL_UnlockMutex(j->lock);
+
+    free(old_path);
+    free(old_header.data);
+    j->record_bytes = 0;
+    j->base_size = base_size;
+}
+
+void journal_start(Journal *j, const char *filepath) {
+    if(!j->thread)
+        return;
+
+    struct stat st;
+    if(!filepath || stat(filepath, &st) < 0) {
+        journal_reset(j, NULL, NULL, false, 0);
+        return;
+    }
+
+    JournalBuffer header = {0};
+    JournalFile file = {
+        .size = st.st_size,
+        .mtime_sec = st.st_mtim.tv_sec,
+        .mtime_nsec = st.st_mtim.tv_nsec
+    };
+    journal_buffer_append(&header, JOURNAL_MAGIC, JOURNAL_MAGIC_LENGTH);
+    journal_buffer_record(&header, JOURNAL_BASE_FILE, (const uint64_t *) &file, 3, NULL, 0);
+    journal_reset(j, journal_path(filepath), &header, false, st.st_size);
+}
+
+void journal_checkpoint(Journal *j, const char *text, size_t length) {
+    if(!j->path)
+        return;
+
+    JournalBuffer header = {0};
+    journal_buffer_append(&header, JOURNAL_MAGIC, JOURNAL_MAGIC_LENGTH);
+    journal_buffer_record(&header, JOURNAL_BASE_TEXT, NULL, 0, text, length);
+    journal_reset(j, strdup(j->path), &header, true, length);
+}
+
+bool journal_has_snapshot(Journal *j) {
+    return j->path && j->snapshot;
+}
+
+bool journal_needs_checkpoint(Journal *j) {
+    // Snapshots of big buffers are taken less often
+    return j->path && j->record_bytes > JOURNAL_CHECKPOINT_BYTES && j->record_bytes > j->base_size / 2;
+}
+
+static void journal_append(Journal *j, uint32_t type, const uint64_t *values, size_t count, const char *text, size_t length) {
+    if(!j->path)
+        return;
+
+    SDL_LockMutex(j->lock);
+    size_t size = j->pending.size;
+    journal_buffer_record(&j->pending, type, values, count, text, length);
+    j->record_bytes += j->pending.size - size;
+    if(!size)
+        SDL_CondSignal(j->wake);
+    SDL_UnlockMutex(j->lock);
+}
+
+void journal_insert(Journal *j, size_t row, size_t col, const char *text, size_t length) {
+    uint64_t values[] = { row, col };
+    journal_append(j, JOURNAL_INSERT, values, 2, text, length);
+}
+
+void journal_delete(Journal *j, size_t rs, size_t cs, size_t re, size_t ce) {
+    uint64_t values[] = { rs, cs, re, ce };
+    journal_append(j, JOURNAL_DELETE, values, 4, NULL, 0);
+}
+
+void journal_swap(Journal *j, size_t a, size_t b) {
+    uint64_t values[] = { a, b };
+    journal_append(j, JOURNAL_SWAP, values, 2, NULL, 0);
+}
+
+/* Recovery */
+
+static bool journal_valid_pos(LineBuffer *lb, uint64_t row, uint64_t col) {
+    return row < lb->lines_size && col <= lb->lines[row].buffer_size;
+}
+
+// Applies one record to lb, false if it does not fit the buffer
+static bool journal_apply(LineBuffer *lb, uint32_t type, const char *payload, uint64_t length) {
+    uint64_t v[4];
+    size_t count = type == JOURNAL_DELETE ? 4 : type == JOURNAL_BASE_TEXT ? 0 : 2;
+    if(length < count * sizeof(uint64_t))
+        return false;
+    memcpy(v, payload, count * sizeof(uint64_t));
+    const char *text = payload + count * sizeof(uint64_t);
+    size_t text_length = length - count * sizeof(uint64_t);
+    size_t end_row, end_col;
+
+    switch(type) {
+        case JOURNAL_BASE_TEXT: {
+            lines_clear(lb);
+            lines_append_line(lb, "", 0);
+            lines_insert_at(lb, 0, 0, text, text_length, &end_row, &end_col);
+        } break;
+        case JOURNAL_INSERT: {
+            if(!journal_valid_pos(lb, v[0], v[1]))
+                return false;
+            lines_insert_at(lb, v[0], v[1], text, text_length, &end_row, &end_col);
+        } break;
+        case JOURNAL_DELETE: {
+            if(!journal_valid_pos(lb, v[0], v[1]) || !journal_valid_pos(lb, v[2], v[3]) ||
+                v[0] > v[2] || (v[0] == v[2] && v[1] > v[3]))
+                return false;
+            lines_delete_range(lb, v[0], v[1], v[2], v[3]);
+        } break;
+        case JOURNAL_SWAP: {
+            if(v[0] >= lb->lines_size || v[1] >= lb->lines_size)
+                return false;
+            lines_swap(lb, v[0], v[1]);
+        } break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+// Whether filepath is still the file the journal was based on
+static bool journal_same_file(const char *filepath, const char *payload, uint64_t length) {
+    JournalFile file;
+    struct stat st;
+    if(length != sizeof(file) || stat(filepath, &st) < 0)
+        return false;
+    memcpy(&file, payload, sizeof(file));
+    return file.size == (uint64_t) st.st_size &&
+        file.mtime_sec == st.st_mtim.tv_sec && file.mtime_nsec == st.st_mtim.tv_nsec;
+}
+
+// Replays the records over lb, or with lb NULL only tells whether there is
+// anything to replay
+static bool journal_replay(const char *filepath, LineBuffer *lb) {
+    char *path = journal_path(filepath);
+    char *data = NULL;
+    bool recovered = false;
+
+    // A locked one belongs to an editor that is still running
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0 || flock(fd, LOCK_SH | LOCK_NB) < 0)
+        goto done;
+
+    struct stat st;
+    if(fstat(fd, &st) < 0)
+        goto done;
+    size_t size = st.st_size;
+    data = (char *) malloc(size ? size : 1);
+    for(size_t got = 0; got < size; ) {
+        ssize_t n = read(fd, data + got, size - got);
+        if(n <= 0) {
+            size = got;
+            break;
+        }
+        got += n;
+    }
+    if(size < JOURNAL_MAGIC_LENGTH || memcmp(data, JOURNAL_MAGIC, JOURNAL_MAGIC_LENGTH))
+        goto done;
+
+    size_t applied = 0;
+    for(size_t offset = JOURNAL_MAGIC_LENGTH; size - offset >= sizeof(JournalRecord); ++applied) {
+        JournalRecord record;
+        memcpy(&record, data + offset, sizeof(record));
+        const char *payload = data + offset + sizeof(record);
+        if(record.length > size - offset - sizeof(record) ||
+            record.check != journal_check(record.type, payload, record.length))
+            break;
+        offset += sizeof(record) + record.length;
+
+        // Only the first record is a base
+        if(!applied && record.type == JOURNAL_BASE_FILE) {
+            if(!journal_same_file(filepath, payload, record.length)) {
+                fprintf(stderr, "Error: %s changed since %s was written, not recovering\n", filepath, path);
+                goto done;
+            }
+            continue;
+        }
+        if(!applied && record.type != JOURNAL_BASE_TEXT)
+            goto done;
+        if(applied && record.type == JOURNAL_BASE_TEXT)
+            break;
+        if(!lb) {
+            recovered = true;
+            break;
+        }
+        if(!journal_apply(lb, record.type, payload, record.length))
+            break;
+        recovered = true;
+    }
+    if(recovered && lb)
+        fprintf(stderr, "Recovered unsaved changes of %s from %s\n", filepath, path);
+
+done:
+    if(fd >= 0)
+        close(fd);
+    free(data);
+    free(path);
+    return recovered;
+}
+
+bool journal_recoverable(const char *filepath) {
+    return journal_replay(filepath, NULL);
+}
+
+bool journal_recover(const char *filepath, LineBuffer *lb) {
+    return journal_replay(filepath, lb);
+}
+
+void journal_discard(const char *filepath) {
+    char *path = journal_path(filepath);
+    // Unless another editor is still writing it
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd >= 0) {
+        if(flock(fd, LOCK_EX | LOCK_NB) == 0)
+            unlink(path);
+        close(fd);
+    }
+    free(path);
+}
+
+void journal_destroy(Journal *j) {
+    if(j->thread) {
+        SDL_LockMutex(j->lock);
+        j->quit = true;
+        SDL_CondSignal(j->wake);
+        SDL_UnlockMutex(j->lock);
+        SDL_WaitThread(j->thread, NULL);
+    }
+    if(j->fd >= 0)
+        close(j->fd);
+    if(j->owned_path)
+        unlink(j->owned_path);
+    free(j->owned_path);
+    free(j->path);
+    free(j->header.data);
+    free(j->pending.data);
+    free(j->out.data);
+    free(j->out_header.data);
+    if(j->wake)
+        SDL_DestroyCond(j->wake);
+    if(j->lock)
+        SDL_DestroyMutex(j->lock);
+}
@@ -0,0 +1,92 @@
+#ifndef JOURNAL_H_
+#define JOURNAL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <SDL2/SDL.h>
+
+#include "./editor/line.h"
+
+// Crash recovery journal. Every edit of a buffer with a file is appended
+// as a small record to a swap file next to it (.name.te-swap), written and
+// synced in batches by a helper thread. The journal starts from a base:
+// the file on disk as it was loaded or saved, or a snapshot of the buffer
+// taken at a checkpoint once the records outgrow it. A clean exit removes
+// the swap file, one left behind is replayed when the file is opened and
+// the user agrees.
+
+// How long records gather before they are written and synced
+#define JOURNAL_SYNC_MS 500
+// Records below this many bytes never call for a checkpoint
+#define JOURNAL_CHECKPOINT_BYTES (4 << 20)
+
+typedef struct {
+    char *data;
+    size_t size;
+    size_t capacity;
+} JournalBuffer;
+
+typedef struct {
+    SDL_Thread *thread;
+    SDL_mutex *lock;
+    SDL_cond *wake;
+
+    // Shared with the writer. reset tells that the base changed and the
+    // swap file starts over with header, a snapshot base is written even
+    // before there are records.
+    char *path;
+    JournalBuffer header;
+    bool snapshot;
+    JournalBuffer pending;
+    bool reset;
+    bool quit;
+
+    // Bytes of records since the base and the size of the base
+    size_t record_bytes;
+    size_t base_size;
+
+    // Writer only
+    int fd;
+    char *owned_path;
+    bool broken;
+    bool out_snapshot;
+    JournalBuffer out;
+    JournalBuffer out_header;
+} Journal;
+
+bool journal_init(Journal *j);
+
+// Starts a journal based on filepath as it is on disk now, NULL stops
+// journaling
+void journal_start(Journal *j, const char *filepath);
+
+// Starts over from text, the whole buffer
+void journal_checkpoint(Journal *j, const char *text, size_t length);
+
+bool journal_needs_checkpoint(Journal *j);
+
+// Whether the journal starts from a snapshot rather than the file on disk
+bool journal_has_snapshot(Journal *j);
+
+void journal_insert(Journal *j, size_t row, size_t col, const char *text, size_t length);
+
+void journal_delete(Journal *j, size_t rs, size_t cs, size_t re, size_t ce);
+
+void journal_swap(Journal *j, size_t a, size_t b);
+
+// Whether a swap file left behind for filepath has changes to replay
+bool journal_recoverable(const char *filepath);
+
+// Replays the swap file left behind for filepath over lb, which holds the
+// file as it is on disk. Returns whether anything was recovered.
+bool journal_recover(const char *filepath, LineBuffer *lb);
+
+// Removes the swap file left behind for filepath, its changes are not
+// wanted
+void journal_discard(const char *filepath);
+
+// Removes the swap file, the buffer was given up on purpose
+void journal_destroy(Journal *j);
+
+#endif // JOURNAL_H_
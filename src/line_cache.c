@@ -0,0 +1,138 @@
+#include "./line_cache.h"
+
+#include <stdlib.h>
+#include <assert.h>
+
+static size_t line_cache_hash(LineCache *cache, uint64_t key) {
+    uint64_t h = key * 0x9E3779B97F4A7C15ull;
+    return (size_t) (h ^ (h >> 32)) & cache->table_mask;
+}
+
+// Returns the bucket holding key, or the empty bucket where it would go
+static size_t line_cache_find_bucket(LineCache *cache, uint64_t key) {
+    size_t i = line_cache_hash(cache, key);
+    while(cache->table[i] != LINE_CACHE_NONE && cache->entries[cache->table[i]].key != key)
+        i = (i + 1) & cache->table_mask;
+    return i;
+}
+
+// Backward shift deletion, keeps probe sequences intact without tombstones
+static void line_cache_remove_bucket(LineCache *cache, size_t i) {
+    size_t j = i;
+    for(;;) {
+        j = (j + 1) & cache->table_mask;
+        if(cache->table[j] == LINE_CACHE_NONE)
+            break;
+        size_t home = line_cache_hash(cache, cache->entries[cache->table[j]].key);
+        bool movable = (j > i) ? (home <= i || home > j) : (home <= i && home > j);
+        if(movable) {
+            cache->table[i] = cache->table[j];
+            i = j;
+        }
+    }
+    cache->table[i] = LINE_CACHE_NONE;
+}
+
+static void line_cache_unlink(LineCache *cache, size_t slot) {
+    LineCacheEntry *e = &cache->entries[slot];
+    if(e->prev != LINE_CACHE_NONE)
+        cache->entries[e->prev].next = e->next;
+    else
+        cache->lru_head = e->next;
+    if(e->next != LINE_CACHE_NONE)
+        cache->entries[e->next].prev = e->prev;
+    else
+        cache->lru_tail = e->prev;
+    e->prev = e->next = LINE_CACHE_NONE;
+}
+
+static void line_cache_push_front(LineCache *cache, size_t slot) {
+    LineCacheEntry *e = &cache->entries[slot];
+    e->prev = LINE_CACHE_NONE;
+    e->next = cache->lru_head;
+    if(cache->lru_head != LINE_CACHE_NONE)
+        cache->entries[cache->lru_head].prev = slot;
+    cache->lru_head = slot;
+    if(cache->lru_tail == LINE_CACHE_NONE)
+        cache->lru_tail = slot;
+}
+
+void line_cache_init(LineCache *cache, size_t capacity) {
+    assert(capacity > 0);
+
+    size_t table_size = 1;
+    while(table_size < capacity * 2)
+        table_size <<= 1;
+
+    *cache = (LineCache) {
+        .entries = (LineCacheEntry *) calloc(capacity, sizeof(LineCacheEntry)),
+        .capacity = capacity,
+        .free_slots = (size_t *) malloc(capacity * sizeof(size_t)),
+        .table = (size_t *) malloc(table_size * sizeof(size_t)),
+        .table_mask = table_size - 1
+    };
+    line_cache_clear(cache);
+}
+
+bool line_cache_get(LineCache *cache, uint64_t key, uint64_t version, size_t *slot) {
+    size_t bucket = line_cache_find_bucket(cache, key);
+
+    if(cache->table[bucket] != LINE_CACHE_NONE) {
+        *slot = cache->table[bucket];
+        line_cache_unlink(cache, *slot);
+        line_cache_push_front(cache, *slot);
+
+        LineCacheEntry *e = &cache->entries[*slot];
+        if(e->version == version)
+            return true;
+        e->version = version;
+        return false;
+    }
+
+    if(!cache->free_count) {
+        line_cache_remove(cache, cache->lru_tail);
+        bucket = line_cache_find_bucket(cache, key);
+    }
+    *slot = cache->free_slots[--cache->free_count];
+
+    cache->entries[*slot] = (LineCacheEntry) {
+        .key = key,
+        .version = version,
+        .used = true,
+        .prev = LINE_CACHE_NONE,
+        .next = LINE_CACHE_NONE
+    };
+    cache->table[bucket] = *slot;
+    line_cache_push_front(cache, *slot);
+    return false;
+}
+
+void line_cache_remove(LineCache *cache, size_t slot) {
+    LineCacheEntry *e = &cache->entries[slot];
+    if(!e->used)
+        return;
+
+    line_cache_remove_bucket(cache, line_cache_find_bucket(cache, e->key));
+    line_cache_unlink(cache, slot);
+    e->used = false;
+    cache->free_slots[cache->free_count++] = slot;
+}
+
+void line_cache_clear(LineCache *cache) {
+    for(size_t i = 0; i <= cache->table_mask; ++i)
+        cache->table[i] = LINE_CACHE_NONE;
+    // Hand out low slots first
+    for(size_t i = 0; i < cache->capacity; ++i) {
+        cache->entries[i].used = false;
+        cache->free_slots[i] = cache->capacity - 1 - i;
+    }
+    cache->free_count = cache->capacity;
+    cache->lru_head = cache->lru_tail = LINE_CACHE_NONE;
+}
+
+void line_cache_destroy(LineCache *cache) {
+    free(cache->entries);
+    free(cache->free_slots);
+    free(cache->table);
+    *cache = (LineCache) {0};
+}
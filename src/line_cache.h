@@ -0,0 +1,52 @@
+#ifndef LINE_CACHE_H_
+#define LINE_CACHE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed-capacity LRU map from a 64-bit key (usually Line.id) to a slot index.
+// The owner keeps the cached data in its own arrays indexed by slot.
+
+#define LINE_CACHE_NONE ((size_t) -1)
+
+typedef struct {
+    uint64_t key;
+    uint64_t version;
+    bool used;
+
+    // LRU list links, most recently used first
+    size_t prev;
+    size_t next;
+} LineCacheEntry;
+
+typedef struct {
+    LineCacheEntry *entries;
+    size_t capacity;
+
+    size_t *free_slots;
+    size_t free_count;
+
+    // Open addressing table of slot indices, LINE_CACHE_NONE marks empty buckets
+    size_t *table;
+    size_t table_mask;
+
+    size_t lru_head;
+    size_t lru_tail;
+} LineCache;
+
+void line_cache_init(LineCache *cache, size_t capacity);
+
+// Looks up key and marks it as most recently used. Returns true if it is
+// cached with the same version. Otherwise the key is bound to *slot (reusing
+// its old slot or evicting the least recently used one) and the caller is
+// expected to fill it.
+bool line_cache_get(LineCache *cache, uint64_t key, uint64_t version, size_t *slot);
+
+void line_cache_remove(LineCache *cache, size_t slot);
+
+void line_cache_clear(LineCache *cache);
+
+void line_cache_destroy(LineCache *cache);
+
+#endif // LINE_CACHE_H_
@@ -6,6 +6,12 @@
 #include "./cmd_parser.h"
 #include "./input.h"
 #include "./init.h"
+#include "./profiler.h"
+
+// Upper bound on how long the loop sleeps when idle
+#define IDLE_WAIT_TIMEOUT_MS 500
+// How long a burst of events may be applied before a frame is drawn
+#define FRAME_BUDGET_MS 16
 
 int main(int argc, char **argv) {
     // Check validity of cmd args
@@ -38,31 +44,52 @@ int main(int argc, char **argv) {
 
     // Event loop
     bool quit = false;
-    int window_w, window_h;
-    SDL_GetWindowSize(window, &window_w, &window_h);
+    profiler_init();
 
     while(!quit) {
         SDL_Event event = {0};
-        while(SDL_PollEvent(&event)) {
-            if(event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_RESIZED) {
-                window_w = event.window.data1, window_h = event.window.data2;
-                renderer_set_resolution(&renderer, window_w, window_h);
-            }
-            handle_input(&event, &editor, &quit);
+
+        // Sleep until something happens, unless a redraw is still pending
+        int timeout = editor_needs_redraw(&editor) ? 0 : IDLE_WAIT_TIMEOUT_MS;
+        if(SDL_WaitEventTimeout(&event, timeout)) {
+            // Apply events as they pour in, but no longer than a frame
+            Uint32 budget_end = SDL_GetTicks() + FRAME_BUDGET_MS;
+            profiler_section_begin(PROFILE_INPUT);
+            handle_input_batch_begin(&editor);
+            do {
+                if(event.type == SDL_KEYDOWN || event.type == SDL_TEXTINPUT)
+                    profiler_count_input(event.common.timestamp);
+                if(event.type == SDL_WINDOWEVENT) {
+                    if(event.window.event == SDL_WINDOWEVENT_RESIZED)
+                        renderer_set_resolution(&renderer, event.window.data1, event.window.data2);
+                    if(event.window.event == SDL_WINDOWEVENT_RESIZED ||
+                        event.window.event == SDL_WINDOWEVENT_EXPOSED)
+                        editor_damage_all(&editor);
+                }
+                handle_input(&event, &editor, &quit);
+            } while(!quit && !SDL_TICKS_PASSED(SDL_GetTicks(), budget_end) && SDL_PollEvent(&event));
+            handle_input_batch_end(&editor);
+            profiler_section_end(PROFILE_INPUT);
         }
 
-        glViewport(0, 0, window_w, window_h);
+        if(quit || !editor_needs_redraw(&editor)) {
+            profiler_discard_input();
+            continue;
+        }
 
-        glClearColor(0.95f, 0.95f, 0.95f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
+        profiler_begin_frame();
 
+        profiler_section_begin(PROFILE_EDITOR_RENDER);
         editor_render(&editor);
+        profiler_section_end(PROFILE_EDITOR_RENDER);
 
         SDL_GL_SwapWindow(window);
+        profiler_end_frame();
     }
 
     // Release resources
 exit:
+    profiler_destroy();
     editor_destroy(&editor);
     renderer_destroy(&renderer);
     font_destroy(&font);
@@ -71,6 +98,7 @@ exit:
     return 0;
 
 fail:
+    profiler_destroy();
     editor_destroy(&editor);
     renderer_destroy(&renderer);
     font_destroy(&font);
@@ -0,0 +1,82 @@
+#include "./mesh_cache.h"
+#include "./profiler.h"
+
+bool mesh_cache_init(MeshCache *mc, Renderer *renderer) {
+    *mc = (MeshCache) {0};
+    line_cache_init(&mc->index, MESH_CACHE_SLOTS);
+
+    glGenVertexArrays(1, &mc->vao);
+    glBindVertexArray(mc->vao);
+
+    glGenBuffers(1, &mc->vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, mc->vbo);
+    glBufferData(
+        GL_ARRAY_BUFFER,
+        MESH_CACHE_SLOTS * MESH_CACHE_SLOT_VERTICES * sizeof(Vertex),
+        NULL,
+        GL_STATIC_DRAW
+    );
+    renderer_bind_vertex_format();
+
+    glBindVertexArray(renderer->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, renderer->vbo);
+    return true;
+}
+
+bool mesh_cache_get(MeshCache *mc, uint64_t key, uint64_t version, size_t *slot) {
+    return line_cache_get(&mc->index, key, version, slot);
+}
+
+bool mesh_cache_store(MeshCache *mc, size_t slot, Renderer *renderer, Vec2f pos) {
+    size_t count = renderer->vertices_count;
+    if(count > MESH_CACHE_SLOT_VERTICES) {
+        mesh_cache_forget(mc, slot);
+        return false;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, mc->vbo);
+    glBufferSubData(
+        GL_ARRAY_BUFFER,
+        slot * MESH_CACHE_SLOT_VERTICES * sizeof(Vertex),
+        count * sizeof(Vertex),
+        renderer->vertices
+    );
+    glBindBuffer(GL_ARRAY_BUFFER, renderer->vbo);
+    profiler_count_upload(count);
+
+    mc->counts[slot] = count;
+    mc->offsets[slot] = vec2f(renderer->batch_origin.x - pos.x, renderer->batch_origin.y - pos.y);
+    renderer->vertices_count = 0;
+    return true;
+}
+
+void mesh_cache_forget(MeshCache *mc, size_t slot) {
+    line_cache_remove(&mc->index, slot);
+    mc->counts[slot] = 0;
+}
+
+void mesh_cache_clear(MeshCache *mc) {
+    line_cache_clear(&mc->index);
+}
+
+void mesh_cache_draw(MeshCache *mc, size_t slot, Renderer *renderer, Vec2f pos) {
+    if(!mc->counts[slot])
+        return;
+
+    glUniform2f(
+        renderer->uniforms[UNIFORM_ORIGIN],
+        pos.x + mc->offsets[slot].x - renderer->scroll_pos.x,
+        pos.y + mc->offsets[slot].y - renderer->scroll_pos.y
+    );
+    glBindVertexArray(mc->vao);
+    glDrawArrays(GL_TRIANGLES, slot * MESH_CACHE_SLOT_VERTICES, mc->counts[slot]);
+    glBindVertexArray(renderer->vao);
+    ++renderer->draw_calls;
+    profiler_count_draw_call();
+}
+
+void mesh_cache_destroy(MeshCache *mc) {
+    line_cache_destroy(&mc->index);
+    glDeleteBuffers(1, &mc->vbo);
+    glDeleteVertexArrays(1, &mc->vao);
+}
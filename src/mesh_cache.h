@@ -0,0 +1,52 @@
+#ifndef MESH_CACHE_H_
+#define MESH_CACHE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <GL/glew.h>
+
+#include "./vec.h"
+#include "./renderer.h"
+#include "./line_cache.h"
+
+// GPU-resident glyph geometry of individual lines. Every slot is a fixed
+// range of a static VBO, so drawing a cached line is one uniform update and
+// one draw call no matter where it is on screen.
+
+#define MESH_CACHE_SLOTS 512
+#define MESH_CACHE_SLOT_GLYPHS 256
+#define MESH_CACHE_SLOT_VERTICES (6 * MESH_CACHE_SLOT_GLYPHS)
+
+typedef struct {
+    GLuint vao;
+    GLuint vbo;
+    LineCache index;
+
+    size_t counts[MESH_CACHE_SLOTS];
+    // Batch origin of the mesh relative to the position it was built at
+    Vec2f offsets[MESH_CACHE_SLOTS];
+    // Glyph atlas pages referenced by the mesh
+    uint32_t atlas_pages[MESH_CACHE_SLOTS];
+} MeshCache;
+
+bool mesh_cache_init(MeshCache *mc, Renderer *renderer);
+
+// Returns true if the mesh of (key, version) is resident in *slot, otherwise
+// *slot has been reserved for it and must be filled with mesh_cache_store.
+bool mesh_cache_get(MeshCache *mc, uint64_t key, uint64_t version, size_t *slot);
+
+// Moves the pending vertices of the renderer into slot. pos is the position
+// the vertices were built relative to. Returns false (and releases the slot)
+// if the batch does not fit into a slot.
+bool mesh_cache_store(MeshCache *mc, size_t slot, Renderer *renderer, Vec2f pos);
+
+void mesh_cache_forget(MeshCache *mc, size_t slot);
+
+void mesh_cache_clear(MeshCache *mc);
+
+// Draws slot translated to pos with the currently bound shader
+void mesh_cache_draw(MeshCache *mc, size_t slot, Renderer *renderer, Vec2f pos);
+
+void mesh_cache_destroy(MeshCache *mc);
+
+#endif // MESH_CACHE_H_
@@ -0,0 +1,285 @@
+#include "./minimap.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./utils.h"
+
+/* Layout */
+
+static size_t minimap_lines_per_row(size_t lines_count) {
+    size_t lines_per_row = (lines_count + MINIMAP_MAX_ROWS - 1) / MINIMAP_MAX_ROWS;
+    return lines_per_row ? lines_per_row : 1;
+}
+
+static size_t minimap_rows(size_t lines_count, size_t lines_per_row) {
+    return (lines_count + lines_per_row - 1) / lines_per_row;
+}
+
+// Columns between the first and the last non-blank byte of text
+static void minimap_ink(const char *text, size_t length, uint8_t *start, uint8_t *end) {
+    size_t first = 0, last = length;
+    while(first < length && (text[first] == ' ' || text[first] == '\t'))
+        ++first;
+    while(last > first && (text[last - 1] == ' ' || text[last - 1] == '\t'))
+        --last;
+
+    *start = (uint8_t) minul(first / MINIMAP_CHARS_PER_COLUMN, MINIMAP_COLUMNS);
+    *end = (uint8_t) minul((last + MINIMAP_CHARS_PER_COLUMN - 1) / MINIMAP_CHARS_PER_COLUMN, MINIMAP_COLUMNS);
+    if(first == last)
+        *start = *end = 0;
+}
+
+static void minimap_line_ink(Line *line, uint8_t *start, uint8_t *end) {
+    if(line->ink_version != line->version) {
+        minimap_ink(line->buffer, line->buffer_size, &line->ink_start, &line->ink_end);
+        line->ink_version = line->version;
+    }
+    *start = line->ink_start;
+    *end = line->ink_end;
+}
+
+// coverage holds the change of the number of inked lines at every column
+static void minimap_compose_row(const int32_t *coverage, size_t lines_per_row, uint8_t *texels) {
+    int32_t lines = 0;
+    for(size_t c = 0; c < MINIMAP_COLUMNS; ++c) {
+        lines += coverage[c];
+        texels[c] = (uint8_t) minul(lines * 255 / lines_per_row, 255);
+    }
+}
+
+/* Background build */
+
+static int minimap_build_worker(void *data) {
+    MinimapBuild *build = (MinimapBuild *) data;
+    int32_t coverage[MINIMAP_COLUMNS + 1] = {0};
+    size_t line = 0;
+
+    for(size_t pos = 0; pos <= build->length; ++line) {
+        size_t next = pos;
+        while(next < build->length && build->text[next] != '\n')
+            ++next;
+
+        uint8_t start, end;
+        minimap_ink(build->text + pos, next - pos, &start, &end);
+        ++coverage[start];
+        --coverage[end];
+
+        // Last line of a texel row
+        if((line + 1) % build->lines_per_row == 0 || next >= build->length) {
+            size_t row = line / build->lines_per_row;
+            minimap_compose_row(coverage, build->lines_per_row, build->texels + row * MINIMAP_COLUMNS);
+            memset(coverage, 0, sizeof(coverage));
+        }
+        pos = next + 1;
+    }
+
+    SDL_AtomicSet(&build->done, 1);
+    return 0;
+}
+
+static bool minimap_build_start(Minimap *mm, LineBuffer *lb, char *text, size_t length) {
+    MinimapBuild *build = &mm->build;
+    *build = (MinimapBuild) {
+        .text = text,
+        .length = length,
+        .lines_count = lb->lines_size,
+        .lines_per_row = minimap_lines_per_row(lb->lines_size),
+        .structure_version = lb->structure_version,
+        .texels = (uint8_t *) calloc(MINIMAP_MAX_ROWS * MINIMAP_COLUMNS, 1)
+    };
+    SDL_AtomicSet(&build->done, 0);
+
+    build->thread = SDL_CreateThread(minimap_build_worker, "minimap build", build);
+    if(!build->thread) {
+        fprintf(stderr, "Error: Could not start minimap thread: %s\n", SDL_GetError());
+        free(build->texels);
+        return false;
+    }
+    mm->building = true;
+    return true;
+}
+
+static void minimap_build_finish(Minimap *mm) {
+    SDL_WaitThread(mm->build.thread, NULL);
+    free(mm->build.text);
+    mm->building = false;
+}
+
+/* Minimap */
+
+bool minimap_init(Minimap *mm) {
+    *mm = (Minimap) {0};
+    mm->texels = (uint8_t *) calloc(MINIMAP_MAX_ROWS * MINIMAP_COLUMNS, 1);
+    mm->lines_per_row = 1;
+    damage_reset(&mm->dirty);
+
+    glGenTextures(1, &mm->texture);
+    glBindTexture(GL_TEXTURE_2D, mm->texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(
+        GL_TEXTURE_2D, 0, GL_R8,
+        MINIMAP_COLUMNS, MINIMAP_MAX_ROWS, 0,
+        GL_RED, GL_UNSIGNED_BYTE, mm->texels
+    );
+    return true;
+}
+
+void minimap_lines_changed(Minimap *mm, size_t start, size_t end) {
+    damage_mark_rows(&mm->dirty, start, end);
+}
+
+void minimap_load(Minimap *mm, LineBuffer *lb, char *text, size_t length) {
+    if(mm->building) {
+        minimap_build_finish(mm);
+        free(mm->build.texels);
+    }
+
+    damage_reset(&mm->dirty);
+    mm->sweep = 0;
+    if(lb->lines_size < MINIMAP_ASYNC_LINES || !minimap_build_start(mm, lb, text, length))
+        free(text);
+}
+
+bool minimap_pending(Minimap *mm, LineBuffer *lb) {
+    if(mm->building)
+        return SDL_AtomicGet(&mm->build.done) != 0;
+    return mm->dirty.rows || mm->sweep < minimap_rows(lb->lines_size, mm->lines_per_row);
+}
+
+// Recomputes a texel row, returns whether it changed
+static bool minimap_update_row(Minimap *mm, LineBuffer *lb, size_t row) {
+    int32_t coverage[MINIMAP_COLUMNS + 1] = {0};
+    size_t first = row * mm->lines_per_row;
+    size_t last = minul(first + mm->lines_per_row, lb->lines_size);
+    for(size_t i = first; i < last; ++i) {
+        uint8_t start, end;
+        minimap_line_ink(&lb->lines[i], &start, &end);
+        ++coverage[start];
+        --coverage[end];
+    }
+
+    uint8_t texels[MINIMAP_COLUMNS];
+    minimap_compose_row(coverage, mm->lines_per_row, texels);
+    if(!memcmp(texels, mm->texels + row * MINIMAP_COLUMNS, MINIMAP_COLUMNS))
+        return false;
+    memcpy(mm->texels + row * MINIMAP_COLUMNS, texels, MINIMAP_COLUMNS);
+    return true;
+}
+
+static void minimap_upload(Minimap *mm, size_t start, size_t end) {
+    glBindTexture(GL_TEXTURE_2D, mm->texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(
+        GL_TEXTURE_2D, 0,
+        0, (GLint) start, MINIMAP_COLUMNS, (GLsizei) (end - start),
+        GL_RED, GL_UNSIGNED_BYTE, mm->texels + start * MINIMAP_COLUMNS
+    );
+}
+
+bool minimap_update(Minimap *mm, LineBuffer *lb) {
+    size_t upload_start = MINIMAP_MAX_ROWS, upload_end = 0;
+
+    // The layout of the loaded document is only good if no lines were
+    // inserted or removed meanwhile, lines edited in place are still dirty
+    if(mm->building) {
+        if(!SDL_AtomicGet(&mm->build.done))
+            return false;
+        minimap_build_finish(mm);
+        if(mm->build.structure_version == lb->structure_version && mm->build.lines_count == lb->lines_size) {
+            free(mm->texels);
+            mm->texels = mm->build.texels;
+            mm->lines_per_row = mm->build.lines_per_row;
+            mm->rows = minimap_rows(lb->lines_size, mm->lines_per_row);
+            mm->sweep = mm->rows;
+            upload_start = 0;
+            upload_end = MINIMAP_MAX_ROWS;
+        }
+        else {
+            free(mm->build.texels);
+            mm->sweep = 0;
+        }
+    }
+
+    // A new scale moves every line to another row
+    size_t lines_per_row = minimap_lines_per_row(lb->lines_size);
+    if(lines_per_row != mm->lines_per_row) {
+        mm->lines_per_row = lines_per_row;
+        mm->sweep = 0;
+    }
+    size_t rows = minimap_rows(lb->lines_size, lines_per_row);
+    if(rows < mm->rows) {
+        memset(mm->texels + rows * MINIMAP_COLUMNS, 0, (mm->rows - rows) * MINIMAP_COLUMNS);
+        upload_start = minul(upload_start, rows);
+        upload_end = maxul(upload_end, mm->rows);
+    }
+    mm->rows = rows;
+
+    // Lines edited in place touch one or a few rows, inserted or removed
+    // lines shift everything below, which is recomputed over several frames
+    if(mm->dirty.rows) {
+        size_t start = mm->dirty.row_start / lines_per_row;
+        if(mm->dirty.row_end == DAMAGE_TO_END) {
+            mm->sweep = minul(mm->sweep, start);
+        }
+        else {
+            size_t end = minul((mm->dirty.row_end + lines_per_row - 1) / lines_per_row, rows);
+            for(size_t row = start; row < end; ++row)
+                if(minimap_update_row(mm, lb, row)) {
+                    upload_start = minul(upload_start, row);
+                    upload_end = maxul(upload_end, row + 1);
+                }
+        }
+    }
+    damage_reset(&mm->dirty);
+
+    for(size_t swept = 0; mm->sweep < rows && swept < MINIMAP_SWEEP_ROWS; ++mm->sweep, ++swept)
+        if(minimap_update_row(mm, lb, mm->sweep)) {
+            upload_start = minul(upload_start, mm->sweep);
+            upload_end = maxul(upload_end, mm->sweep + 1);
+        }
+
+    if(upload_start >= upload_end)
+        return false;
+    minimap_upload(mm, upload_start, upload_end);
+    return true;
+}
+
+float minimap_height(Minimap *mm, float available) {
+    float height = mm->rows * MINIMAP_ROW_HEIGHT;
+    return height < available ? height : available;
+}
+
+void minimap_draw(Minimap *mm, Renderer *renderer, Vec2f pos, Vec2f size, Vec4f color) {
+    if(!mm->rows || mm->building)
+        return;
+
+    glActiveTexture(GL_TEXTURE0 + RENDERER_MINIMAP_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, mm->texture);
+    glActiveTexture(GL_TEXTURE0);
+
+    renderer_set_shader(renderer, SHADER_MINIMAP);
+    renderer_textured_rect(
+        renderer,
+        pos, size,
+        vec2f(0.0f, 0.0f),
+        vec2f(1.0f, (float) mm->rows / MINIMAP_MAX_ROWS),
+        0,
+        color
+    );
+    renderer_flush(renderer);
+}
+
+void minimap_destroy(Minimap *mm) {
+    if(mm->building) {
+        minimap_build_finish(mm);
+        free(mm->build.texels);
+    }
+    glDeleteTextures(1, &mm->texture);
+    free(mm->texels);
+}
@@ -0,0 +1,83 @@
+#ifndef MINIMAP_H_
+#define MINIMAP_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <GL/glew.h>
+#include <SDL2/SDL.h>
+
+#include "./renderer.h"
+#include "./editor/line.h"
+#include "./editor/damage.h"
+
+// Overview of the whole document in a one channel texture. Every texel row
+// covers lines_per_row lines, every texel how many of them have text in its
+// columns. Rows are recomputed from the lines reported as changed, only the
+// texels that differ are uploaded.
+
+#define MINIMAP_COLUMNS 64
+#define MINIMAP_CHARS_PER_COLUMN 2
+#define MINIMAP_MAX_ROWS 4096
+
+// Width of the sidebar and height of a texel row on screen
+#define MINIMAP_WIDTH 96.0f
+#define MINIMAP_ROW_HEIGHT 2.0f
+
+// Documents with more lines are laid out on a background thread when loaded
+#define MINIMAP_ASYNC_LINES 100000
+// Texel rows recomputed per frame after lines were inserted or removed
+#define MINIMAP_SWEEP_ROWS 256
+
+typedef struct {
+    char *text; // owned
+    size_t length;
+    size_t lines_count;
+    size_t lines_per_row;
+    uint64_t structure_version;
+    uint8_t *texels;
+
+    SDL_atomic_t done;
+    SDL_Thread *thread;
+} MinimapBuild;
+
+typedef struct {
+    GLuint texture;
+    uint8_t *texels; // MINIMAP_MAX_ROWS * MINIMAP_COLUMNS
+    size_t rows;
+    size_t lines_per_row;
+
+    // Lines changed since the last update, and the next texel row of a
+    // recompute that runs to the end of the document
+    Damage dirty;
+    size_t sweep;
+
+    bool building;
+    MinimapBuild build;
+} Minimap;
+
+bool minimap_init(Minimap *mm);
+
+// Line change feed, rows as in Damage
+void minimap_lines_changed(Minimap *mm, size_t start, size_t end);
+
+// Lays out a freshly loaded document. Takes ownership of its text, big
+// documents are laid out from it in the background.
+void minimap_load(Minimap *mm, LineBuffer *lb, char *text, size_t length);
+
+// Whether minimap_update has work left
+bool minimap_pending(Minimap *mm, LineBuffer *lb);
+
+// Brings the texture up to date, returns whether any texel changed
+bool minimap_update(Minimap *mm, LineBuffer *lb);
+
+// Height the overview takes up in a sidebar of height available
+float minimap_height(Minimap *mm, float available);
+
+// Draws the overview into the rectangle at pos
+void minimap_draw(Minimap *mm, Renderer *renderer, Vec2f pos, Vec2f size, Vec4f color);
+
+void minimap_destroy(Minimap *mm);
+
+#endif // MINIMAP_H_
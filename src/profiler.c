@@ -0,0 +1,304 @@
+#include "./profiler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL2/SDL.h>
+
+#include "./utils.h"
+
+// Timer queries are read back a few frames late so they never stall
+#define PROFILER_GPU_QUERIES 4
+// Frames shown in the overlay's frame time graph
+#define PROFILER_GRAPH_FRAMES 120
+#define PROFILER_GRAPH_HEIGHT 60.0f
+#define PROFILER_GRAPH_MS_SCALE 3.0f
+
+#define HUD_LINES 6
+#define HUD_PADDING 8.0f
+#define HUD_TEXT_COLOR vec4f(1.0f, 1.0f, 1.0f, 1.0f)
+#define HUD_BACKGROUND_COLOR vec4f(0.0f, 0.0f, 0.0f, 0.75f)
+#define HUD_BAR_COLOR vec4f(0.3f, 0.8f, 0.3f, 1.0f)
+#define HUD_SLOW_BAR_COLOR vec4f(0.9f, 0.3f, 0.2f, 1.0f)
+#define HUD_SLOW_FRAME_MS 16.7
+
+static const char *section_names[COUNT_PROFILE_SECTIONS] = {
+    [PROFILE_INPUT] = "input",
+    [PROFILE_EDITOR_RENDER] = "editor_render",
+    [PROFILE_FONT_RENDER_LINE] = "font_render_line",
+    [PROFILE_RENDERER_FLUSH] = "renderer_flush",
+    [PROFILE_SHAPE] = "shape",
+};
+
+typedef struct {
+    bool enabled;
+    bool queries_created;
+
+    Uint64 section_start[COUNT_PROFILE_SECTIONS];
+    Uint64 frame_start;
+    ProfileFrame current;
+    Uint32 input_since;
+
+    ProfileFrame history[PROFILER_HISTORY];
+    size_t frame_count;
+
+    GLuint queries[PROFILER_GPU_QUERIES];
+    bool query_pending[PROFILER_GPU_QUERIES];
+    size_t query_frame[PROFILER_GPU_QUERIES];
+} Profiler;
+
+static Profiler profiler;
+
+static double profiler_ms_since(Uint64 start) {
+    return (double) (SDL_GetPerformanceCounter() - start) * 1000.0 / (double) SDL_GetPerformanceFrequency();
+}
+
+void profiler_init(void) {
+    profiler = (Profiler) {0};
+    profiler.enabled = getenv(PROFILER_ENV) != NULL;
+}
+
+void profiler_toggle(void) {
+    profiler.enabled = !profiler.enabled;
+}
+
+bool profiler_is_enabled(void) {
+    return profiler.enabled;
+}
+
+void profiler_section_begin(ProfileSection section) {
+    if(!profiler.enabled)
+        return;
+    profiler.section_start[section] = SDL_GetPerformanceCounter();
+}
+
+void profiler_section_end(ProfileSection section) {
+    if(!profiler.enabled || !profiler.section_start[section])
+        return;
+    profiler.current.section_ms[section] += profiler_ms_since(profiler.section_start[section]);
+    profiler.section_start[section] = 0;
+}
+
+void profiler_count_draw_call(void) {
+    if(profiler.enabled)
+        ++profiler.current.draw_calls;
+}
+
+void profiler_count_upload(size_t vertices) {
+    if(!profiler.enabled)
+        return;
+    profiler.current.vertices += vertices;
+    profiler.current.bytes += vertices * sizeof(Vertex);
+}
+
+void profiler_count_shape(bool cache_hit) {
+    if(!profiler.enabled)
+        return;
+    if(cache_hit)
+        ++profiler.current.shape_hits;
+    else
+        ++profiler.current.shape_misses;
+}
+
+void profiler_count_input(Uint32 timestamp) {
+    if(!profiler.enabled)
+        return;
+    if(!profiler.current.input_events || SDL_TICKS_PASSED(profiler.input_since, timestamp))
+        profiler.input_since = timestamp;
+    ++profiler.current.input_events;
+}
+
+void profiler_discard_input(void) {
+    profiler.current.input_events = 0;
+}
+
+// Stores finished GPU timings into the frames they were measured in
+static void profiler_collect_queries(bool wait) {
+    for(size_t i = 0; i < PROFILER_GPU_QUERIES; ++i) {
+        if(!profiler.query_pending[i])
+            continue;
+
+        GLint available = 0;
+        glGetQueryObjectiv(profiler.queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if(!available && !wait)
+            continue;
+
+        GLuint64 elapsed_ns = 0;
+        glGetQueryObjectui64v(profiler.queries[i], GL_QUERY_RESULT, &elapsed_ns);
+        profiler.query_pending[i] = false;
+
+        size_t frame = profiler.query_frame[i];
+        if(frame + PROFILER_HISTORY > profiler.frame_count)
+            profiler.history[frame % PROFILER_HISTORY].gpu_ms = elapsed_ns / 1e6;
+    }
+}
+
+void profiler_begin_frame(void) {
+    if(!profiler.enabled)
+        return;
+
+    if(!profiler.queries_created) {
+        glGenQueries(PROFILER_GPU_QUERIES, profiler.queries);
+        profiler.queries_created = true;
+    }
+
+    size_t q = profiler.frame_count % PROFILER_GPU_QUERIES;
+    if(profiler.query_pending[q])
+        profiler_collect_queries(true);
+
+    profiler.frame_start = SDL_GetPerformanceCounter();
+    glBeginQuery(GL_TIME_ELAPSED, profiler.queries[q]);
+    profiler.query_frame[q] = profiler.frame_count;
+}
+
+void profiler_end_frame(void) {
+    if(!profiler.enabled || !profiler.frame_start)
+        return;
+
+    size_t q = profiler.frame_count % PROFILER_GPU_QUERIES;
+    glEndQuery(GL_TIME_ELAPSED);
+    profiler.query_pending[q] = true;
+
+    profiler.current.cpu_ms = profiler.current.section_ms[PROFILE_INPUT] + profiler_ms_since(profiler.frame_start);
+    profiler.current.gpu_ms = -1.0;
+    profiler.current.input_latency_ms = profiler.current.input_events
+        ? (double) (SDL_GetTicks() - profiler.input_since)
+        : -1.0;
+    profiler.history[profiler.frame_count % PROFILER_HISTORY] = profiler.current;
+    ++profiler.frame_count;
+
+    profiler.current = (ProfileFrame) {0};
+    profiler.frame_start = 0;
+    profiler_collect_queries(false);
+}
+
+static int profiler_compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+static void profiler_percentiles(double *p50, double *p99) {
+    static double sorted[PROFILER_HISTORY];
+    size_t n = minul(profiler.frame_count, PROFILER_HISTORY);
+    *p50 = *p99 = 0.0;
+    if(!n)
+        return;
+
+    for(size_t i = 0; i < n; ++i)
+        sorted[i] = profiler.history[i].cpu_ms;
+    qsort(sorted, n, sizeof(*sorted), profiler_compare_doubles);
+    *p50 = sorted[n / 2];
+    *p99 = sorted[minul(n - 1, (n * 99) / 100)];
+}
+
+static ProfileFrame *profiler_frame_back(size_t n) {
+    return &profiler.history[(profiler.frame_count - 1 - n) % PROFILER_HISTORY];
+}
+
+void profiler_render_hud(Font *font, Renderer *renderer) {
+    if(!profiler.enabled || !profiler.frame_count)
+        return;
+
+    ProfileFrame *last = profiler_frame_back(0);
+    double gpu_ms = -1.0;
+    for(size_t i = 0; i < minul(profiler.frame_count, PROFILER_GPU_QUERIES + 1) && gpu_ms < 0.0; ++i)
+        gpu_ms = profiler_frame_back(i)->gpu_ms;
+
+    double p50, p99;
+    profiler_percentiles(&p50, &p99);
+
+    char lines[HUD_LINES][128];
+    snprintf(lines[0], sizeof(lines[0]), "cpu %.2f ms  p50 %.2f  p99 %.2f  gpu %.2f ms",
+        last->cpu_ms, p50, p99, gpu_ms);
+    snprintf(lines[1], sizeof(lines[1]), "%s %.2f  %s %.2f",
+        section_names[PROFILE_INPUT], last->section_ms[PROFILE_INPUT],
+        section_names[PROFILE_EDITOR_RENDER], last->section_ms[PROFILE_EDITOR_RENDER]);
+    snprintf(lines[2], sizeof(lines[2]), "%s %.2f  %s %.2f",
+        section_names[PROFILE_FONT_RENDER_LINE], last->section_ms[PROFILE_FONT_RENDER_LINE],
+        section_names[PROFILE_RENDERER_FLUSH], last->section_ms[PROFILE_RENDERER_FLUSH]);
+    snprintf(lines[3], sizeof(lines[3]), "draws %zu  vertices %zu  %.1f KB",
+        last->draw_calls, last->vertices, last->bytes / 1024.0);
+    snprintf(lines[4], sizeof(lines[4]), "shape hits %zu  misses %zu  %s %.2f",
+        last->shape_hits, last->shape_misses,
+        section_names[PROFILE_SHAPE], last->section_ms[PROFILE_SHAPE]);
+    snprintf(lines[5], sizeof(lines[5]), "input events %zu  latency %.1f ms",
+        last->input_events, last->input_latency_ms);
+
+    float line_height = font_line_height(font);
+    float width = 0.0f;
+    for(size_t i = 0; i < HUD_LINES; ++i) {
+        float w = font_calculate_width(font, lines[i], strlen(lines[i]));
+        if(w > width)
+            width = w;
+    }
+    float height = HUD_LINES * line_height + PROFILER_GRAPH_HEIGHT + 3 * HUD_PADDING;
+    width += 2 * HUD_PADDING;
+    Vec2f origin = vec2f(renderer->resolution.x - width, 0.0f);
+
+    // The overlay is drawn in screen space
+    Vec2f scroll_pos = renderer->scroll_pos;
+    renderer->scroll_pos = vec2f(0.0f, 0.0f);
+
+    renderer_set_shader(renderer, SHADER_SOLID);
+    renderer_solid_rect(renderer, origin, vec2f(width, height), HUD_BACKGROUND_COLOR);
+
+    float bar_width = (width - 2 * HUD_PADDING) / PROFILER_GRAPH_FRAMES;
+    float graph_bottom = height - HUD_PADDING;
+    for(size_t i = 0; i < minul(profiler.frame_count, PROFILER_GRAPH_FRAMES); ++i) {
+        double ms = profiler_frame_back(i)->cpu_ms;
+        float bar_height = (float) ms * PROFILER_GRAPH_MS_SCALE;
+        if(bar_height > PROFILER_GRAPH_HEIGHT)
+            bar_height = PROFILER_GRAPH_HEIGHT;
+        renderer_solid_rect(
+            renderer,
+            vec2f(origin.x + width - HUD_PADDING - (i + 1) * bar_width, graph_bottom - bar_height),
+            vec2f(bar_width, bar_height),
+            ms > HUD_SLOW_FRAME_MS ? HUD_SLOW_BAR_COLOR : HUD_BAR_COLOR
+        );
+    }
+    renderer_flush(renderer);
+
+    for(size_t i = 0; i < HUD_LINES; ++i)
+        font_render_line(
+            font, renderer, lines[i], strlen(lines[i]),
+            vec2f(origin.x + HUD_PADDING, HUD_PADDING + (i + 1) * line_height),
+            HUD_TEXT_COLOR
+        );
+
+    renderer->scroll_pos = scroll_pos;
+}
+
+bool profiler_dump_csv(const char *filepath) {
+    FILE *fp = fopen(filepath, "w");
+    if(!fp) {
+        fprintf(stderr, "Error: Failed to open file %s for writing\n", filepath);
+        perror("fopen");
+        return false;
+    }
+
+    fprintf(fp, "frame,cpu_ms,gpu_ms");
+    for(size_t s = 0; s < COUNT_PROFILE_SECTIONS; ++s)
+        fprintf(fp, ",%s_ms", section_names[s]);
+    fprintf(fp, ",draw_calls,vertices,bytes,shape_hits,shape_misses,input_events,input_latency_ms\n");
+
+    size_t n = minul(profiler.frame_count, PROFILER_HISTORY);
+    for(size_t frame = profiler.frame_count - n; frame < profiler.frame_count; ++frame) {
+        ProfileFrame *f = &profiler.history[frame % PROFILER_HISTORY];
+        fprintf(fp, "%zu,%.4f,%.4f", frame, f->cpu_ms, f->gpu_ms);
+        for(size_t s = 0; s < COUNT_PROFILE_SECTIONS; ++s)
+            fprintf(fp, ",%.4f", f->section_ms[s]);
+        fprintf(fp, ",%zu,%zu,%zu,%zu,%zu,%zu,%.1f\n", f->draw_calls, f->vertices, f->bytes,
+            f->shape_hits, f->shape_misses, f->input_events, f->input_latency_ms);
+    }
+
+    fclose(fp);
+    fprintf(stderr, "Profile of %zu frames written to %s\n", n, filepath);
+    return true;
+}
+
+void profiler_destroy(void) {
+    if(profiler.queries_created)
+        glDeleteQueries(PROFILER_GPU_QUERIES, profiler.queries);
+    profiler.queries_created = false;
+}
@@ -0,0 +1,77 @@
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <SDL2/SDL.h>
+
+#include "./font.h"
+#include "./renderer.h"
+
+// Opt-in frame instrumentation (F3 toggles the overlay, F4 dumps a CSV).
+// All hooks return immediately while the profiler is disabled.
+
+#define PROFILER_HISTORY 1024
+#define PROFILER_CSV_PATH "te_profile.csv"
+// Set to enable the profiler at startup
+#define PROFILER_ENV "TE_PROFILE"
+
+typedef enum {
+    PROFILE_INPUT = 0,
+    PROFILE_EDITOR_RENDER,
+    PROFILE_FONT_RENDER_LINE,
+    PROFILE_RENDERER_FLUSH,
+    PROFILE_SHAPE,
+    COUNT_PROFILE_SECTIONS
+} ProfileSection;
+
+typedef struct {
+    double section_ms[COUNT_PROFILE_SECTIONS];
+    double cpu_ms;
+    double gpu_ms;
+    size_t draw_calls;
+    size_t vertices;
+    size_t bytes;
+    size_t shape_hits;
+    size_t shape_misses;
+    // Keystrokes applied since the last frame, and the time from the
+    // oldest of them to the buffer swap (-1 if there were none)
+    size_t input_events;
+    double input_latency_ms;
+} ProfileFrame;
+
+void profiler_init(void);
+
+void profiler_toggle(void);
+
+bool profiler_is_enabled(void);
+
+void profiler_section_begin(ProfileSection section);
+
+void profiler_section_end(ProfileSection section);
+
+void profiler_count_draw_call(void);
+
+void profiler_count_upload(size_t vertices);
+
+void profiler_count_shape(bool cache_hit);
+
+// timestamp is the SDL_GetTicks() time the event was queued at
+void profiler_count_input(Uint32 timestamp);
+
+// Forgets keystrokes that did not change anything on screen
+void profiler_discard_input(void);
+
+void profiler_begin_frame(void);
+
+void profiler_end_frame(void);
+
+// Draws the overlay in screen space on top of the current frame
+void profiler_render_hud(Font *font, Renderer *renderer);
+
+bool profiler_dump_csv(const char *filepath);
+
+void profiler_destroy(void);
+
+#endif // PROFILER_H_
@@ -1,11 +1,25 @@
 #include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <math.h>
 
 #include "renderer.h"
 #include "file.h"
+#include "profiler.h"
 
 #define VERT_SHADER_FILE_PATH "./shaders/simple.vert"
 
+#define VERTEX_RING_SIZE (VERTEX_RING_REGIONS * VERTEX_RING_REGION_SIZE)
+#define VERTEX_RING_BYTES (VERTEX_RING_SIZE * sizeof(Vertex))
+
+#define CLEAR_COLOR 0.95f, 0.95f, 0.95f, 1.0f
+
+// Set to force the orphaning fallback even when persistent mapping is available
+#define NO_PERSISTENT_MAP_ENV "TE_NO_PERSISTENT_MAP"
+
 typedef struct {
     Uniform id;
     const char *name;
@@ -16,15 +30,28 @@ static const UniformInfo uniform_info[COUNT_UNIFORMS] = {
         .id = UNIFORM_RESOLUTION,
         .name = "resolution"
     },
-    [UNIFORM_SCROLL_POS] = {
-        .id = UNIFORM_SCROLL_POS,
-        .name = "scroll_pos"
+    [UNIFORM_ORIGIN] = {
+        .id = UNIFORM_ORIGIN,
+        .name = "origin"
+    },
+    [UNIFORM_EXTENT] = {
+        .id = UNIFORM_EXTENT,
+        .name = "extent"
     }
 };
 
 static const char *fragment_shader_paths[COUNT_SHADERS] = {
     [SHADER_SOLID] = "./shaders/simple_color.frag",
     [SHADER_TEXT] = "./shaders/simple_text.frag",
+    [SHADER_MINIMAP] = "./shaders/simple_minimap.frag",
+    [SHADER_SELECTION] = "./shaders/simple_selection.frag",
+};
+
+// Texture unit of the "image" sampler of every shader
+static const GLint sampler_units[COUNT_SHADERS] = {
+    [SHADER_TEXT] = 0,
+    [SHADER_MINIMAP] = RENDERER_MINIMAP_TEXTURE_UNIT,
+    [SHADER_SELECTION] = RENDERER_SELECTION_TEXTURE_UNIT,
 };
 
 bool compile_shader(
@@ -72,24 +99,86 @@ bool link_program(GLuint program) {
     return success;
 }
 
-bool renderer_init(Renderer *renderer) {
-    *renderer = (Renderer) {0};
-    renderer->vertices_count = 0;
-    renderer->scale = 2.0f;
-    renderer->resolution = vec2f(1.0f, 1.0f);
+static void renderer_ring_init(Renderer *renderer) {
+    if(GLEW_ARB_buffer_storage && !getenv(NO_PERSISTENT_MAP_ENV)) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, VERTEX_RING_BYTES, NULL, flags);
+        renderer->ring_mapped = (Vertex *) glMapBufferRange(
+            GL_ARRAY_BUFFER, 0, VERTEX_RING_BYTES, flags
+        );
+        if(renderer->ring_mapped)
+            return;
+
+        // Buffer storage is immutable, start over with a fresh name
+        fprintf(stderr, "WARNING: Persistent mapping failed, falling back to buffer orphaning.\n");
+        glDeleteBuffers(1, &renderer->vbo);
+        glGenBuffers(1, &renderer->vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, renderer->vbo);
+    }
+    glBufferData(GL_ARRAY_BUFFER, VERTEX_RING_BYTES, NULL, GL_STREAM_DRAW);
+}
 
-    glGenVertexArrays(1, &renderer->vao);
-    glBindVertexArray(renderer->vao);
+static void renderer_ring_wait(GLsync fence) {
+    GLenum status;
+    do {
+        status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+    } while(status == GL_TIMEOUT_EXPIRED);
+    glDeleteSync(fence);
+}
 
-    glGenBuffers(1, &renderer->vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, renderer->vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(renderer->vertices), renderer->vertices, GL_DYNAMIC_DRAW);
+// Move the writer to the next region, fencing the one it leaves
+static void renderer_ring_advance(Renderer *renderer) {
+    if(renderer->ring_mapped)
+        renderer->ring_fences[renderer->ring_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    renderer->ring_region = (renderer->ring_region + 1) % VERTEX_RING_REGIONS;
+    renderer->ring_offset = renderer->ring_region * VERTEX_RING_REGION_SIZE;
 
+    if(renderer->ring_mapped) {
+        GLsync fence = renderer->ring_fences[renderer->ring_region];
+        if(fence)
+            renderer_ring_wait(fence);
+        renderer->ring_fences[renderer->ring_region] = NULL;
+    }
+    else if(!renderer->ring_region) {
+        // Orphan the storage on wrap-around, the driver hands out a fresh
+        // allocation while pending draws keep using the old one
+        glBufferData(GL_ARRAY_BUFFER, VERTEX_RING_BYTES, NULL, GL_STREAM_DRAW);
+    }
+}
+
+static void renderer_ring_upload(Renderer *renderer) {
+    size_t count = renderer->vertices_count;
+    size_t region_end = (renderer->ring_region + 1) * VERTEX_RING_REGION_SIZE;
+    if(renderer->ring_offset + count > region_end)
+        renderer_ring_advance(renderer);
+
+    if(renderer->ring_mapped) {
+        memcpy(renderer->ring_mapped + renderer->ring_offset, renderer->vertices, count * sizeof(Vertex));
+    }
+    else {
+        void *dest = glMapBufferRange(
+            GL_ARRAY_BUFFER,
+            renderer->ring_offset * sizeof(Vertex),
+            count * sizeof(Vertex),
+            GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT
+        );
+        if(dest) {
+            memcpy(dest, renderer->vertices, count * sizeof(Vertex));
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        }
+    }
+
+    renderer->draw_first = renderer->ring_offset;
+    renderer->ring_offset += count;
+}
+
+void renderer_bind_vertex_format(void) {
     glEnableVertexAttribArray(VERTEX_ATTR_POSITION);
     glVertexAttribPointer(
         VERTEX_ATTR_POSITION,
         2,
-        GL_FLOAT,
+        GL_SHORT,
         GL_FALSE,
         sizeof(Vertex),
         (GLvoid *) offsetof(Vertex, position)
@@ -99,8 +188,8 @@ bool renderer_init(Renderer *renderer) {
     glVertexAttribPointer(
         VERTEX_ATTR_UV,
         2,
-        GL_FLOAT,
-        GL_FALSE,
+        GL_UNSIGNED_SHORT,
+        GL_TRUE,
         sizeof(Vertex),
         (GLvoid *) offsetof(Vertex, uv)
     );
@@ -109,12 +198,40 @@ bool renderer_init(Renderer *renderer) {
     glVertexAttribPointer(
         VERTEX_ATTR_COLOR,
         4,
-        GL_FLOAT,
-        GL_FALSE,
+        GL_UNSIGNED_BYTE,
+        GL_TRUE,
         sizeof(Vertex),
         (GLvoid *) offsetof(Vertex, color)
     );
 
+    glEnableVertexAttribArray(VERTEX_ATTR_LAYER);
+    glVertexAttribIPointer(
+        VERTEX_ATTR_LAYER,
+        1,
+        GL_UNSIGNED_BYTE,
+        sizeof(Vertex),
+        (GLvoid *) offsetof(Vertex, layer)
+    );
+}
+
+bool renderer_init(Renderer *renderer) {
+    *renderer = (Renderer) {0};
+    renderer->vertices_count = 0;
+    renderer->batch_origin = vec2f(0.0f, 0.0f);
+    renderer->resolution = vec2f(1.0f, 1.0f);
+
+    glGenVertexArrays(1, &renderer->vao);
+    glBindVertexArray(renderer->vao);
+
+    glGenBuffers(1, &renderer->vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, renderer->vbo);
+    renderer_ring_init(renderer);
+
+    glGenFramebuffers(1, &renderer->frame_fbo);
+    glGenRenderbuffers(1, &renderer->frame_rbo);
+
+    renderer_bind_vertex_format();
+
     GLuint vert_shader, frag_shader;
     if(!compile_shader(VERT_SHADER_FILE_PATH, GL_VERTEX_SHADER, &vert_shader)) {
         return false;
@@ -137,6 +254,11 @@ bool renderer_init(Renderer *renderer) {
         glDeleteShader(frag_shader);
     }
     glDeleteShader(vert_shader);
+
+    for(int i = 0; i < COUNT_SHADERS; ++i) {
+        glUseProgram(renderer->programs[i]);
+        glUniform1i(glGetUniformLocation(renderer->programs[i], "image"), sampler_units[i]);
+    }
     
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -144,6 +266,32 @@ bool renderer_init(Renderer *renderer) {
     return true;
 }
 
+static GLshort renderer_pack_position(float p, float origin) {
+    float v = roundf((p - origin) * VERTEX_POSITION_SUBPIXELS);
+    if(v < INT16_MIN) v = INT16_MIN;
+    if(v > INT16_MAX) v = INT16_MAX;
+    return (GLshort) v;
+}
+
+static GLushort renderer_pack_unorm16(float f) {
+    if(f < 0.0f) f = 0.0f;
+    if(f > 1.0f) f = 1.0f;
+    return (GLushort) (f * UINT16_MAX + 0.5f);
+}
+
+static GLubyte renderer_pack_unorm8(float f) {
+    if(f < 0.0f) f = 0.0f;
+    if(f > 1.0f) f = 1.0f;
+    return (GLubyte) (f * UINT8_MAX + 0.5f);
+}
+
+// Whether p can be stored relative to the current batch origin without clamping
+static bool renderer_fits_batch(Renderer *renderer, Vec2f p) {
+    float x = (p.x - renderer->batch_origin.x) * VERTEX_POSITION_SUBPIXELS;
+    float y = (p.y - renderer->batch_origin.y) * VERTEX_POSITION_SUBPIXELS;
+    return x >= INT16_MIN && x <= INT16_MAX && y >= INT16_MIN && y <= INT16_MAX;
+}
+
 void renderer_vertex(
     Renderer *renderer,
     Vec2f p, Vec4f c, Vec2f uv
@@ -152,9 +300,16 @@ void renderer_vertex(
     
     Vertex *new = &renderer->vertices[renderer->vertices_count++];
     *new = (Vertex) {
-        .position = p,
-        .uv = uv,
-        .color = c
+        .position = {
+            renderer_pack_position(p.x, renderer->batch_origin.x),
+            renderer_pack_position(p.y, renderer->batch_origin.y)
+        },
+        .uv = { renderer_pack_unorm16(uv.x), renderer_pack_unorm16(uv.y) },
+        .color = {
+            renderer_pack_unorm8(c.x), renderer_pack_unorm8(c.y),
+            renderer_pack_unorm8(c.z), renderer_pack_unorm8(c.w)
+        },
+        .layer = renderer->texture_layer
     };
 }
 
@@ -165,6 +320,18 @@ void renderer_triangle(
     Vec4f c0, Vec4f c1, Vec4f c2,
     Vec2f uv0, Vec2f uv1, Vec2f uv2
 ) {
+    // Start a new batch when the buffer is full or the triangle is out of the
+    // int16 range around the current origin (very long lines / documents)
+    if(renderer->vertices_count && (
+        renderer->vertices_count + 3 > VERTEX_BUFFER_SIZE ||
+        !renderer_fits_batch(renderer, p0) ||
+        !renderer_fits_batch(renderer, p1) ||
+        !renderer_fits_batch(renderer, p2)
+    ))
+        renderer_flush(renderer);
+    if(!renderer->vertices_count)
+        renderer->batch_origin = vec2f(floorf(p0.x), floorf(p0.y));
+
     renderer_vertex(renderer, p0, c0, uv0);
     renderer_vertex(renderer, p1, c1, uv1);
     renderer_vertex(renderer, p2, c2, uv2);
@@ -208,8 +375,10 @@ void renderer_textured_rect(
     Vec2f size,
     Vec2f uv_position,
     Vec2f uv_size,
+    GLubyte layer,
     Vec4f color
 ) {
+    renderer->texture_layer = layer;
     renderer_quad(
         renderer,
         
@@ -225,6 +394,7 @@ void renderer_textured_rect(
         (Vec2f) {uv_position.x, uv_position.y + uv_size.y},
         (Vec2f) {uv_position.x + uv_size.x, uv_position.y + uv_size.y}
     );
+    renderer->texture_layer = 0;
 }
 
 void renderer_set_resolution(Renderer *renderer, int width, int height) {
@@ -232,34 +402,108 @@ void renderer_set_resolution(Renderer *renderer, int width, int height) {
     renderer->resolution.y = (float) height;
 }
 
+static void renderer_resize_frame(Renderer *renderer, int width, int height) {
+    glBindRenderbuffer(GL_RENDERBUFFER, renderer->frame_rbo);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, renderer->frame_fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderer->frame_rbo);
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        fprintf(stderr, "Error: Offscreen framebuffer is incomplete\n");
+
+    renderer->frame_width = width;
+    renderer->frame_height = height;
+}
+
+void renderer_begin_frame(Renderer *renderer, float top, float bottom) {
+    int width = (int) renderer->resolution.x;
+    int height = (int) renderer->resolution.y;
+
+    // A resized frame has no valid contents, redraw it whole
+    if(width != renderer->frame_width || height != renderer->frame_height) {
+        renderer_resize_frame(renderer, width, height);
+        top = 0.0f;
+        bottom = renderer->resolution.y;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, renderer->frame_fbo);
+    glViewport(0, 0, width, height);
+
+    if(top < 0.0f) top = 0.0f;
+    if(bottom > renderer->resolution.y) bottom = renderer->resolution.y;
+    int scissor_top = (int) floorf(top);
+    int scissor_bottom = (int) ceilf(bottom);
+    if(scissor_bottom < scissor_top)
+        scissor_bottom = scissor_top;
+
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(0, height - scissor_bottom, width, scissor_bottom - scissor_top);
+
+    glClearColor(CLEAR_COLOR);
+    glClear(GL_COLOR_BUFFER_BIT);
+}
+
+void renderer_end_frame(Renderer *renderer) {
+    glDisable(GL_SCISSOR_TEST);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, renderer->frame_fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(
+        0, 0, renderer->frame_width, renderer->frame_height,
+        0, 0, renderer->frame_width, renderer->frame_height,
+        GL_COLOR_BUFFER_BIT, GL_NEAREST
+    );
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
 void renderer_set_shader(Renderer *renderer, Shader shader) {
     glUseProgram(renderer->programs[shader]);
     for(Uniform u = 0; u < COUNT_UNIFORMS; ++u) {
         renderer->uniforms[u] = glGetUniformLocation(
-            renderer->programs[renderer->current_shader],
+            renderer->programs[shader],
             uniform_info[u].name
         );
     }
     glUniform2f(renderer->uniforms[UNIFORM_RESOLUTION], renderer->resolution.x, renderer->resolution.y);
-    glUniform2f(renderer->uniforms[UNIFORM_SCROLL_POS], renderer->scroll_pos.x, renderer->scroll_pos.y);
     renderer->current_shader = shader;
 }
 
 void renderer_flush(Renderer *renderer) {
-    glBufferSubData(
-        GL_ARRAY_BUFFER,
-        0,
-        renderer->vertices_count * sizeof(Vertex),
-        renderer->vertices
+    if(!renderer->vertices_count)
+        return;
+    profiler_section_begin(PROFILE_RENDERER_FLUSH);
+
+    // The origin is made relative to the scroll position on the CPU so the
+    // shader never has to subtract two large floats
+    glUniform2f(
+        renderer->uniforms[UNIFORM_ORIGIN],
+        renderer->batch_origin.x - renderer->scroll_pos.x,
+        renderer->batch_origin.y - renderer->scroll_pos.y
     );
+    renderer_ring_upload(renderer);
     renderer_draw(renderer);
+    profiler_count_upload(renderer->vertices_count);
+    profiler_count_draw_call();
     renderer->vertices_count = 0;
+    ++renderer->draw_calls;
+    profiler_section_end(PROFILE_RENDERER_FLUSH);
 }
 
 void renderer_draw(Renderer *renderer) {
-    glDrawArrays(GL_TRIANGLES, 0, renderer->vertices_count);
+    glDrawArrays(GL_TRIANGLES, renderer->draw_first, renderer->vertices_count);
 }
 
 void renderer_destroy(Renderer *renderer) {
-    (void) renderer;
+    for(size_t i = 0; i < VERTEX_RING_REGIONS; ++i)
+        if(renderer->ring_fences[i])
+            glDeleteSync(renderer->ring_fences[i]);
+
+    glBindBuffer(GL_ARRAY_BUFFER, renderer->vbo);
+    if(renderer->ring_mapped)
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    glDeleteBuffers(1, &renderer->vbo);
+    glDeleteVertexArrays(1, &renderer->vao);
+
+    glDeleteRenderbuffers(1, &renderer->frame_rbo);
+    glDeleteFramebuffers(1, &renderer->frame_fbo);
 }
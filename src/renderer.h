@@ -9,47 +9,91 @@
 typedef enum {
     SHADER_TEXT = 0,
     SHADER_SOLID,
+    SHADER_MINIMAP,
+    SHADER_SELECTION,
     COUNT_SHADERS
 } Shader;
 
+// Texture units the shaders sample their 2D textures from, the glyph atlas
+// stays bound to unit 0
+#define RENDERER_MINIMAP_TEXTURE_UNIT 1
+#define RENDERER_SELECTION_TEXTURE_UNIT 2
+
+// Packed vertex (16 bytes). Positions are fixed-point offsets from the
+// batch origin, UVs and colors are normalized integers, layer selects the
+// page of the glyph atlas.
 typedef struct {
-    Vec2f position;
-    Vec2f uv;
-    Vec4f color;
+    GLshort position[2];
+    GLushort uv[2];
+    GLubyte color[4];
+    GLubyte layer;
+    GLubyte padding[3];
 } Vertex;
 
 #define VERTEX_BUFFER_SIZE (3*10000)
 
+// Vertices are streamed into a ring of regions. Each region is fenced once the
+// writer moves past it, so the CPU never overwrites data the GPU still reads.
+#define VERTEX_RING_REGIONS 4
+#define VERTEX_RING_REGION_SIZE (4*VERTEX_BUFFER_SIZE)
+
+// Sub-pixel steps per pixel of Vertex.position, must match simple.vert.
+// With int16 storage this leaves +-8191 px of reach around the batch origin.
+#define VERTEX_POSITION_SUBPIXELS 4
+
 typedef enum {
     VERTEX_ATTR_POSITION = 0,
     VERTEX_ATTR_UV,
     VERTEX_ATTR_COLOR,
+    VERTEX_ATTR_LAYER,
 } VertexAttr;
 
 typedef enum {
     UNIFORM_RESOLUTION,
-    UNIFORM_SCROLL_POS,
+    UNIFORM_ORIGIN,
+    UNIFORM_EXTENT,
     COUNT_UNIFORMS
 } Uniform;
 
 typedef struct {
     GLuint vao;
     GLuint vbo;
+
+    // Persistently mapped ring (ARB_buffer_storage), NULL when the driver
+    // lacks it and the ring is streamed via orphaning instead
+    Vertex *ring_mapped;
+    GLsync ring_fences[VERTEX_RING_REGIONS];
+    size_t ring_region;
+    size_t ring_offset;
+    size_t draw_first;
+
     GLuint programs[COUNT_SHADERS];
     Shader current_shader;
 
     Vertex vertices[VERTEX_BUFFER_SIZE];
     size_t vertices_count;
+    Vec2f batch_origin;
+    GLubyte texture_layer;
+    size_t draw_calls;
 
     GLint uniforms[COUNT_UNIFORMS];
 
+    // Frames are drawn into an offscreen framebuffer that keeps its contents,
+    // so only the damaged part has to be redrawn before it is blitted out
+    GLuint frame_fbo;
+    GLuint frame_rbo;
+    int frame_width;
+    int frame_height;
+
     Vec2f resolution;
     Vec2f scroll_pos;
-    float scale;
 } Renderer;
 
 bool renderer_init(Renderer *renderer);
 
+// Sets up the Vertex attribute layout for the bound VAO and GL_ARRAY_BUFFER
+void renderer_bind_vertex_format(void);
+
 void renderer_vertex(
     Renderer *renderer,
     Vec2f p, Vec4f c, Vec2f uv
@@ -82,11 +126,18 @@ void renderer_textured_rect(
     Vec2f size,
     Vec2f uv_position,
     Vec2f uv_size,
+    GLubyte layer,
     Vec4f color
 );
 
 void renderer_set_resolution(Renderer *renderer, int width, int height);
 
+// Starts a frame that only touches screen rows [top, bottom), clearing them
+void renderer_begin_frame(Renderer *renderer, float top, float bottom);
+
+// Presents the offscreen frame into the default framebuffer
+void renderer_end_frame(Renderer *renderer);
+
 void renderer_set_shader(Renderer *renderer, Shader shader);
 
 void renderer_flush(Renderer *renderer);
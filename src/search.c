@@ -0,0 +1,565 @@
+#define _DEFAULT_SOURCE
+#include "./search.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "./utils.h"
+
+// How long an idle thread sleeps before looking for tasks again
+#define PROJECT_SEARCH_IDLE_MS 10
+// A file is checked for cancellation after every chunk of this size
+#define PROJECT_SEARCH_CHUNK_BYTES (4 << 20)
+// Files with a NUL byte this close to the start are taken for binary
+#define PROJECT_SEARCH_BINARY_PROBE 8192
+// The panel is refreshed at least every this many files
+#define PROJECT_SEARCH_PROGRESS_FILES 4096
+
+#define PROJECT_SEARCH_PADDING 8.0f
+#define PROJECT_SEARCH_WIDTH_RATIO 0.8f
+#define PROJECT_SEARCH_TEXT_COLOR vec4f(1.0f, 1.0f, 1.0f, 1.0f)
+#define PROJECT_SEARCH_STATUS_COLOR vec4f(0.6f, 0.6f, 0.6f, 1.0f)
+#define PROJECT_SEARCH_BACKGROUND_COLOR vec4f(0.0f, 0.0f, 0.0f, 0.85f)
+#define PROJECT_SEARCH_SELECTION_COLOR vec4f(0.25f, 0.35f, 0.55f, 1.0f)
+
+/* Queues */
+
+static void search_queue_push(SearchQueue *queue, const SearchTask *tasks, size_t count) {
+    SDL_LockMutex(queue->lock);
+    if(queue->end + count > queue->capacity && queue->start) {
+        memmove(queue->tasks, queue->tasks + queue->start, (queue->end - queue->start) * sizeof(SearchTask));
+        queue->end -= queue->start;
+        queue->start = 0;
+    }
+    if(queue->end + count > queue->capacity) {
+        queue->capacity = (queue->end + count) * 2;
+        queue->tasks = (SearchTask *) realloc(queue->tasks, queue->capacity * sizeof(SearchTask));
+    }
+    memcpy(queue->tasks + queue->end, tasks, count * sizeof(SearchTask));
+    queue->end += count;
+    SDL_UnlockMutex(queue->lock);
+}
+
+static bool search_queue_take(SearchQueue *queue, bool newest, SearchTask *task) {
+    SDL_LockMutex(queue->lock);
+    bool taken = queue->start < queue->end;
+    if(taken)
+        *task = newest ? queue->tasks[--queue->end] : queue->tasks[queue->start++];
+    if(queue->start == queue->end)
+        queue->start = queue->end = 0;
+    SDL_UnlockMutex(queue->lock);
+    return taken;
+}
+
+static void search_queue_clear(SearchQueue *queue) {
+    for(size_t i = queue->start; i < queue->end; ++i)
+        free(queue->tasks[i].path);
+    queue->start = queue->end = 0;
+}
+
+/* Matching */
+
+// First occurrence of needle in haystack. With SSE2, 16 positions are
+// tested at once for the first and last byte of needle and only those
+// passing both are compared in full.
+static const char *project_search_find(const char *haystack, size_t length, const char *needle, size_t needle_length) {
+    if(needle_length > length)
+        return NULL;
+    size_t last = length - needle_length;
+    size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i final = _mm_set1_epi8(needle[needle_length - 1]);
+    for(; i + 15 <= last; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (haystack + i));
+        __m128i b = _mm_loadu_si128((const __m128i *) (haystack + i + needle_length - 1));
+        unsigned int mask = (unsigned int) _mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, final))
+        );
+        for(; mask; mask &= mask - 1) {
+            size_t at = i + (size_t) __builtin_ctz(mask);
+            if(!memcmp(haystack + at, needle, needle_length))
+                return haystack + at;
+        }
+    }
+#endif
+
+    // The tail, or everything without SSE2
+    while(i <= last) {
+        const char *c = (const char *) memchr(haystack + i, needle[0], last - i + 1);
+        if(!c)
+            return NULL;
+        if(!memcmp(c, needle, needle_length))
+            return c;
+        i = (size_t) (c - haystack) + 1;
+    }
+    return NULL;
+}
+
+/* Threads */
+
+static void project_search_post_change(ProjectSearch *ps) {
+    if(!SDL_AtomicCAS(&ps->event_queued, 0, 1))
+        return;
+    SDL_Event event = { .type = ps->changed_event };
+    event.user.data1 = ps;
+    if(SDL_PushEvent(&event) <= 0)
+        SDL_AtomicSet(&ps->event_queued, 0);
+}
+
+static void project_search_wake_all(ProjectSearch *ps) {
+    SDL_LockMutex(ps->idle_lock);
+    SDL_CondBroadcast(ps->work);
+    SDL_UnlockMutex(ps->idle_lock);
+}
+
+static void project_search_add_hits(ProjectSearch *ps, SearchHit *hits, size_t count) {
+    SDL_LockMutex(ps->lock);
+    size_t room = PROJECT_SEARCH_MAX_HITS - ps->hits_count;
+    bool full = count >= room;
+    if(full) {
+        ps->truncated = true;
+        SDL_AtomicSet(&ps->cancelled, 1);
+        SDL_AtomicSet(&ps->done, 1);
+    }
+    size_t kept = minul(count, room);
+    if(ps->hits_count + kept > ps->hits_capacity) {
+        while(ps->hits_count + kept > ps->hits_capacity)
+            ps->hits_capacity = maxul(ps->hits_capacity * 2, 256);
+        ps->hits = (SearchHit *) realloc(ps->hits, ps->hits_capacity * sizeof(SearchHit));
+    }
+    memcpy(ps->hits + ps->hits_count, hits, kept * sizeof(SearchHit));
+    ps->hits_count += kept;
+    SDL_UnlockMutex(ps->lock);
+
+    for(size_t i = kept; i < count; ++i) {
+        free(hits[i].path);
+        free(hits[i].preview);
+    }
+    if(full)
+        project_search_wake_all(ps);
+    project_search_post_change(ps);
+}
+
+// Queues the subdirectories and files of a directory on the own queue
+static void project_search_dir(ProjectSearch *ps, SearchQueue *own, const SearchTask *task) {
+    IgnoreRules *loaded = NULL;
+    const IgnoreRules *rules = ignore_rules_load(&loaded, task->rules, ps->root, task->path);
+    if(loaded) {
+        SDL_LockMutex(ps->lock);
+        loaded->next = ps->rules;
+        ps->rules = loaded;
+        SDL_UnlockMutex(ps->lock);
+    }
+
+    char *full_path = utils_path_join(ps->root, task->path);
+    DIR *d = opendir(full_path);
+    SearchTask *tasks = NULL;
+    size_t count = 0, capacity = 0;
+
+    struct dirent *entry;
+    while(d && !SDL_AtomicGet(&ps->cancelled) && (entry = readdir(d))) {
+        const char *name = entry->d_name;
+        if(!strcmp(name, ".") || !strcmp(name, "..") || !strcmp(name, ".git"))
+            continue;
+
+        // Symbolic links are left out, they could lead in circles
+        unsigned char type = entry->d_type;
+        if(type == DT_UNKNOWN) {
+            struct stat st;
+            char *entry_path = utils_path_join(full_path, name);
+            type = lstat(entry_path, &st) < 0 ? DT_UNKNOWN
+                : S_ISDIR(st.st_mode) ? DT_DIR
+                : S_ISREG(st.st_mode) ? DT_REG
+                : DT_UNKNOWN;
+            free(entry_path);
+        }
+        if(type != DT_DIR && type != DT_REG)
+            continue;
+
+        char *path = utils_path_join(task->path, name);
+        if(ignore_rules_match(rules, path, type == DT_DIR)) {
+            free(path);
+            continue;
+        }
+        if(count == capacity) {
+            capacity = capacity * 2 + 64;
+            tasks = (SearchTask *) realloc(tasks, capacity * sizeof(SearchTask));
+        }
+        tasks[count++] = (SearchTask) { .path = path, .is_dir = type == DT_DIR, .rules = rules };
+    }
+    if(d)
+        closedir(d);
+    free(full_path);
+
+    if(count) {
+        SDL_AtomicAdd(&ps->pending, (int) count);
+        search_queue_push(own, tasks, count);
+        project_search_wake_all(ps);
+    }
+    free(tasks);
+}
+
+static void project_search_file(ProjectSearch *ps, const SearchTask *task) {
+    char *full_path = utils_path_join(ps->root, task->path);
+    int fd = open(full_path, O_RDONLY | O_CLOEXEC);
+    free(full_path);
+    if(fd < 0)
+        return;
+
+    struct stat st;
+    if(fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || !st.st_size) {
+        close(fd);
+        return;
+    }
+    size_t size = (size_t) st.st_size;
+    void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED)
+        return;
+    madvise(mapping, size, MADV_SEQUENTIAL);
+    const char *data = (const char *) mapping;
+
+    SearchHit *hits = NULL;
+    size_t hits_count = 0, hits_capacity = 0;
+    if(memchr(data, 0, minul(size, PROJECT_SEARCH_BINARY_PROBE)))
+        goto done;
+
+    // Newlines are counted up to counted, the line holding it starts at
+    // line_start
+    size_t row = 0, counted = 0, line_start = 0;
+    size_t pos = 0;
+    while(pos + ps->needle_length <= size && !SDL_AtomicGet(&ps->cancelled)) {
+        size_t window_end = minul(size, pos + PROJECT_SEARCH_CHUNK_BYTES + ps->needle_length - 1);
+        const char *found = project_search_find(data + pos, window_end - pos, ps->needle, ps->needle_length);
+        if(!found) {
+            pos = window_end - ps->needle_length + 1;
+            continue;
+        }
+
+        size_t at = (size_t) (found - data);
+        const char *newline;
+        while((newline = (const char *) memchr(data + counted, '\n', at - counted))) {
+            ++row;
+            counted = line_start = (size_t) (newline - data) + 1;
+        }
+        counted = at;
+
+        const char *line_end = (const char *) memchr(data + at, '\n', size - at);
+        size_t end = line_end ? (size_t) (line_end - data) : size;
+        size_t preview_start = line_start;
+        while(preview_start < at && (data[preview_start] == ' ' || data[preview_start] == '\t'))
+            ++preview_start;
+        size_t preview_length = minul(end - preview_start, PROJECT_SEARCH_PREVIEW_BYTES);
+
+        if(hits_count == hits_capacity) {
+            hits_capacity = hits_capacity * 2 + 16;
+            hits = (SearchHit *) realloc(hits, hits_capacity * sizeof(SearchHit));
+        }
+        SearchHit *hit = &hits[hits_count++];
+        hit->path = strdup(task->path);
+        hit->row = row;
+        hit->col = at - line_start;
+        hit->preview = (char *) malloc(preview_length + 1);
+        memcpy(hit->preview, data + preview_start, preview_length);
+        hit->preview[preview_length] = 0;
+        hit->preview_length = preview_length;
+
+        // One hit per line
+        pos = end;
+    }
+
+done:
+    munmap(mapping, size);
+    if(hits_count)
+        project_search_add_hits(ps, hits, hits_count);
+    free(hits);
+    if(SDL_AtomicAdd(&ps->files_searched, 1) % PROJECT_SEARCH_PROGRESS_FILES == 0)
+        project_search_post_change(ps);
+}
+
+static int project_search_worker(void *data) {
+    SearchQueue *own = (SearchQueue *) data;
+    ProjectSearch *ps = own->search;
+    size_t index = (size_t) (own - ps->queues);
+
+    SearchTask task;
+    while(!SDL_AtomicGet(&ps->cancelled)) {
+        // Newest own task first, which keeps to one part of the tree, else
+        // the oldest task of another thread, which is the biggest piece
+        bool found = search_queue_take(own, true, &task);
+        for(size_t k = 1; !found && k < ps->thread_count; ++k)
+            found = search_queue_take(&ps->queues[(index + k) % ps->thread_count], false, &task);
+        if(!found) {
+            if(!SDL_AtomicGet(&ps->pending))
+                break;
+            SDL_LockMutex(ps->idle_lock);
+            SDL_CondWaitTimeout(ps->work, ps->idle_lock, PROJECT_SEARCH_IDLE_MS);
+            SDL_UnlockMutex(ps->idle_lock);
+            continue;
+        }
+
+        if(task.is_dir)
+            project_search_dir(ps, own, &task);
+        else
+            project_search_file(ps, &task);
+        free(task.path);
+
+        if(SDL_AtomicAdd(&ps->pending, -1) == 1) {
+            SDL_AtomicSet(&ps->done, 1);
+            project_search_wake_all(ps);
+            project_search_post_change(ps);
+        }
+    }
+    return 0;
+}
+
+/* Searches */
+
+static void project_search_stop(ProjectSearch *ps) {
+    SDL_AtomicSet(&ps->cancelled, 1);
+    project_search_wake_all(ps);
+    for(size_t i = 0; i < ps->thread_count; ++i)
+        SDL_WaitThread(ps->threads[i], NULL);
+    ps->thread_count = 0;
+    for(size_t i = 0; i < PROJECT_SEARCH_MAX_THREADS; ++i)
+        search_queue_clear(&ps->queues[i]);
+}
+
+static void project_search_clear_hits(ProjectSearch *ps) {
+    for(size_t i = 0; i < ps->hits_count; ++i) {
+        free(ps->hits[i].path);
+        free(ps->hits[i].preview);
+    }
+    ps->hits_count = 0;
+    ps->truncated = false;
+}
+
+static void project_search_run(ProjectSearch *ps) {
+    project_search_stop(ps);
+    project_search_clear_hits(ps);
+    // No task is left that could use them
+    ignore_rules_free_list(ps->rules);
+    ps->rules = NULL;
+
+    memcpy(ps->needle, ps->query, ps->query_length);
+    ps->needle_length = ps->query_length;
+    ps->selected = ps->scroll = 0;
+    ps->dirty = true;
+    SDL_AtomicSet(&ps->cancelled, 0);
+    SDL_AtomicSet(&ps->files_searched, 0);
+    SDL_AtomicSet(&ps->done, 1);
+    if(!ps->needle_length || !ps->root)
+        return;
+
+    SDL_AtomicSet(&ps->done, 0);
+    SDL_AtomicSet(&ps->pending, 1);
+    SearchTask root = { .path = strdup(""), .is_dir = true, .rules = NULL };
+    search_queue_push(&ps->queues[0], &root, 1);
+
+    int cpus = SDL_GetCPUCount();
+    size_t threads = minul(cpus > 0 ? (size_t) cpus : 1, PROJECT_SEARCH_MAX_THREADS);
+    // The count is read by the threads to find each other's queues
+    ps->thread_count = threads;
+    for(size_t i = 0; i < threads; ++i) {
+        ps->threads[i] = SDL_CreateThread(project_search_worker, "project search", &ps->queues[i]);
+        if(!ps->threads[i]) {
+            fprintf(stderr, "Error: Could not start project search thread: %s\n", SDL_GetError());
+            // Those already running take over the tasks of the others
+            ps->thread_count = i;
+            break;
+        }
+    }
+    if(!ps->thread_count) {
+        search_queue_clear(&ps->queues[0]);
+        SDL_AtomicSet(&ps->done, 1);
+    }
+}
+
+bool project_search_init(ProjectSearch *ps) {
+    *ps = (ProjectSearch) {0};
+    ps->lock = SDL_CreateMutex();
+    ps->idle_lock = SDL_CreateMutex();
+    ps->work = SDL_CreateCond();
+    ps->changed_event = SDL_RegisterEvents(1);
+    if(!ps->lock || !ps->idle_lock || !ps->work || ps->changed_event == (Uint32) -1)
+        goto fail;
+    for(size_t i = 0; i < PROJECT_SEARCH_MAX_THREADS; ++i) {
+        ps->queues[i].search = ps;
+        if(!(ps->queues[i].lock = SDL_CreateMutex()))
+            goto fail;
+    }
+    SDL_AtomicSet(&ps->done, 1);
+    return true;
+fail:
+    fprintf(stderr, "Error: Could not set up project search: %s\n", SDL_GetError());
+    return false;
+}
+
+void project_search_toggle(ProjectSearch *ps) {
+    if(ps->open) {
+        project_search_close(ps);
+        return;
+    }
+
+    if(!ps->root) {
+        char cwd[PATH_MAX];
+        if(!getcwd(cwd, sizeof(cwd))) {
+            perror("getcwd");
+            return;
+        }
+        ps->root = strdup(cwd);
+    }
+    ps->open = true;
+    project_search_run(ps);
+}
+
+void project_search_close(ProjectSearch *ps) {
+    project_search_stop(ps);
+    ps->open = false;
+    ps->dirty = true;
+}
+
+void project_search_insert_text(ProjectSearch *ps, const char *text) {
+    size_t length = strlen(text);
+    if(ps->query_length + length > PROJECT_SEARCH_QUERY_CAPACITY)
+        return;
+    memcpy(ps->query + ps->query_length, text, length);
+    ps->query_length += length;
+    project_search_run(ps);
+}
+
+void project_search_delete_char(ProjectSearch *ps) {
+    if(!ps->query_length)
+        return;
+    // Back to the first byte of the last UTF-8 sequence
+    do {
+        --ps->query_length;
+    } while(ps->query_length && (ps->query[ps->query_length] & 0xC0) == 0x80);
+    project_search_run(ps);
+}
+
+void project_search_move_selection(ProjectSearch *ps, int delta) {
+    SDL_LockMutex(ps->lock);
+    size_t count = ps->hits_count;
+    SDL_UnlockMutex(ps->lock);
+    if(!count)
+        return;
+
+    if(delta < 0 && (size_t) -delta > ps->selected)
+        ps->selected = 0;
+    else
+        ps->selected = minul(ps->selected + delta, count - 1);
+    if(ps->selected < ps->scroll)
+        ps->scroll = ps->selected;
+    else if(ps->selected >= ps->scroll + PROJECT_SEARCH_VISIBLE_HITS)
+        ps->scroll = ps->selected + 1 - PROJECT_SEARCH_VISIBLE_HITS;
+    ps->dirty = true;
+}
+
+char *project_search_selected_hit(ProjectSearch *ps, size_t *row, size_t *col) {
+    char *path = NULL;
+    SDL_LockMutex(ps->lock);
+    if(ps->selected < ps->hits_count) {
+        SearchHit *hit = &ps->hits[ps->selected];
+        path = utils_path_join(ps->root, hit->path);
+        *row = hit->row;
+        *col = hit->col;
+    }
+    SDL_UnlockMutex(ps->lock);
+    return path;
+}
+
+bool project_search_handle_event(ProjectSearch *ps, SDL_Event *event) {
+    if(!ps->lock || event->type != ps->changed_event || event->user.data1 != ps)
+        return false;
+    SDL_AtomicSet(&ps->event_queued, 0);
+    if(ps->open)
+        ps->dirty = true;
+    return true;
+}
+
+void project_search_render(ProjectSearch *ps, Font *font, Renderer *renderer) {
+    if(!ps->open)
+        return;
+
+    // Copied out so the threads are not held up while the text is drawn
+    char lines[PROJECT_SEARCH_VISIBLE_HITS][512];
+    size_t lines_count = 0;
+    char status[96];
+    SDL_LockMutex(ps->lock);
+    for(size_t i = ps->scroll; i < ps->hits_count && lines_count < PROJECT_SEARCH_VISIBLE_HITS; ++i) {
+        SearchHit *hit = &ps->hits[i];
+        snprintf(lines[lines_count++], sizeof(lines[0]), "%s:%zu: %.*s",
+            hit->path, hit->row + 1, (int) hit->preview_length, hit->preview);
+    }
+    snprintf(status, sizeof(status), "%s%zu hits in %d files%s",
+        SDL_AtomicGet(&ps->done) ? "" : "searching... ",
+        ps->hits_count, SDL_AtomicGet(&ps->files_searched),
+        ps->truncated ? ", stopped at the limit" : "");
+    SDL_UnlockMutex(ps->lock);
+
+    float line_height = font_line_height(font);
+    float width = renderer->resolution.x * PROJECT_SEARCH_WIDTH_RATIO;
+    float height = (2 + lines_count) * line_height + 3 * PROJECT_SEARCH_PADDING;
+    Vec2f origin = vec2f((renderer->resolution.x - width) / 2.0f, 0.0f);
+
+    // The panel is drawn in screen space
+    Vec2f scroll_pos = renderer->scroll_pos;
+    renderer->scroll_pos = vec2f(0.0f, 0.0f);
+
+    renderer_set_shader(renderer, SHADER_SOLID);
+    renderer_solid_rect(renderer, origin, vec2f(width, height), PROJECT_SEARCH_BACKGROUND_COLOR);
+    if(ps->selected >= ps->scroll && ps->selected - ps->scroll < lines_count) {
+        float y = 2 * PROJECT_SEARCH_PADDING + (2 + ps->selected - ps->scroll) * line_height;
+        renderer_solid_rect(renderer, vec2f(origin.x, y), vec2f(width, line_height), PROJECT_SEARCH_SELECTION_COLOR);
+    }
+    renderer_flush(renderer);
+
+    char query[PROJECT_SEARCH_QUERY_CAPACITY + 6] = "find: ";
+    memcpy(query + 6, ps->query, ps->query_length);
+    float x = origin.x + PROJECT_SEARCH_PADDING;
+    font_render_line(font, renderer, query, ps->query_length + 6,
+        vec2f(x, PROJECT_SEARCH_PADDING + line_height), PROJECT_SEARCH_TEXT_COLOR);
+    font_render_line(font, renderer, status, strlen(status),
+        vec2f(x, PROJECT_SEARCH_PADDING + 2 * line_height), PROJECT_SEARCH_STATUS_COLOR);
+    for(size_t i = 0; i < lines_count; ++i)
+        font_render_line(
+            font, renderer, lines[i], strlen(lines[i]),
+            vec2f(x, 2 * PROJECT_SEARCH_PADDING + (i + 3) * line_height),
+            PROJECT_SEARCH_TEXT_COLOR
+        );
+
+    renderer->scroll_pos = scroll_pos;
+}
+
+void project_search_destroy(ProjectSearch *ps) {
+    project_search_stop(ps);
+    project_search_clear_hits(ps);
+    ignore_rules_free_list(ps->rules);
+    free(ps->hits);
+    free(ps->root);
+    for(size_t i = 0; i < PROJECT_SEARCH_MAX_THREADS; ++i) {
+        free(ps->queues[i].tasks);
+        if(ps->queues[i].lock)
+            SDL_DestroyMutex(ps->queues[i].lock);
+    }
+    if(ps->work)
+        SDL_DestroyCond(ps->work);
+    if(ps->idle_lock)
+        SDL_DestroyMutex(ps->idle_lock);
+    if(ps->lock)
+        SDL_DestroyMutex(ps->lock);
+}
@@ -0,0 +1,118 @@
+#ifndef SEARCH_H_
+#define SEARCH_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <SDL2/SDL.h>
+
+#include "./gitignore.h"
+#include "./font.h"
+#include "./renderer.h"
+
+// Find in project (Ctrl+Shift+F). Every keystroke cancels the running
+// search and starts a new one for the literal query. Threads with a queue
+// each walk the working directory (skipping what .gitignore excludes) and
+// search the files they find, an idle thread takes the oldest task of a
+// busy one. Hits are listed as they come in.
+
+#define PROJECT_SEARCH_QUERY_CAPACITY 256
+#define PROJECT_SEARCH_MAX_THREADS 8
+// The search stops after this many hits
+#define PROJECT_SEARCH_MAX_HITS 10000
+// Longest part of a line shown for a hit
+#define PROJECT_SEARCH_PREVIEW_BYTES 160
+#define PROJECT_SEARCH_VISIBLE_HITS 16
+
+typedef struct {
+    char *path; // relative to the root
+    size_t row;
+    size_t col;
+    char *preview;
+    size_t preview_length;
+} SearchHit;
+
+typedef struct {
+    char *path; // relative to the root, "" is the root itself
+    bool is_dir;
+    const IgnoreRules *rules;
+} SearchTask;
+
+struct ProjectSearch;
+
+// Tasks of one thread. The owner takes the newest, others the oldest.
+typedef struct {
+    struct ProjectSearch *search;
+    SDL_mutex *lock;
+    SearchTask *tasks;
+    size_t start;
+    size_t end;
+    size_t capacity;
+} SearchQueue;
+
+typedef struct ProjectSearch {
+    bool open;
+    // The panel changed since it was last drawn
+    bool dirty;
+
+    char query[PROJECT_SEARCH_QUERY_CAPACITY];
+    size_t query_length;
+    char *root;
+
+    // The running search. pending counts the tasks queued or being worked
+    // on, the search is done when it drops to 0.
+    char needle[PROJECT_SEARCH_QUERY_CAPACITY];
+    size_t needle_length;
+    SDL_atomic_t cancelled;
+    SDL_atomic_t pending;
+    SDL_atomic_t done;
+    SDL_atomic_t files_searched;
+    SearchQueue queues[PROJECT_SEARCH_MAX_THREADS];
+    SDL_Thread *threads[PROJECT_SEARCH_MAX_THREADS];
+    size_t thread_count;
+    // Idle threads wait here for new tasks
+    SDL_mutex *idle_lock;
+    SDL_cond *work;
+
+    // Filled by the threads, read under lock
+    SDL_mutex *lock;
+    SearchHit *hits;
+    size_t hits_count;
+    size_t hits_capacity;
+    bool truncated;
+    IgnoreRules *rules;
+
+    // Posted when there are new hits or the search is done, at most one is
+    // queued at a time
+    Uint32 changed_event;
+    SDL_atomic_t event_queued;
+
+    size_t selected;
+    size_t scroll;
+} ProjectSearch;
+
+bool project_search_init(ProjectSearch *ps);
+
+void project_search_toggle(ProjectSearch *ps);
+
+void project_search_close(ProjectSearch *ps);
+
+void project_search_insert_text(ProjectSearch *ps, const char *text);
+
+void project_search_delete_char(ProjectSearch *ps);
+
+void project_search_move_selection(ProjectSearch *ps, int delta);
+
+// Absolute path of the selected hit and where in the file it is, NULL if
+// there is none. Has to be freed.
+char *project_search_selected_hit(ProjectSearch *ps, size_t *row, size_t *col);
+
+// Returns whether event was a change notice of the search
+bool project_search_handle_event(ProjectSearch *ps, SDL_Event *event);
+
+// Draws the panel in screen space over the current frame
+void project_search_render(ProjectSearch *ps, Font *font, Renderer *renderer);
+
+void project_search_destroy(ProjectSearch *ps);
+
+#endif // SEARCH_H_
@@ -0,0 +1,76 @@
+#include "./selection_pass.h"
+
+#include <string.h>
+
+bool selection_pass_init(SelectionPass *pass) {
+    memset(pass, 0, sizeof(*pass));
+
+    glGenTextures(1, &pass->texture);
+    glBindTexture(GL_TEXTURE_2D, pass->texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(
+        GL_TEXTURE_2D, 0, GL_RG32F,
+        SELECTION_PASS_SPANS, SELECTION_PASS_MAX_ROWS, 0,
+        GL_RG, GL_FLOAT, NULL
+    );
+    return true;
+}
+
+void selection_pass_begin(SelectionPass *pass, size_t rows) {
+    pass->rows = rows < SELECTION_PASS_MAX_ROWS ? rows : SELECTION_PASS_MAX_ROWS;
+    memset(pass->counts, 0, pass->rows * sizeof(*pass->counts));
+    pass->width = 0.0f;
+}
+
+void selection_pass_add(SelectionPass *pass, size_t row, float x0, float x1) {
+    if(row >= pass->rows || x1 <= x0)
+        return;
+
+    size_t count = pass->counts[row];
+    if(count == SELECTION_PASS_SPANS) {
+        float *last = pass->spans[row][count - 1];
+        if(x0 < last[0]) last[0] = x0;
+        if(x1 > last[1]) last[1] = x1;
+    }
+    else {
+        pass->spans[row][count][0] = x0;
+        pass->spans[row][count][1] = x1;
+        pass->counts[row] = count + 1;
+    }
+    if(x1 > pass->width)
+        pass->width = x1;
+}
+
+void selection_pass_draw(SelectionPass *pass, Renderer *renderer, Vec2f pos, float row_height, Vec4f color) {
+    if(!pass->rows || pass->width <= 0.0f)
+        return;
+
+    // Unused spans are empty
+    for(size_t row = 0; row < pass->rows; ++row)
+        memset(pass->spans[row][pass->counts[row]], 0, (SELECTION_PASS_SPANS - pass->counts[row]) * sizeof(pass->spans[row][0]));
+
+    glActiveTexture(GL_TEXTURE0 + RENDERER_SELECTION_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, pass->texture);
+    glTexSubImage2D(
+        GL_TEXTURE_2D, 0,
+        0, 0, SELECTION_PASS_SPANS, (GLsizei) pass->rows,
+        GL_RG, GL_FLOAT, pass->spans
+    );
+    glActiveTexture(GL_TEXTURE0);
+
+    renderer_set_shader(renderer, SHADER_SELECTION);
+    glUniform2f(renderer->uniforms[UNIFORM_EXTENT], pass->width, (float) pass->rows);
+    renderer_textured_rect(
+        renderer,
+        pos, vec2f(pass->width, pass->rows * row_height),
+        vec2f(0.0f, 0.0f), vec2f(1.0f, 1.0f),
+        0,
+        color
+    );
+    renderer_flush(renderer);
+}
+
+void selection_pass_destroy(SelectionPass *pass) {
+    glDeleteTextures(1, &pass->texture);
+}
@@ -0,0 +1,42 @@
+#ifndef SELECTION_PASS_H_
+#define SELECTION_PASS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <GL/glew.h>
+
+#include "./vec.h"
+#include "./renderer.h"
+
+// Selection highlight of the visible rows drawn as one quad. The selected
+// x spans of every row go into a small float texture that the fragment
+// shader tests against, so the cost depends on the viewport only, however
+// many lines and ranges are selected.
+
+// Disjoint spans per visual row, further ones are merged into the last
+#define SELECTION_PASS_SPANS 8
+#define SELECTION_PASS_MAX_ROWS 1024
+
+typedef struct {
+    GLuint texture;
+    float spans[SELECTION_PASS_MAX_ROWS][SELECTION_PASS_SPANS][2];
+    size_t counts[SELECTION_PASS_MAX_ROWS];
+    size_t rows;
+    float width;
+} SelectionPass;
+
+bool selection_pass_init(SelectionPass *pass);
+
+// Starts collecting the spans of rows visual rows
+void selection_pass_begin(SelectionPass *pass, size_t rows);
+
+// Adds [x0, x1) to row, relative to the left edge of the text
+void selection_pass_add(SelectionPass *pass, size_t row, float x0, float x1);
+
+// Draws the collected spans with the first row at pos
+void selection_pass_draw(SelectionPass *pass, Renderer *renderer, Vec2f pos, float row_height, Vec4f color);
+
+void selection_pass_destroy(SelectionPass *pass);
+
+#endif // SELECTION_PASS_H_
@@ -9,6 +9,10 @@ size_t minul(size_t a, size_t b) {
     return a < b ? a : b;
 }
 
+size_t maxul(size_t a, size_t b) {
+    return a > b ? a : b;
+}
+
 char *strdup(const char *src) {
     size_t len = strlen(src) + 1;
     char *copy = malloc(len);
@@ -41,8 +45,51 @@ char *utils_add_asterisk_to_string(char *title) {
     return title;
 }
 
+char *utils_path_join(const char *dir, const char *name) {
+    size_t dir_length = strlen(dir), name_length = strlen(name);
+    char *path = (char *) malloc(dir_length + name_length + 2);
+    memcpy(path, dir, dir_length);
+    size_t pos = dir_length;
+    if(dir_length)
+        path[pos++] = '/';
+    memcpy(path + pos, name, name_length + 1);
+    return path;
+}
+
 size_t utils_find_next_line(const char *src, size_t pos, size_t src_length) {
     size_t i = pos;
     for(; i < src_length && src[i] && src[i] != '\n'; ++i);
     return i;
 }
+
+size_t utils_utf8_decode(const char *src, size_t src_length, uint32_t *codepoint) {
+    const unsigned char *s = (const unsigned char *) src;
+    size_t length;
+    uint32_t c, min;
+
+    if(s[0] < 0x80) {
+        *codepoint = s[0];
+        return 1;
+    }
+    else if((s[0] & 0xE0) == 0xC0) { length = 2; c = s[0] & 0x1F; min = 0x80; }
+    else if((s[0] & 0xF0) == 0xE0) { length = 3; c = s[0] & 0x0F; min = 0x800; }
+    else if((s[0] & 0xF8) == 0xF0) { length = 4; c = s[0] & 0x07; min = 0x10000; }
+    else goto invalid;
+
+    if(length > src_length)
+        goto invalid;
+    for(size_t i = 1; i < length; ++i) {
+        if((s[i] & 0xC0) != 0x80)
+            goto invalid;
+        c = (c << 6) | (s[i] & 0x3F);
+    }
+    if(c < min || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF))
+        goto invalid;
+
+    *codepoint = c;
+    return length;
+
+invalid:
+    *codepoint = 0xFFFD;
+    return 1;
+}
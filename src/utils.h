@@ -3,9 +3,12 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 size_t minul(size_t a, size_t b);
 
+size_t maxul(size_t a, size_t b);
+
 char *strdup(const char *src);
 
 bool utils_is_word_boundary(char c);
@@ -14,6 +17,13 @@ bool utils_string_has_asterisk(char *title);
 
 char *utils_add_asterisk_to_string(char *title);
 
+// dir/name, just name when dir is empty. Has to be freed.
+char *utils_path_join(const char *dir, const char *name);
+
 size_t utils_find_next_line(const char *src, size_t pos, size_t src_length);
 
+// Decodes one UTF-8 sequence, returns the number of bytes consumed (at least 1).
+// Malformed input decodes to U+FFFD one byte at a time.
+size_t utils_utf8_decode(const char *src, size_t src_length, uint32_t *codepoint);
+
 #endif // UTILS_H_